@@ -0,0 +1,656 @@
+// Compares every registered image backend on throughput and size,
+// the built-in WAV reader/writer against libsndfile, resampler throughput,
+// batch conversion of many short clips (files/s) with each I/O path, repeated in-memory conversions with and
+// without a ConversionContext (time and heap allocations) and the peak RSS of encoding generated recordings of growing size.
+// Usage: SoundImageConverterBench [seconds] [workdir] [clips] [largest peak RSS input MiB]
+// Prints markdown tables, one row per layout and codec / stage.
+#include "SoundImageConverter/Converter.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/WavFile.h"
+#include "SoundImageConverter/Resampler.h"
+#include "SoundImageConverter/BatchConverter.h"
+#include "SyntheticAudio.h"
+#include <sndfile.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every operator new is counted, so the tables can show what a conversion allocates
+namespace
+{
+	std::atomic<uint64_t> heapAllocations{ 0 };
+}
+
+void* operator new(size_t size)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = std::malloc(size != 0 ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	size_t alignment = static_cast<size_t>(align);
+#ifdef _WIN32
+	void* p = _aligned_malloc(size != 0 ? size : 1, alignment);
+#else
+	void* p = std::aligned_alloc(alignment, (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment);
+#endif
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+	operator delete(p, std::align_val_t());
+}
+
+namespace
+{
+	struct Layout
+	{
+		const char* name;
+		int channels;
+		int format;
+	};
+
+	// Music-like test signal: a few partials with slow vibrato plus a little noise
+	bool writeSyntheticWav(const std::string& path, const Layout& layout, int sampleRate, int seconds)
+	{
+		SF_INFO sfInfo = {};
+		sfInfo.samplerate = sampleRate;
+		sfInfo.channels = layout.channels;
+		sfInfo.format = layout.format;
+		SNDFILE* file = sf_open(path.c_str(), SFM_WRITE, &sfInfo);
+		if (!file)
+		{
+			std::cerr << "Error: Could not create " << path << std::endl;
+			return false;
+		}
+
+		const double pi = 3.14159265358979323846;
+		uint32_t noise = 12345;
+		std::vector<int16_t> block(4096 * layout.channels);
+		sf_count_t totalFrames = static_cast<sf_count_t>(sampleRate) * seconds;
+		for (sf_count_t done = 0; done < totalFrames;)
+		{
+			sf_count_t frames = std::min<sf_count_t>(4096, totalFrames - done);
+			for (sf_count_t i = 0; i < frames; i++)
+			{
+				double t = static_cast<double>(done + i) / sampleRate;
+				double vibrato = 1.0 + 0.002 * std::sin(2 * pi * 5 * t);
+				double v = 0.35 * std::sin(2 * pi * 220 * vibrato * t) +
+						   0.20 * std::sin(2 * pi * 440 * vibrato * t) +
+						   0.10 * std::sin(2 * pi * 1320 * t);
+				for (int c = 0; c < layout.channels; c++)
+				{
+					noise = noise * 1664525u + 1013904223u;
+					double n = (static_cast<int>(noise >> 16) - 32768) / 32768.0 * 0.01;
+					double s = (c == 0 ? v : 0.8 * v) + n;
+					block[i * layout.channels + c] = static_cast<int16_t>(std::lround(s * 32767));
+				}
+			}
+			sf_writef_short(file, block.data(), frames);
+			done += frames;
+		}
+		sf_close(file);
+		return true;
+	}
+
+	// Read stage: whole file into interleaved shorts, as the encoder does
+	bool readWithSndfile(const std::string& path, std::vector<int16_t>& samples)
+	{
+		SF_INFO sfInfo = {};
+		SNDFILE* file = sf_open(path.c_str(), SFM_READ, &sfInfo);
+		if (!file)
+		{
+			return false;
+		}
+		samples.resize(static_cast<size_t>(sfInfo.frames) * sfInfo.channels);
+		bool ok = sf_readf_short(file, samples.data(), sfInfo.frames) == sfInfo.frames;
+		sf_close(file);
+		return ok;
+	}
+
+	bool readWithWavReader(const std::string& path, std::vector<int16_t>& samples)
+	{
+		std::unique_ptr<SoundImageConverter::InputStream> in = SoundImageConverter::openInputFile(path);
+		SoundImageConverter::WavReader reader;
+		SoundImageConverter::WavFormat format;
+		if (!in || !reader.open(*in, format))
+		{
+			return false;
+		}
+		samples.resize(static_cast<size_t>(format.frames) * format.channels);
+		return reader.readFrames(samples.data(), static_cast<size_t>(format.frames)) == format.frames;
+	}
+
+	// Write stage: the decoder's output path
+	bool writeWithSndfile(const std::string& path, const std::vector<int16_t>& samples, const SF_INFO& layoutInfo)
+	{
+		SF_INFO sfInfo = layoutInfo;
+		SNDFILE* file = sf_open(path.c_str(), SFM_WRITE, &sfInfo);
+		if (!file)
+		{
+			return false;
+		}
+		sf_count_t frames = static_cast<sf_count_t>(samples.size() / sfInfo.channels);
+		bool ok = sf_writef_short(file, samples.data(), frames) == frames;
+		sf_close(file);
+		return ok;
+	}
+
+	bool writeWithWavWriter(const std::string& path, const std::vector<int16_t>& samples, const SF_INFO& layoutInfo)
+	{
+		SoundImageConverter::WavFormat format;
+		format.sampleRate = static_cast<uint32_t>(layoutInfo.samplerate);
+		format.channels = layoutInfo.channels;
+		format.bitsPerSample = (layoutInfo.format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_16 ? 16 : 8;
+		format.frames = samples.size() / layoutInfo.channels;
+		SoundImageConverter::FileOutputStream out;
+		SoundImageConverter::WavWriter writer;
+		return out.open(path) && writer.begin(out, format) &&
+			   writer.writeFrames(samples.data(), static_cast<size_t>(format.frames)) && writer.finish() && out.close();
+	}
+
+	// Resamples seconds of noise-like input in encoder-sized blocks, returns false if the ratio is unsupported
+	bool resampleBlocks(uint32_t inRate, uint32_t outRate, int channels, const std::vector<int16_t>& input, std::vector<int16_t>& output)
+	{
+		SoundImageConverter::Resampler resampler;
+		if (!resampler.init(inRate, outRate, channels))
+		{
+			return false;
+		}
+		output.clear();
+		const size_t blockFrames = 16384;
+		size_t frames = input.size() / channels;
+		for (size_t done = 0; done < frames; done += blockFrames)
+		{
+			resampler.process(input.data() + done * channels, std::min(blockFrames, frames - done), output);
+		}
+		resampler.flush(output);
+		return true;
+	}
+
+	// Encodes wav to an image in memory and decodes it again, as the daemon does for each request
+	bool roundTrip(const std::vector<uint8_t>& wav, const std::string& imageName, SoundImageConverter::ConversionContext* context,
+		std::vector<uint8_t>& image, std::vector<uint8_t>& decoded)
+	{
+		image.clear();
+		decoded.clear();
+		SoundImageConverter::EncodeOptions encodeOptions;
+		encodeOptions.pipeline = false;
+		encodeOptions.context = context;
+		encodeOptions.log = nullptr;
+		SoundImageConverter::DecodeOptions decodeOptions;
+		decodeOptions.output = SoundImageConverter::AudioOutputWav;
+		decodeOptions.pipeline = false;
+		decodeOptions.context = context;
+		decodeOptions.log = nullptr;
+		SoundImageConverter::MemoryInputStream wavIn(wav.data(), wav.size());
+		SoundImageConverter::MemoryOutputStream imageOut(image);
+		if (!SoundImageConverter::Encoder::encode(wavIn, "clip.wav", imageOut, imageName, encodeOptions).ok())
+		{
+			return false;
+		}
+		SoundImageConverter::MemoryInputStream imageIn(image.data(), image.size());
+		SoundImageConverter::MemoryOutputStream wavOut(decoded);
+		return SoundImageConverter::Decoder::decode(imageIn, imageName, wavOut, "clip.wav", decodeOptions).ok();
+	}
+
+	// Writes count 0.1 s mono clips at 22.05 kHz (about 4 KB each), the small-file case of batch mode
+	bool writeClips(const std::filesystem::path& dir, size_t count, std::vector<SoundImageConverter::BatchJob>& jobs, const std::filesystem::path& outDir, const char* extension)
+	{
+		std::filesystem::create_directories(dir);
+		std::filesystem::create_directories(outDir);
+		SoundImageConverter::WavFormat format;
+		format.sampleRate = 22050;
+		format.channels = 1;
+		format.bitsPerSample = 16;
+		format.frames = 2205;
+		std::vector<int16_t> samples(format.frames);
+		uint32_t noise = 12345;
+		jobs.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			for (size_t s = 0; s < samples.size(); s++)
+			{
+				noise = noise * 1664525u + 1013904223u;
+				samples[s] = static_cast<int16_t>(8000 * std::sin(0.05 * (s + i)) + static_cast<int>(noise >> 24));
+			}
+			std::string name = "clip" + std::to_string(i);
+			SoundImageConverter::BatchJob job;
+			job.input = (dir / (name + ".wav")).string();
+			job.output = (outDir / (name + extension)).string();
+			jobs.push_back(job);
+
+			SoundImageConverter::FileOutputStream out;
+			SoundImageConverter::WavWriter writer;
+			if (!out.open(job.input) || !writer.begin(out, format) || !writer.writeFrames(samples.data(), samples.size()) || !writer.finish() || !out.close())
+			{
+				std::cerr << "Error: Could not create " << job.input << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Counts what is written and drops it
+	class DiscardOutputStream : public SoundImageConverter::OutputStream
+	{
+	public:
+		bool write(const void*, size_t size) override
+		{
+			bytes_ += size;
+			return true;
+		}
+
+		uint64_t bytes() const { return bytes_; }
+
+	private:
+		uint64_t bytes_ = 0;
+	};
+
+	// A field of /proc/self/status in KiB (VmRSS, VmHWM), 0 where there is none
+	uint64_t statusKiB(const std::string& field)
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			if (line.compare(0, field.size() + 1, field + ":") == 0)
+			{
+				return std::strtoull(line.c_str() + field.size() + 1, nullptr, 10);
+			}
+		}
+		return 0;
+	}
+
+	// Starts a new peak: on Linux 4.0 and later, writing 5 to clear_refs sets VmHWM back to the current RSS
+	bool resetPeakRss()
+	{
+		std::ofstream clearRefs("/proc/self/clear_refs");
+		return clearRefs && (clearRefs << "5").flush() && statusKiB("VmHWM") > 0;
+	}
+
+	// Runs fn `repeats` times and returns the best wall time in seconds
+	template <typename Fn>
+	double bestOf(int repeats, Fn fn, bool& ok)
+	{
+		double best = 1e30;
+		for (int i = 0; i < repeats; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			ok = fn() && ok;
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+		return best;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int seconds = argc > 1 ? std::atoi(argv[1]) : 60;
+	std::filesystem::path workDir = argc > 2 ? argv[2] : std::filesystem::temp_directory_path() / "sic_bench";
+	size_t clips = argc > 3 ? static_cast<size_t>(std::atol(argv[3])) : 50000;
+	uint64_t peakMiB = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 256;
+
+	std::filesystem::create_directories(workDir);
+
+	const int sampleRate = 44100;
+	const int repeats = 3;
+	const Layout layouts[] = {
+		{ "8-bit stereo", 2, SF_FORMAT_WAV | SF_FORMAT_PCM_U8 },
+		{ "16-bit mono", 1, SF_FORMAT_WAV | SF_FORMAT_PCM_16 },
+		{ "16-bit stereo", 2, SF_FORMAT_WAV | SF_FORMAT_PCM_16 },
+	};
+
+	std::ostringstream table;
+	table << "| Layout | Codec | Encode MB/s | Decode MB/s | Image size (KiB) | Size vs WAV |\n";
+	table << "|---|---|---:|---:|---:|---:|\n";
+	std::ostringstream wavTable;
+	wavTable << "| Layout | Stage | libsndfile MB/s | Built-in MB/s |\n";
+	wavTable << "|---|---|---:|---:|\n";
+
+	bool ok = true;
+	for (const Layout& layout : layouts)
+	{
+		std::string wavPath = (workDir / (std::string("input_") + std::to_string(layout.channels) + "_" + std::to_string(layout.format) + ".wav")).string();
+		if (!writeSyntheticWav(wavPath, layout, sampleRate, seconds))
+		{
+			return 1;
+		}
+		double wavMB = std::filesystem::file_size(wavPath) / (1024.0 * 1024.0);
+
+		// WAV stages in isolation
+		std::vector<int16_t> samples;
+		SF_INFO layoutInfo = {};
+		layoutInfo.samplerate = sampleRate;
+		layoutInfo.channels = layout.channels;
+		layoutInfo.format = layout.format;
+		std::string stagePath = (workDir / "stage.wav").string();
+		double readSndfile = bestOf(repeats, [&]() { return readWithSndfile(wavPath, samples); }, ok);
+		double readBuiltin = bestOf(repeats, [&]() { return readWithWavReader(wavPath, samples); }, ok);
+		double writeSndfile = bestOf(repeats, [&]() { return writeWithSndfile(stagePath, samples, layoutInfo); }, ok);
+		double writeBuiltin = bestOf(repeats, [&]() { return writeWithWavWriter(stagePath, samples, layoutInfo); }, ok);
+		wavTable << std::fixed << std::setprecision(1)
+				 << "| " << layout.name << " | read | " << wavMB / readSndfile << " | " << wavMB / readBuiltin << " |\n"
+				 << "| " << layout.name << " | write | " << wavMB / writeSndfile << " | " << wavMB / writeBuiltin << " |\n";
+
+		for (const auto& codec : SoundImageConverter::ImageCodecRegistry::instance().codecs())
+		{
+			std::string imagePath = (workDir / ("image" + codec->extensions().front())).string();
+			std::string outPath = (workDir / "decoded.wav").string();
+
+			// The converter logs to stdout, keep the table readable
+			std::ostringstream sink;
+			std::streambuf* saved = std::cout.rdbuf(sink.rdbuf());
+			double encodeTime = bestOf(repeats, [&]() { return SoundImageConverter::Encoder::encode(wavPath, imagePath); }, ok);
+			double decodeTime = bestOf(repeats, [&]() { return SoundImageConverter::Decoder::decode(imagePath, outPath); }, ok);
+			std::cout.rdbuf(saved);
+
+			double imageKiB = std::filesystem::file_size(imagePath) / 1024.0;
+			table << "| " << layout.name << " | " << codec->name() << std::fixed << std::setprecision(1)
+				  << " | " << wavMB / encodeTime
+				  << " | " << wavMB / decodeTime
+				  << " | " << imageKiB
+				  << " | " << std::setprecision(2) << imageKiB / (wavMB * 1024.0) << "x |\n";
+		}
+	}
+
+	// Resampler on its own, one thread
+	std::ostringstream resamplerTable;
+	resamplerTable << "| Conversion | Channels | Input Mframes/s | Realtime factor |\n";
+	resamplerTable << "|---|---:|---:|---:|\n";
+	const uint32_t conversions[][2] = { { 48000, 16000 }, { 44100, 16000 }, { 44100, 48000 }, { 48000, 44100 } };
+	for (const auto& conversion : conversions)
+	{
+		for (int channels = 1; channels <= 2; channels++)
+		{
+			size_t frames = static_cast<size_t>(conversion[0]) * seconds;
+			std::vector<int16_t> input(frames * channels);
+			uint32_t noise = 12345;
+			for (int16_t& sample : input)
+			{
+				noise = noise * 1664525u + 1013904223u;
+				sample = static_cast<int16_t>(noise >> 17);
+			}
+			std::vector<int16_t> output;
+			double time = bestOf(repeats, [&]() { return resampleBlocks(conversion[0], conversion[1], channels, input, output); }, ok);
+			resamplerTable << "| " << conversion[0] << " -> " << conversion[1] << " Hz | " << channels << std::fixed << std::setprecision(1)
+						   << " | " << frames / time / 1e6
+						   << " | " << std::setprecision(0) << seconds / time << "x |\n";
+		}
+	}
+
+	// The same 0.5 s clip converted over and over in memory, with every buffer allocated anew and with one
+	// ConversionContext kept across the conversions. Allocations are counted after a first, warming round trip
+	std::ostringstream reuseTable;
+	reuseTable << "| Codec | Round trips | us per round trip | With context | Allocations per round trip | With context |\n";
+	reuseTable << "|---|---:|---:|---:|---:|---:|\n";
+	{
+		SoundImageConverter::WavFormat format;
+		format.sampleRate = 44100;
+		format.channels = 2;
+		format.bitsPerSample = 16;
+		format.frames = 22050;
+		std::vector<int16_t> samples(static_cast<size_t>(format.frames) * 2);
+		for (size_t s = 0; s < samples.size(); s++)
+		{
+			samples[s] = static_cast<int16_t>(12000 * std::sin(0.02 * static_cast<double>(s / 2)) + static_cast<int>(s * 7919 % 61));
+		}
+		std::vector<uint8_t> wav;
+		SoundImageConverter::MemoryOutputStream wavOut(wav);
+		SoundImageConverter::WavWriter writer;
+		ok = writer.begin(wavOut, format) && writer.writeFrames(samples.data(), samples.size() / 2) && writer.finish() && ok;
+
+		// Short batches, alternating between the two, and the best batch of each: the difference is small next
+		// to the noise of a shared machine
+		const int rounds = 20;
+		const int batches = 10 * repeats;
+		std::vector<uint8_t> image;
+		std::vector<uint8_t> decoded;
+		image.reserve(wav.size() * 4);
+		decoded.reserve(wav.size() * 2);
+		for (const auto& codec : SoundImageConverter::ImageCodecRegistry::instance().codecs())
+		{
+			std::string imageName = "clip" + codec->extensions().front();
+			SoundImageConverter::ConversionContext context;
+			double micros[2] = { 1e30, 1e30 };
+			uint64_t allocations[2] = {};
+			ok = roundTrip(wav, imageName, nullptr, image, decoded) && roundTrip(wav, imageName, &context, image, decoded) && ok;
+			for (int batch = 0; batch < batches; batch++)
+			{
+				for (int reuse = 0; reuse < 2; reuse++)
+				{
+					uint64_t before = heapAllocations.load();
+					double time = bestOf(1, [&]()
+					{
+						bool converted = true;
+						for (int i = 0; i < rounds; i++)
+						{
+							converted = roundTrip(wav, imageName, reuse ? &context : nullptr, image, decoded) && converted;
+						}
+						return converted;
+					}, ok);
+					allocations[reuse] += heapAllocations.load() - before;
+					micros[reuse] = std::min(micros[reuse], time / rounds * 1e6);
+				}
+			}
+			reuseTable << "| " << codec->name() << " | " << rounds * batches << std::fixed << std::setprecision(0)
+					   << " | " << micros[0] << " | " << micros[1] << std::setprecision(1)
+					   << " | " << static_cast<double>(allocations[0]) / (rounds * batches)
+					   << " | " << static_cast<double>(allocations[1]) / (rounds * batches) << " |\n";
+		}
+	}
+
+	// Batch mode on a directory of short clips, one thread, warm page cache.
+	// One file at a time through the path API, then BatchConverter with blocking I/O and with io_uring
+	std::ostringstream batchTable;
+	batchTable << "| Direction | Files | One at a time files/s | Batch pread/pwrite files/s | Batch io_uring files/s |\n";
+	batchTable << "|---|---:|---:|---:|---:|\n";
+	std::vector<SoundImageConverter::BatchJob> encodeJobs;
+	if (clips > 0 && writeClips(workDir / "clips", clips, encodeJobs, workDir / "clip_images", ".qoi"))
+	{
+		std::vector<SoundImageConverter::BatchJob> decodeJobs;
+		for (const SoundImageConverter::BatchJob& job : encodeJobs)
+		{
+			SoundImageConverter::BatchJob decodeJob;
+			decodeJob.input = job.output;
+			decodeJob.output = job.input + ".decoded.wav";
+			decodeJobs.push_back(decodeJob);
+		}
+
+		SoundImageConverter::BatchOptions options;
+		options.threads = 1;
+		bool ioUring = false;
+		for (int direction = 0; direction < 2; direction++)
+		{
+			const std::vector<SoundImageConverter::BatchJob>& jobs = direction == 0 ? encodeJobs : decodeJobs;
+			auto runBatch = [&](bool allowIoUring)
+			{
+				options.allowIoUring = allowIoUring;
+				SoundImageConverter::BatchResult result = direction == 0 ? SoundImageConverter::BatchConverter::encode(jobs, options)
+																		  : SoundImageConverter::BatchConverter::decode(jobs, options);
+				ioUring = ioUring || result.usedIoUring;
+				return result.failed == 0;
+			};
+			std::ostringstream sink;
+			std::streambuf* saved = std::cout.rdbuf(sink.rdbuf());
+			double single = bestOf(1, [&]()
+			{
+				bool converted = true;
+				for (const SoundImageConverter::BatchJob& job : jobs)
+				{
+					converted = (direction == 0 ? SoundImageConverter::Encoder::encode(job.input, job.output)
+												: SoundImageConverter::Decoder::decode(job.input, job.output)) && converted;
+				}
+				return converted;
+			}, ok);
+			std::cout.rdbuf(saved);
+			double blocking = bestOf(1, [&]() { return runBatch(false); }, ok);
+			double async = bestOf(1, [&]() { return runBatch(true); }, ok);
+			batchTable << "| " << (direction == 0 ? "wav -> qoi" : "qoi -> wav") << " | " << jobs.size() << std::fixed << std::setprecision(0)
+					   << " | " << jobs.size() / single
+					   << " | " << jobs.size() / blocking
+					   << " | " << jobs.size() / async << (ioUring ? "" : " (unavailable, ran blocking)") << " |\n";
+		}
+	}
+
+	// Batch mode on a mixed directory: short clips plus one long recording that would otherwise finish alone.
+	// Compared with the single-thread time divided by the thread count, the best the threads could do
+	std::ostringstream mixedTable;
+	mixedTable << "| Threads | Files | Seconds | 1-thread seconds / threads | Steals |\n";
+	mixedTable << "|---:|---:|---:|---:|---:|\n";
+	std::vector<SoundImageConverter::BatchJob> mixedJobs;
+	if (clips > 0 && writeClips(workDir / "mixed", std::min<size_t>(clips, 2000), mixedJobs, workDir / "mixed_images", ".qoi"))
+	{
+		// Ten minutes of 44.1 kHz mono, written in chunks
+		SoundImageConverter::BatchJob job;
+		job.input = (workDir / "mixed" / "long.wav").string();
+		job.output = (workDir / "mixed_images" / "long.qoi").string();
+		SoundImageConverter::WavFormat format;
+		format.sampleRate = 44100;
+		format.channels = 1;
+		format.bitsPerSample = 16;
+		format.frames = 600 * 44100;
+		std::vector<int16_t> chunk(44100);
+		SoundImageConverter::FileOutputStream out;
+		SoundImageConverter::WavWriter writer;
+		bool written = out.open(job.input) && writer.begin(out, format);
+		for (uint64_t frame = 0; written && frame < format.frames; frame += chunk.size())
+		{
+			for (size_t s = 0; s < chunk.size(); s++)
+			{
+				chunk[s] = static_cast<int16_t>(12000 * std::sin(0.01 * static_cast<double>(frame + s)));
+			}
+			written = writer.writeFrames(chunk.data(), chunk.size());
+		}
+		written = written && writer.finish() && out.close();
+		ok = ok && written;
+		mixedJobs.push_back(job);
+
+		std::vector<unsigned> threadCounts{ 1 };
+		if (std::thread::hardware_concurrency() > 1)
+		{
+			threadCounts.push_back(std::thread::hardware_concurrency());
+		}
+		SoundImageConverter::BatchOptions options;
+		double oneThread = 0;
+		for (unsigned threads : threadCounts)
+		{
+			if (!written)
+			{
+				break;
+			}
+			options.threads = threads;
+			uint64_t steals = 0;
+			double time = bestOf(1, [&]()
+			{
+				SoundImageConverter::BatchResult result = SoundImageConverter::BatchConverter::encode(mixedJobs, options);
+				steals = result.steals;
+				return result.failed == 0;
+			}, ok);
+			oneThread = threads == 1 ? time : oneThread;
+			mixedTable << "| " << threads << " | " << mixedJobs.size() << std::fixed << std::setprecision(2)
+					   << " | " << time << " | " << oneThread / threads << " | " << steals << " |\n";
+		}
+	}
+
+	// Peak RSS of encoding 16-bit mono recordings of 1/64, 1/8 and all of peakMiB, generated while the encoder reads them
+	// and dropped once encoded, so what grows is the converter's own memory. The peak is reset before each encode
+	std::ostringstream peakTable;
+	peakTable << "| Codec | Input MiB | Image MiB | Seconds | Peak RSS growth MiB |\n";
+	peakTable << "|---|---:|---:|---:|---:|\n";
+	if (peakMiB > 0)
+	{
+		for (const auto& codec : SoundImageConverter::ImageCodecRegistry::instance().codecs())
+		{
+			for (uint64_t inputMiB : { std::max<uint64_t>(peakMiB / 64, 1), std::max<uint64_t>(peakMiB / 8, 1), peakMiB })
+			{
+				SoundImageConverter::SyntheticWavStream source(inputMiB << 19);
+				DiscardOutputStream image;
+				SoundImageConverter::EncodeOptions options;
+				options.log = nullptr;
+				bool reset = resetPeakRss();
+				uint64_t before = statusKiB("VmRSS");
+				double time = bestOf(1, [&]()
+				{
+					return SoundImageConverter::Encoder::encode(source, "synthetic.wav", image, "peak" + codec->extensions().front(), options).ok();
+				}, ok);
+				uint64_t peak = statusKiB("VmHWM");
+				peakTable << "| " << codec->name() << " | " << inputMiB << std::fixed << std::setprecision(1)
+						  << " | " << image.bytes() / 1048576.0 << std::setprecision(2) << " | " << time << std::setprecision(1) << " | ";
+				if (reset && peak >= before)
+				{
+					peakTable << (peak - before) / 1024.0 << " |\n";
+				}
+				else
+				{
+					peakTable << "n/a |\n";
+				}
+			}
+		}
+	}
+
+	std::cout << "Input: " << seconds << " s at " << sampleRate << " Hz, best of " << repeats << " runs, MB/s of WAV data\n\n";
+	std::cout << table.str();
+	std::cout << "\n" << wavTable.str();
+	std::cout << "\n" << resamplerTable.str();
+	std::cout << "\n" << reuseTable.str();
+	std::cout << "\n" << batchTable.str();
+	std::cout << "\n" << mixedTable.str();
+	if (peakMiB > 0)
+	{
+		std::cout << "\n" << peakTable.str();
+	}
+	if (!ok)
+	{
+		std::cerr << "Error: one or more conversions failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
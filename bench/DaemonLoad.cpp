@@ -0,0 +1,271 @@
+// Load generator for sic-daemon: several connections send encode, then decode, requests back to back
+// and the latency of every request is recorded, once with the data copied through the socket and once
+// passed as shared memory descriptors.
+// Usage: SoundImageConverterDaemonLoad <socket> [connections] [requests per connection] [seconds of audio] [type] [sic path]
+// With the path of the sic tool, the same encode is also timed as one process per request, the cost the daemon avoids.
+// Prints a markdown table: requests/s and the p50 / p99 / max latency seen by the client, and the p50 spent in the server.
+#include "SoundImageConverter/ConversionServer.h"
+#include "SoundImageConverter/SharedMemory.h"
+#include "SoundImageConverter/Stream.h"
+#include "SyntheticAudio.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+using namespace SoundImageConverter;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Sample
+	{
+		double client; // Microseconds
+		double server;
+	};
+
+	double percentile(std::vector<double>& values, double p)
+	{
+		if (values.empty())
+		{
+			return 0;
+		}
+		std::sort(values.begin(), values.end());
+		size_t index = std::min(values.size() - 1, static_cast<size_t>(values.size() * p));
+		return values[index];
+	}
+
+	void printRow(const std::string& mode, size_t connections, const std::vector<Sample>& samples, double seconds)
+	{
+		std::vector<double> client;
+		std::vector<double> server;
+		for (const Sample& sample : samples)
+		{
+			client.push_back(sample.client);
+			server.push_back(sample.server);
+		}
+		std::cout << std::fixed << std::setprecision(2) << "| " << mode << " | " << connections << " | " << samples.size() << " | "
+			<< samples.size() / std::max(seconds, 1e-9) << " | " << percentile(client, 0.5) / 1000 << " | "
+			<< percentile(client, 0.99) / 1000 << " | " << percentile(client, 1.0) / 1000 << " | ";
+		if (server.empty() || server.front() < 0)
+		{
+			std::cout << "- |" << std::endl;
+		}
+		else
+		{
+			std::cout << percentile(server, 0.5) / 1000 << " |" << std::endl;
+		}
+	}
+
+	// Runs connections clients of requests each; returns false if any connection failed
+	bool runLoad(const std::string& socketPath, const ServerRequest& request, const std::vector<uint8_t>& payload, bool shared,
+		size_t connections, size_t requests, std::vector<Sample>& samples, double& seconds)
+	{
+		std::vector<std::vector<Sample>> perConnection(connections);
+		std::vector<char> failed(connections, 0);
+		auto client = [&](size_t index)
+		{
+			ConversionClient connection;
+			if (!connection.connect(socketPath))
+			{
+				failed[index] = 1;
+				return;
+			}
+			std::vector<uint8_t> output;
+			ServerResponse response;
+#ifndef _WIN32
+			// The input is written to shared memory once and sent with every request, as a client producing it there
+			// would; the output memory is reused and mapped again only when the server had to grow it
+			SharedMemoryOutputStream input;
+			int sharedOutput = shared ? createSharedMemory("sic-load-output", 0) : -1;
+			uint64_t outputSize = 0;
+			MappedFile mapped;
+			if (shared && (!input.create(payload.size()) || !input.write(payload.data(), payload.size()) || !input.finish()
+				|| sharedOutput < 0 || !sealSharedMemorySize(sharedOutput)))
+			{
+				failed[index] = 1;
+				return;
+			}
+			struct DescriptorCloser
+			{
+				int fd;
+				~DescriptorCloser() { if (fd >= 0) close(fd); }
+			} closeOutput{ sharedOutput };
+#endif
+			for (size_t i = 0; i < requests; i++)
+			{
+				Clock::time_point start = Clock::now();
+#ifndef _WIN32
+				bool sent = shared ? connection.convertShared(request, input.descriptor(), payload.size(), sharedOutput, outputSize, response)
+								   : connection.convert(request, payload.data(), payload.size(), output, response);
+				if (sent && shared && outputSize > mapped.size())
+				{
+					sent = mapped.openDescriptor(sharedOutput);
+				}
+#else
+				bool sent = connection.convert(request, payload.data(), payload.size(), output, response);
+#endif
+				if (!sent || response.error != ConversionOk)
+				{
+					failed[index] = 1;
+					return;
+				}
+				double micros = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+				perConnection[index].push_back(Sample{ micros, static_cast<double>(response.serverMicroseconds) });
+			}
+		};
+
+		Clock::time_point start = Clock::now();
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < connections; i++)
+		{
+			threads.emplace_back(client, i);
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		samples.clear();
+		for (const std::vector<Sample>& part : perConnection)
+		{
+			samples.insert(samples.end(), part.begin(), part.end());
+		}
+		return std::find(failed.begin(), failed.end(), 1) == failed.end();
+	}
+
+	// Times `sic encode in out` started as a new process per request
+	bool runProcesses(const std::string& sicPath, const std::vector<uint8_t>& wav, const std::string& type, size_t requests,
+		std::vector<Sample>& samples, double& seconds)
+	{
+#ifndef _WIN32
+		std::filesystem::path dir = std::filesystem::temp_directory_path();
+		std::string input = (dir / "sic_load_input.wav").string();
+		std::string output = (dir / ("sic_load_output." + type)).string();
+		std::ofstream(input, std::ios::binary).write(reinterpret_cast<const char*>(wav.data()), static_cast<std::streamsize>(wav.size()));
+
+		samples.clear();
+		Clock::time_point begin = Clock::now();
+		for (size_t i = 0; i < requests; i++)
+		{
+			char* args[] = { const_cast<char*>(sicPath.c_str()), const_cast<char*>("encode"), const_cast<char*>(input.c_str()),
+				const_cast<char*>(output.c_str()), nullptr };
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+			posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0); // stdout only takes the progress lines
+			Clock::time_point start = Clock::now();
+			pid_t pid;
+			int status = 0;
+			bool ok = posix_spawn(&pid, sicPath.c_str(), &actions, nullptr, args, environ) == 0 && waitpid(pid, &status, 0) == pid
+				&& WIFEXITED(status) && WEXITSTATUS(status) == 0;
+			posix_spawn_file_actions_destroy(&actions);
+			if (!ok)
+			{
+				std::cerr << "Error: " << sicPath << " encode failed" << std::endl;
+				return false;
+			}
+			samples.push_back(Sample{ std::chrono::duration<double, std::micro>(Clock::now() - start).count(), -1 });
+		}
+		seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+		std::filesystem::remove(input);
+		std::filesystem::remove(output);
+		return true;
+#else
+		(void)sicPath; (void)wav; (void)type; (void)requests; (void)samples; (void)seconds;
+		return false;
+#endif
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: SoundImageConverterDaemonLoad <socket> [connections] [requests per connection] [seconds of audio] [type] [sic path]" << std::endl;
+		return 1;
+	}
+	std::string socketPath = argv[1];
+	size_t connections = argc > 2 ? static_cast<size_t>(std::max(1, std::atoi(argv[2]))) : 4;
+	size_t requests = argc > 3 ? static_cast<size_t>(std::max(1, std::atoi(argv[3]))) : 200;
+	double audioSeconds = argc > 4 ? std::atof(argv[4]) : 3.0;
+	std::string type = argc > 5 ? argv[5] : "qoi";
+	std::string sicPath = argc > 6 ? argv[6] : "";
+
+	std::vector<uint8_t> wav = syntheticWav(audioSeconds);
+
+	// One request up front gives the image the decode runs use, and checks the daemon is there
+	ServerRequest encode;
+	encode.operation = ServerEncode;
+	encode.type = type;
+	ConversionClient probe;
+	std::vector<uint8_t> image;
+	ServerResponse response;
+	if (!probe.connect(socketPath) || !probe.convert(encode, wav.data(), wav.size(), image, response) || response.error != ConversionOk)
+	{
+		std::cerr << "Error: No working daemon on " << socketPath << std::endl;
+		return 1;
+	}
+	probe.close();
+	ServerRequest decode = encode;
+	decode.operation = ServerDecode;
+
+	std::cout << "Requests of " << audioSeconds << " s of 16-bit stereo 44.1 kHz audio (" << wav.size() / 1024 << " KiB WAV, "
+		<< image.size() / 1024 << " KiB " << type << ")" << std::endl << std::endl;
+	std::cout << "| Mode | Connections | Requests | Requests/s | p50 ms | p99 ms | Max ms | Server p50 ms |" << std::endl;
+	std::cout << "|---|---:|---:|---:|---:|---:|---:|---:|" << std::endl;
+
+	bool ok = true;
+	std::vector<Sample> samples;
+	double seconds = 0;
+	for (bool shared : { false, true })
+	{
+		std::string transport = shared ? " (memfd)" : " (socket)";
+		if (runLoad(socketPath, encode, wav, shared, connections, requests, samples, seconds))
+		{
+			printRow("daemon encode" + transport, connections, samples, seconds);
+		}
+		else
+		{
+			std::cerr << "Error: Encode requests failed" << transport << std::endl;
+			ok = false;
+		}
+		if (runLoad(socketPath, decode, image, shared, connections, requests, samples, seconds))
+		{
+			printRow("daemon decode" + transport, connections, samples, seconds);
+		}
+		else
+		{
+			std::cerr << "Error: Decode requests failed" << transport << std::endl;
+			ok = false;
+		}
+	}
+	if (!sicPath.empty())
+	{
+		if (runProcesses(sicPath, wav, type, std::min<size_t>(requests, 100), samples, seconds))
+		{
+			printRow("process per encode", 1, samples, seconds);
+		}
+		else
+		{
+			ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+// Load generator for the HTTP endpoint of sic-daemon (--http): keep-alive connections send encode, then decode,
+// requests back to back, each body chunked and sent from its own thread while the chunked answer is read, as a
+// streaming client would.
+// Usage: SoundImageConverterHttpLoad <port> [connections] [requests per connection] [seconds of audio] [type]
+// Prints a markdown table: requests/s, MB/s of request bodies and the p50 / p99 / max latency seen by the client.
+#include "SoundImageConverter/Stream.h"
+#include "SyntheticAudio.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace SoundImageConverter;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const size_t chunkBytes = 64 * 1024;
+
+	double percentile(std::vector<double>& values, double p)
+	{
+		if (values.empty())
+		{
+			return 0;
+		}
+		std::sort(values.begin(), values.end());
+		size_t index = std::min(values.size() - 1, static_cast<size_t>(values.size() * p));
+		return values[index];
+	}
+
+#ifndef _WIN32
+	bool sendAll(int fd, const void* data, size_t size)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		while (size > 0)
+		{
+			ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (sent <= 0)
+			{
+				return false;
+			}
+			p += sent;
+			size -= static_cast<size_t>(sent);
+		}
+		return true;
+	}
+
+	// One keep-alive HTTP connection with a small read buffer
+	class HttpClient
+	{
+	public:
+		~HttpClient()
+		{
+			if (fd_ >= 0)
+			{
+				close(fd_);
+			}
+		}
+
+		bool connect(uint16_t port)
+		{
+			fd_ = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_port = htons(port);
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			int on = 1;
+			return fd_ >= 0 && ::connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0
+				&& setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == 0;
+		}
+
+		// POSTs body in chunks from another thread while the answer is read; output receives the answer's body
+		bool post(const std::string& target, const std::vector<uint8_t>& body, int& status, std::vector<uint8_t>& output)
+		{
+			bool sent = true;
+			std::thread sender([&]()
+				{
+					std::string head = "POST " + target + " HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+					sent = sendAll(fd_, head.data(), head.size());
+					for (size_t offset = 0; sent && offset < body.size(); offset += chunkBytes)
+					{
+						size_t size = std::min(chunkBytes, body.size() - offset);
+						char sizeLine[32];
+						int length = std::snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", size);
+						sent = sendAll(fd_, sizeLine, static_cast<size_t>(length)) && sendAll(fd_, body.data() + offset, size) && sendAll(fd_, "\r\n", 2);
+					}
+					sent = sent && sendAll(fd_, "0\r\n\r\n", 5);
+				});
+			bool received = readAnswer(status, output);
+			sender.join();
+			return sent && received;
+		}
+
+	private:
+		bool readAnswer(int& status, std::vector<uint8_t>& output)
+		{
+			output.clear();
+			std::string line;
+			if (!readLine(line) || line.size() < 12)
+			{
+				return false;
+			}
+			status = std::atoi(line.c_str() + 9);
+			bool chunked = false;
+			uint64_t length = 0;
+			while (readLine(line) && !line.empty())
+			{
+				std::string lower = line;
+				std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+				if (lower.compare(0, 18, "transfer-encoding:") == 0)
+				{
+					chunked = lower.find("chunked") != std::string::npos;
+				}
+				else if (lower.compare(0, 15, "content-length:") == 0)
+				{
+					length = std::strtoull(lower.c_str() + 15, nullptr, 10);
+				}
+			}
+			if (!chunked)
+			{
+				return readBytes(output, length);
+			}
+			for (;;)
+			{
+				if (!readLine(line))
+				{
+					return false;
+				}
+				uint64_t size = std::strtoull(line.c_str(), nullptr, 16);
+				if (size == 0)
+				{
+					return readLine(line) && line.empty();
+				}
+				if (!readBytes(output, size) || !readLine(line) || !line.empty())
+				{
+					return false;
+				}
+			}
+		}
+
+		bool fill()
+		{
+			ssize_t got;
+			do
+			{
+				got = recv(fd_, buffer_, sizeof(buffer_), 0);
+			} while (got < 0 && errno == EINTR);
+			begin_ = 0;
+			end_ = got > 0 ? static_cast<size_t>(got) : 0;
+			return got > 0;
+		}
+
+		bool readLine(std::string& line)
+		{
+			line.clear();
+			for (;;)
+			{
+				if (begin_ == end_ && !fill())
+				{
+					return false;
+				}
+				char c = buffer_[begin_++];
+				if (c == '\n')
+				{
+					if (!line.empty() && line.back() == '\r')
+					{
+						line.pop_back();
+					}
+					return true;
+				}
+				line += c;
+			}
+		}
+
+		bool readBytes(std::vector<uint8_t>& output, uint64_t size)
+		{
+			while (size > 0)
+			{
+				if (begin_ == end_ && !fill())
+				{
+					return false;
+				}
+				size_t take = static_cast<size_t>(std::min<uint64_t>(size, end_ - begin_));
+				output.insert(output.end(), buffer_ + begin_, buffer_ + begin_ + take);
+				begin_ += take;
+				size -= take;
+			}
+			return true;
+		}
+
+		int fd_ = -1;
+		uint8_t buffer_[chunkBytes];
+		size_t begin_ = 0;
+		size_t end_ = 0;
+	};
+
+	// Runs connections clients of requests each; returns false if any request failed
+	bool runLoad(uint16_t port, const std::string& target, const std::vector<uint8_t>& body, size_t connections, size_t requests,
+		std::vector<double>& latencies, double& seconds)
+	{
+		std::vector<std::vector<double>> perConnection(connections);
+		std::vector<char> failed(connections, 0);
+		auto client = [&](size_t index)
+		{
+			std::unique_ptr<HttpClient> connection(new HttpClient());
+			if (!connection->connect(port))
+			{
+				failed[index] = 1;
+				return;
+			}
+			std::vector<uint8_t> output;
+			for (size_t i = 0; i < requests; i++)
+			{
+				Clock::time_point start = Clock::now();
+				int status = 0;
+				if (!connection->post(target, body, status, output) || status != 200)
+				{
+					failed[index] = 1;
+					return;
+				}
+				perConnection[index].push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+			}
+		};
+
+		Clock::time_point start = Clock::now();
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < connections; i++)
+		{
+			threads.emplace_back(client, i);
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		latencies.clear();
+		for (const std::vector<double>& part : perConnection)
+		{
+			latencies.insert(latencies.end(), part.begin(), part.end());
+		}
+		return std::find(failed.begin(), failed.end(), 1) == failed.end();
+	}
+
+	void printRow(const std::string& mode, size_t connections, size_t bodyBytes, std::vector<double>& latencies, double seconds)
+	{
+		seconds = std::max(seconds, 1e-9);
+		std::cout << std::fixed << std::setprecision(2) << "| " << mode << " | " << connections << " | " << latencies.size() << " | "
+			<< latencies.size() / seconds << " | " << latencies.size() * static_cast<double>(bodyBytes) / seconds / 1e6 << " | "
+			<< percentile(latencies, 0.5) / 1000 << " | " << percentile(latencies, 0.99) / 1000 << " | " << percentile(latencies, 1.0) / 1000
+			<< " |" << std::endl;
+	}
+#endif
+}
+
+int main(int argc, char** argv)
+{
+#ifndef _WIN32
+	if (argc < 2)
+	{
+		std::cerr << "Usage: SoundImageConverterHttpLoad <port> [connections] [requests per connection] [seconds of audio] [type]" << std::endl;
+		return 1;
+	}
+	uint16_t port = static_cast<uint16_t>(std::atoi(argv[1]));
+	size_t connections = argc > 2 ? static_cast<size_t>(std::max(1, std::atoi(argv[2]))) : 4;
+	size_t requests = argc > 3 ? static_cast<size_t>(std::max(1, std::atoi(argv[3]))) : 200;
+	double audioSeconds = argc > 4 ? std::atof(argv[4]) : 3.0;
+	std::string type = argc > 5 ? argv[5] : "qoi";
+
+	std::vector<uint8_t> wav = syntheticWav(audioSeconds);
+
+	// One request up front gives the image the decode runs use, and checks the daemon is there
+	HttpClient probe;
+	std::vector<uint8_t> image;
+	int status = 0;
+	if (!probe.connect(port) || !probe.post("/encode?type=" + type, wav, status, image) || status != 200)
+	{
+		std::cerr << "Error: No working HTTP endpoint on 127.0.0.1:" << port << std::endl;
+		return 1;
+	}
+
+	std::cout << "Requests of " << audioSeconds << " s of 16-bit stereo 44.1 kHz audio (" << wav.size() / 1024 << " KiB WAV, "
+		<< image.size() / 1024 << " KiB " << type << ")" << std::endl << std::endl;
+	std::cout << "| Mode | Connections | Requests | Requests/s | MB/s in | p50 ms | p99 ms | Max ms |" << std::endl;
+	std::cout << "|---|---:|---:|---:|---:|---:|---:|---:|" << std::endl;
+
+	bool ok = true;
+	std::vector<double> latencies;
+	double seconds = 0;
+	if (runLoad(port, "/encode?type=" + type, wav, connections, requests, latencies, seconds))
+	{
+		printRow("HTTP encode", connections, wav.size(), latencies, seconds);
+	}
+	else
+	{
+		std::cerr << "Error: Encode requests failed" << std::endl;
+		ok = false;
+	}
+	if (runLoad(port, "/decode?type=" + type, image, connections, requests, latencies, seconds))
+	{
+		printRow("HTTP decode", connections, image.size(), latencies, seconds);
+	}
+	else
+	{
+		std::cerr << "Error: Decode requests failed" << std::endl;
+		ok = false;
+	}
+	return ok ? 0 : 1;
+#else
+	(void)argc;
+	(void)argv;
+	std::cerr << "Error: The HTTP load generator is only built on POSIX systems" << std::endl;
+	return 1;
+#endif
+}
@@ -0,0 +1,121 @@
+#include "SyntheticAudio.h"
+#include "SoundImageConverter/WavFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace SoundImageConverter
+{
+	std::vector<uint8_t> syntheticWav(double seconds)
+	{
+		WavFormat format;
+		format.sampleRate = 44100;
+		format.channels = 2;
+		format.bitsPerSample = 16;
+		format.frames = static_cast<uint64_t>(seconds * format.sampleRate);
+		std::vector<int16_t> samples(static_cast<size_t>(format.frames) * 2);
+		uint32_t noise = 12345;
+		for (size_t i = 0; i < format.frames; i++)
+		{
+			double t = static_cast<double>(i) / format.sampleRate;
+			double v = 0.4 * std::sin(2 * 3.14159265 * 220 * t) + 0.2 * std::sin(2 * 3.14159265 * 331 * t);
+			noise = noise * 1664525 + 1013904223;
+			samples[i * 2] = static_cast<int16_t>(v * 20000 + static_cast<int>(noise >> 24) - 128);
+			samples[i * 2 + 1] = static_cast<int16_t>(v * 18000);
+		}
+		std::vector<uint8_t> wav;
+		MemoryOutputStream out(wav);
+		WavWriter writer;
+		writer.begin(out, format);
+		writer.writeFrames(samples.data(), static_cast<size_t>(format.frames));
+		writer.finish();
+		return wav;
+	}
+
+	std::vector<uint8_t> smallWav(uint32_t sampleRate, int channels, uint64_t frames, std::optional<uint32_t> dataSize)
+	{
+		WavFormat format;
+		format.sampleRate = sampleRate;
+		format.channels = channels;
+		format.bitsPerSample = 16;
+		format.frames = frames;
+		std::vector<int16_t> samples(static_cast<size_t>(frames) * channels);
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			samples[i] = static_cast<int16_t>(i * 2654435761u >> 16);
+		}
+		std::vector<uint8_t> wav;
+		MemoryOutputStream out(wav);
+		WavWriter writer;
+		writer.begin(out, format);
+		writer.writeFrames(samples.data(), static_cast<size_t>(frames));
+		writer.finish();
+
+		if (dataSize)
+		{
+			auto data = std::search(wav.begin(), wav.end(), "data", "data" + 4);
+			for (int i = 0; i < 4; i++)
+			{
+				data[4 + i] = static_cast<uint8_t>(*dataSize >> (8 * i));
+			}
+		}
+		return wav;
+	}
+
+	bool check(bool condition, const std::string& what)
+	{
+		if (!condition)
+		{
+			std::cerr << "FAIL: " << what << std::endl;
+		}
+		return condition;
+	}
+
+	SyntheticWavStream::SyntheticWavStream(uint64_t frames) : table_(65521)
+	{
+		uint32_t noise = 12345;
+		for (size_t i = 0; i < table_.size(); i++)
+		{
+			noise = noise * 1664525u + 1013904223u;
+			table_[i] = static_cast<int16_t>(12000 * std::sin(0.0613 * i) + static_cast<int>(noise >> 24) - 128);
+		}
+		WavFormat format;
+		format.sampleRate = 8000;
+		format.channels = 1;
+		format.bitsPerSample = 16;
+		format.frames = frames;
+		MemoryOutputStream out(header_);
+		WavWriter writer;
+		writer.begin(out, format);
+		size_ = header_.size() + frames * 2;
+	}
+
+	size_t SyntheticWavStream::read(void* data, size_t size)
+	{
+		uint8_t* bytes = static_cast<uint8_t*>(data);
+		size = static_cast<size_t>(std::min<uint64_t>(size, size_ - pos_));
+		size_t headerBytes = pos_ < header_.size() ? std::min(size, static_cast<size_t>(header_.size() - pos_)) : 0;
+		if (headerBytes > 0)
+		{
+			std::memcpy(bytes, header_.data() + pos_, headerBytes);
+		}
+		samples(pos_ + headerBytes - header_.size(), bytes + headerBytes, size - headerBytes);
+		pos_ += size;
+		return size;
+	}
+
+	void SyntheticWavStream::samples(uint64_t offset, uint8_t* bytes, size_t size, bool asDecoded) const
+	{
+		size_t index = static_cast<size_t>((offset / 2) % table_.size());
+		for (size_t i = 0; i < size; i++, offset++)
+		{
+			uint16_t sample = static_cast<uint16_t>(table_[index]) & (asDecoded ? 0xff00 : 0xffff);
+			bytes[i] = static_cast<uint8_t>(offset % 2 == 0 ? sample : sample >> 8);
+			if (offset % 2 == 1 && ++index == table_.size())
+			{
+				index = 0;
+			}
+		}
+	}
+}
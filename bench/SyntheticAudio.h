@@ -0,0 +1,45 @@
+#ifndef SOUNDIMAGECONVERTER_SYNTHETICAUDIO_H
+#define SOUNDIMAGECONVERTER_SYNTHETICAUDIO_H
+
+// Generated audio shared by the benchmarks and the tests, and the tests' check
+#include "SoundImageConverter/Stream.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Music-like 16-bit stereo signal at 44.1 kHz, as a WAV file in memory
+	std::vector<uint8_t> syntheticWav(double seconds);
+
+	// Short 16-bit WAV of hashed samples, as a WAV file in memory. With dataSize, that replaces the size of the data
+	// chunk, e.g. the 0 or 0xFFFFFFFF a writer that never patched it leaves behind
+	std::vector<uint8_t> smallWav(uint32_t sampleRate, int channels, uint64_t frames, std::optional<uint32_t> dataSize = std::nullopt);
+
+	// Prints "FAIL: what" unless condition holds, and returns it; tests run every check and fail at the end
+	bool check(bool condition, const std::string& what);
+
+	// 16-bit mono WAV of any length, generated as it is read: RF64 header, then a table of tone plus noise
+	// whose period is not a multiple of the image width
+	class SyntheticWavStream : public InputStream
+	{
+	public:
+		explicit SyntheticWavStream(uint64_t frames);
+
+		size_t read(void* data, size_t size) override;
+
+		// size bytes of the 16-bit little-endian PCM, starting offset bytes into it.
+		// asDecoded gives what the decoder reproduces: the image keeps the top 8 bits of each sample
+		void samples(uint64_t offset, uint8_t* bytes, size_t size, bool asDecoded = false) const;
+
+	private:
+		std::vector<int16_t> table_;
+		std::vector<uint8_t> header_;
+		uint64_t size_ = 0;
+		uint64_t pos_ = 0;
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_SYNTHETICAUDIO_H
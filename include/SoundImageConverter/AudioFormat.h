@@ -0,0 +1,32 @@
+#ifndef SOUNDIMAGECONVERTER_AUDIOFORMAT_H
+#define SOUNDIMAGECONVERTER_AUDIOFORMAT_H
+
+#include <string>
+
+namespace SoundImageConverter
+{
+	// Mapping between libsndfile formats (container | subtype, see sndfile.h) and the image layouts
+	namespace AudioFormat
+	{
+		// Image bit depth for an input format: 8 for 8-bit PCM, 16 for everything else.
+		// Images hold at most 16 bits, so 24/32-bit, float and compressed sources are read as 16-bit.
+		int storedBitDepth(int format);
+
+		// True for the formats the built-in WAV reader and writer handle (8/16-bit PCM WAV)
+		bool isBuiltinWav(int format);
+
+		// Format to decode to. The container comes from the output extension, or from the original
+		// file if the extension is unknown. The original subtype is kept when that container and
+		// libsndfile can write it; otherwise the container's default at bitDepth is used.
+		// A sourceFormat of 0 (unknown) gives plain PCM WAV.
+		int outputFormat(const std::string& path, int sourceFormat, int bitDepth, int channels, int sampleRate);
+
+		// True if the extension names a container libsndfile knows (.wav, .flac, .ogg, .mp3, ...)
+		bool isAudioPath(const std::string& path);
+
+		// Short description for logs, e.g. "FLAC (16 bit PCM)"
+		std::string describe(int format);
+	}
+}
+
+#endif // SOUNDIMAGECONVERTER_AUDIOFORMAT_H
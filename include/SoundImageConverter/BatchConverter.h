@@ -0,0 +1,49 @@
+#ifndef SOUNDIMAGECONVERTER_BATCHCONVERTER_H
+#define SOUNDIMAGECONVERTER_BATCHCONVERTER_H
+
+#include "SoundImageConverter/Converter.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	struct BatchJob
+	{
+		std::string input;
+		std::string output;
+	};
+
+	struct BatchOptions
+	{
+		unsigned threads = 0; // 0 = one per core
+		unsigned queueDepth = 32; // Files in flight per thread: inputs read ahead plus outputs still being written
+		bool allowIoUring = true; // Off forces blocking pread/pwrite
+		EncodeOptions encode;
+		DecodeOptions decode;
+	};
+
+	struct BatchResult
+	{
+		size_t converted = 0;
+		size_t failed = 0;
+		bool usedIoUring = false;
+		uint64_t steals = 0; // Tasks that ran on another worker than the one they were queued on
+	};
+
+	// Converts many files, from directories of short clips, where per-file I/O costs more than the conversion,
+	// to mixes of clips and hours-long recordings. The calling thread reads inputs ahead and writes finished
+	// outputs behind through BatchIo; every file read becomes a task on a work-stealing TaskScheduler, and long
+	// files split their row work into subtasks, so no core idles while one worker is stuck on a big file.
+	// With one thread the calling thread converts as well. Per-file progress on std::cout is suppressed
+	// while a batch runs; errors still go to std::cerr.
+	class BatchConverter
+	{
+	public:
+		static BatchResult encode(const std::vector<BatchJob>& jobs, const BatchOptions& options);
+		static BatchResult decode(const std::vector<BatchJob>& jobs, const BatchOptions& options);
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_BATCHCONVERTER_H
@@ -0,0 +1,68 @@
+#ifndef SOUNDIMAGECONVERTER_BATCHIO_H
+#define SOUNDIMAGECONVERTER_BATCHIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Whole-file reads and writes for batch conversions, with many files in flight at once.
+	// On Linux the open, size, read/write and close of every file are queued on an io_uring
+	// (raw system calls, no liburing), so one io_uring_enter covers many small-file operations.
+	// Without io_uring (other systems, old kernels, sandboxes that block it) each request runs
+	// with blocking open/pread/pwrite/close when it is waited for.
+	class BatchIo
+	{
+	public:
+		struct Completion
+		{
+			size_t tag = 0;
+			bool write = false;
+			bool ok = false;
+			std::string path;
+			std::vector<uint8_t> data; // File contents for reads, the written buffer (for reuse) for writes
+		};
+
+		BatchIo();
+		~BatchIo();
+
+		BatchIo(const BatchIo&) = delete;
+		BatchIo& operator=(const BatchIo&) = delete;
+
+		// Sets how many files may be in flight at once and sets up io_uring if allowed and available.
+		// Always succeeds; usingIoUring() tells which path is taken
+		void init(unsigned queueDepth, bool allowIoUring = true);
+		bool usingIoUring() const { return ring_ != nullptr; }
+
+		// Queue reading the whole file at path, or replacing it with data.
+		// Requests start as soon as the queue depth allows and are submitted by the next wait()
+		void read(const std::string& path, size_t tag);
+		void write(const std::string& path, std::vector<uint8_t> data, size_t tag);
+
+		// Waits for the next finished request; returns false if nothing is queued or in flight
+		bool wait(Completion& completion);
+
+	private:
+		struct Request;
+		struct Ring;
+
+		void enqueue(std::unique_ptr<Request> request);
+		void startQueued();
+		void runBlocking(Request& request);
+		void handleCompletion(uint64_t userData, int result);
+		void finish(Request* request);
+		void abandonRing();
+
+		unsigned queueDepth_ = 32;
+		std::unique_ptr<Ring> ring_;
+		std::deque<std::unique_ptr<Request>> queued_;
+		std::vector<std::unique_ptr<Request>> inFlight_;
+		std::deque<std::unique_ptr<Request>> finished_;
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_BATCHIO_H
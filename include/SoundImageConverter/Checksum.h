@@ -0,0 +1,29 @@
+#ifndef SOUNDIMAGECONVERTER_CHECKSUM_H
+#define SOUNDIMAGECONVERTER_CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace SoundImageConverter
+{
+	namespace Checksum
+	{
+		// CRC32C (Castagnoli). Start with crc = 0 and feed the result back in to hash a stream in pieces.
+		// Uses the SSE4.2 crc32 instruction when the CPU has it, a table-driven fallback otherwise.
+		uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+		// CRC32C of A followed by B, from the CRC32C of A (first) and of B (second, started from 0)
+		// and the length of B. Lets parts of a stream be hashed on different threads
+		uint32_t combine(uint32_t first, uint32_t second, uint64_t secondSize);
+
+		// True if crc32c runs on the hardware instruction
+		bool hardwareAccelerated();
+
+		// Eight hex digits for messages, leading zeros included. Unlike std::hex this leaves the stream flags alone,
+		// so conversions running on several threads can share std::cout
+		std::string toHex(uint32_t crc);
+	}
+}
+
+#endif // SOUNDIMAGECONVERTER_CHECKSUM_H
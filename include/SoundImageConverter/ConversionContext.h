@@ -0,0 +1,162 @@
+#ifndef SOUNDIMAGECONVERTER_CONVERSIONCONTEXT_H
+#define SOUNDIMAGECONVERTER_CONVERSIONCONTEXT_H
+
+#include "SoundImageConverter/MemoryAccount.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	class ImageCodec;
+	class ImageSink;
+	class ImageSource;
+
+	const size_t cacheLineBytes = 64;
+
+	// Memory aligned to a cache line: a row block shares no line with other data, and vector loads from its start are aligned.
+	// Counted by the MemoryAccount current when it is allocated (see MemoryAccount.h)
+	template <typename T>
+	struct CacheAlignedAllocator
+	{
+		typedef T value_type;
+
+		CacheAlignedAllocator() = default;
+		template <typename U>
+		CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+		T* allocate(size_t count) { return static_cast<T*>(accountedAllocate(count * sizeof(T))); }
+		void deallocate(T* p, size_t) { accountedFree(p); }
+
+		template <typename U>
+		bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+		template <typename U>
+		bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+	};
+
+	template <typename T>
+	using AlignedVector = std::vector<T, CacheAlignedAllocator<T>>;
+
+	// What one worker keeps from one conversion to the next: its row and sample buffers, a sink and a source
+	// per image backend, and an arena that serves stb_image / stb_image_write allocations. Give each thread
+	// that converts its own (EncodeOptions::context, DecodeOptions::context); once everything has grown to
+	// the largest conversion seen, further conversions without resampling allocate nothing and touch no new pages.
+	// One conversion at a time
+	class ConversionContext
+	{
+	public:
+		ConversionContext();
+		~ConversionContext();
+
+		ConversionContext(const ConversionContext&) = delete;
+		ConversionContext& operator=(const ConversionContext&) = delete;
+
+		// An empty buffer with room for at least capacity elements: the smallest given back earlier that fits,
+		// else the largest, grown
+		template <typename T>
+		AlignedVector<T> take(size_t capacity);
+		// Keeps buffer for a later take
+		void give(AlignedVector<uint8_t>&& buffer);
+		void give(AlignedVector<int16_t>&& buffer);
+
+		// The backend's sink or source, created on first use. A source must be closed before the conversion ends
+		ImageSink& sink(const ImageCodec& codec);
+		ImageSource& source(const ImageCodec& codec);
+
+		// Bytes held in buffers and the arena, not counting what sinks and sources keep
+		size_t retainedBytes() const;
+		// What conversions with this context hold, per stage; buffers kept here stay counted under the stage that allocated them
+		MemoryAccount& memory() { return memory_; }
+		// Frees all of it, e.g. after a conversion much larger than the usual ones
+		void clear();
+
+		// Makes context current on this thread while it exists (a null context changes nothing): stb allocations
+		// come from its arena, and backends may take buffers from it. The arena is emptied when the scope ends,
+		// so nothing stb allocated may outlive it
+		class Scope
+		{
+		public:
+			explicit Scope(ConversionContext* context);
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			ConversionContext* context_;
+			ConversionContext* previous_;
+		};
+
+		// The context of the innermost Scope on this thread, nullptr outside one
+		static ConversionContext* current();
+
+	private:
+		struct Arena;
+		friend void* contextAllocate(size_t size);
+		friend void* contextReallocate(void* data, size_t size);
+		friend void contextFree(void* data);
+
+		template <typename T>
+		std::vector<AlignedVector<T>>& pool();
+
+		MemoryAccount memory_; // First, so it outlives everything counted against it
+		std::vector<AlignedVector<uint8_t>> bytes_;
+		std::vector<AlignedVector<int16_t>> samples_;
+		std::vector<std::pair<const ImageCodec*, std::unique_ptr<ImageSink>>> sinks_;
+		std::vector<std::pair<const ImageCodec*, std::unique_ptr<ImageSource>>> sources_;
+		std::unique_ptr<Arena> arena_;
+	};
+
+	// Makes room for capacity elements in buffer. When it is too small and there is a context, the best fit from
+	// the context replaces it (and it goes back to the context) instead of growing it; the contents are then lost
+	template <typename T>
+	void reserveBuffer(AlignedVector<T>& buffer, size_t capacity, ConversionContext* context)
+	{
+		if (context && buffer.capacity() < capacity)
+		{
+			context->give(std::move(buffer));
+			buffer = context->take<T>(capacity);
+		}
+		buffer.reserve(capacity);
+	}
+
+	// Sizes buffer to count elements, as reserveBuffer
+	template <typename T>
+	void fitBuffer(AlignedVector<T>& buffer, size_t count, ConversionContext* context)
+	{
+		reserveBuffer(buffer, count, context);
+		buffer.resize(count);
+	}
+
+	// A buffer that goes back to its context, if it has one, when it goes out of scope
+	template <typename T>
+	struct ContextBuffer
+	{
+		explicit ContextBuffer(ConversionContext* context = nullptr) : context(context) {}
+		~ContextBuffer()
+		{
+			if (context)
+			{
+				context->give(std::move(data));
+			}
+		}
+
+		ContextBuffer(const ContextBuffer&) = delete;
+		ContextBuffer& operator=(const ContextBuffer&) = delete;
+
+		ConversionContext* context;
+		AlignedVector<T> data;
+	};
+
+	// Allocation hooks for stb_image and stb_image_write (STBI_MALLOC, STBIW_MALLOC, ...): from the arena of the
+	// current ConversionContext::Scope, or from the heap outside one or when the arena is full. Arena blocks are
+	// gone when their scope ends; freeing one before that is optional
+	void* contextAllocate(size_t size);
+	void* contextReallocate(void* data, size_t size);
+	void contextFree(void* data);
+}
+
+#endif // SOUNDIMAGECONVERTER_CONVERSIONCONTEXT_H
@@ -0,0 +1,144 @@
+#ifndef SOUNDIMAGECONVERTER_CONVERSIONSERVER_H
+#define SOUNDIMAGECONVERTER_CONVERSIONSERVER_H
+
+#include "SoundImageConverter/Converter.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Local conversion service. Callers converting a few seconds of audio at a time would spend far longer
+	// starting a process than converting; the daemon keeps its worker threads, codecs and buffers warm and
+	// converts requests sent over a Unix domain socket instead. POSIX only.
+	//
+	// Protocol, integers little-endian. A connection carries any number of requests, one at a time:
+	//   request:  "SICQ" | u8 operation | u8 type length | u16 flags | u32 sample rate | u64 payload size
+	//             | type | payload
+	//   response: "SICA" | u32 ConversionError | u64 frames | u64 server microseconds | u64 payload size | payload
+	// Encode sends an audio file (anything the Encoder reads) and gets back an image of type ("png", "qoi", ...);
+	// a sample rate other than 0 resamples first. Decode sends an image of type and gets back a WAV.
+	// A failed conversion answers with its error and no payload and the connection stays usable; a malformed
+	// header closes the connection.
+	//
+	// With ServerSharedMemory in flags no payload bytes cross either way: the request header carries two shared
+	// memory descriptors (SCM_RIGHTS), the input holding the payload in its first payload size bytes and the
+	// output, which the server writes from the start (growing it as needed) and whose length the answer's
+	// payload size gives. The server converts straight from and into those mappings, so client and server
+	// share one copy of each, and a client reusing its output memory has its pages already in place.
+	// Both must have their size sealed against shrinking (see SharedMemory.h), or the request fails with
+	// ConversionInvalidInput.
+	enum ServerOperation : uint8_t
+	{
+		ServerEncode = 1,
+		ServerDecode = 2,
+	};
+
+	enum ServerFlags : uint16_t
+	{
+		ServerSharedMemory = 1,
+	};
+
+	struct ServerRequest
+	{
+		ServerOperation operation = ServerEncode;
+		std::string type = "png"; // Image type, an extension without the dot
+		uint32_t sampleRate = 0;
+	};
+
+	struct ServerResponse
+	{
+		ConversionError error = ConversionOk;
+		uint64_t frames = 0;
+		uint64_t serverMicroseconds = 0; // From the whole request being received to the response being queued
+
+		bool ok() const { return error == ConversionOk; }
+	};
+
+	struct ServerOptions
+	{
+		// Conversion workers, 0 for one per core
+		unsigned threads = 0;
+		// Request and response buffers allocated (and touched) up front, 0 for four per worker. Buffers that
+		// grew past bufferBytes * 16 are freed instead of going back to the pool
+		unsigned buffers = 0;
+		size_t bufferBytes = 4 << 20;
+		// Larger requests are answered with ConversionInvalidInput and the connection closed. A request's buffer
+		// grows with the bytes that arrive, not with the size its header announces
+		uint64_t maxRequestBytes = 1ull << 30;
+		// Further connections are closed as soon as they are accepted; counts HTTP connections too
+		unsigned maxConnections = 256;
+		// Also answers HTTP on 127.0.0.1:httpPort if not 0, one thread per connection (see HttpServer.h)
+		uint16_t httpPort = 0;
+	};
+
+	// What a server has done so far
+	struct ServerStats
+	{
+		uint64_t connections = 0;
+		uint64_t requests = 0;
+		uint64_t failed = 0;
+	};
+
+	class ConversionServer
+	{
+	public:
+		explicit ConversionServer(const ServerOptions& options = ServerOptions());
+		~ConversionServer();
+
+		ConversionServer(const ConversionServer&) = delete;
+		ConversionServer& operator=(const ConversionServer&) = delete;
+
+		// Listens on socketPath (a leftover socket file there is replaced) and on the HTTP port if there is one,
+		// starts the workers, fills the buffer pool and runs one small conversion per backend so the first request
+		// finds everything warm. socketPath may be empty when only HTTP is wanted
+		bool start(const std::string& socketPath);
+
+		// Serves connections until stop(); returns false if start() was not called or failed
+		bool run();
+
+		// Makes run() return after the requests being converted are answered. Only sets a flag and writes
+		// a byte to a pipe, so a signal handler may call it
+		void stop();
+
+		ServerStats stats() const;
+
+	private:
+		struct State;
+		std::unique_ptr<State> state_;
+	};
+
+	// Blocking client for ConversionServer, one request at a time
+	class ConversionClient
+	{
+	public:
+		ConversionClient() = default;
+		~ConversionClient();
+
+		ConversionClient(const ConversionClient&) = delete;
+		ConversionClient& operator=(const ConversionClient&) = delete;
+
+		bool connect(const std::string& socketPath);
+		void close();
+
+		// Sends data and waits for the answer; output receives the converted file (empty if it failed).
+		// Returns false if the connection failed, in which case it is closed
+		bool convert(const ServerRequest& request, const uint8_t* data, size_t size, std::vector<uint8_t>& output, ServerResponse& response);
+#ifndef _WIN32
+		// Same, passing the first size bytes of the shared memory input instead of copying them and receiving the
+		// answer in the shared memory output, outputSize bytes long (both from createSharedMemory, size sealed).
+		// The descriptors stay the caller's, to reuse for the next request
+		bool convertShared(const ServerRequest& request, int input, uint64_t size, int output, uint64_t& outputSize, ServerResponse& response);
+#endif
+
+	private:
+		bool exchange(const ServerRequest& request, uint16_t flags, const uint8_t* data, uint64_t size, const int* descriptors,
+			uint64_t& answerSize, ServerResponse& response);
+
+		int socket_ = -1;
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_CONVERSIONSERVER_H
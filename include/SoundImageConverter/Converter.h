@@ -1,23 +1,174 @@
 #ifndef SOUNDIMAGECONVERTER_ENCODER_H
 #define SOUNDIMAGECONVERTER_ENCODER_H
 
+#include "SoundImageConverter/MemoryAccount.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
 #include <string>
 
 namespace SoundImageConverter
 {
+	class ConversionContext;
+	class InputStream;
+	class OutputStream;
+	class TaskScheduler;
+
+	// Stops a conversion from another thread. Conversions check it before every block of rows
+	class CancelToken
+	{
+	public:
+		void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+		void reset() { cancelled_.store(false, std::memory_order_relaxed); }
+		bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<bool> cancelled_{ false };
+	};
+
+	// Frames done and the total, called from a converting thread after every block of rows
+	typedef std::function<void(uint64_t done, uint64_t total)> ProgressCallback;
+
+	// Why a conversion failed
+	enum ConversionError
+	{
+		ConversionOk,
+		ConversionUnsupported, // No backend for the extension, a layout it cannot store, or a resampling ratio out of range
+		ConversionOpenInputFailed, // Missing, unreadable, or not audio / an image of that format
+		ConversionInvalidInput, // Damaged metadata row, unsupported channel count, or too long for one image
+		ConversionOpenOutputFailed,
+		ConversionReadFailed, // Input ended early or a read failed
+		ConversionWriteFailed,
+		ConversionChecksumMismatch, // Decoded PCM differs from the stored checksum, or the checksum row is missing
+		ConversionCancelled,
+	};
+
+	// What a conversion did. Timings are wall time; the stage times are how long each stage was busy
+	// and add up to more than seconds when the stages run on separate threads
+	struct ConversionResult
+	{
+		ConversionError error = ConversionOk;
+		uint64_t frames = 0; // Frames converted
+		uint64_t bytesIn = 0; // Size of the input audio or image
+		uint64_t bytesOut = 0; // Bytes written
+		size_t peakBufferBytes = 0; // Most held at once in the converter's row blocks and input buffers; codec internals not included
+		double seconds = 0;
+		double readSeconds = 0; // Input decoding (and resampling), or image decompression
+		double packSeconds = 0; // Packing or unpacking, and the checksum
+		double writeSeconds = 0; // Image compression, or audio encoding, and output
+		// Bytes per stage (see MemoryAccount.h): peaks during the conversion, and what is still held after it, i.e. what
+		// the context keeps. The process RSS is sampled before the conversion, once the input is open, every 16 blocks and after it
+		MemoryUsage memory;
+
+		bool ok() const { return error == ConversionOk; }
+	};
+
+	struct EncodeOptions
+	{
+		// Resample to this rate before packing, 0 keeps the input rate.
+		// Image size and conversion time scale with the stored rate (e.g. 48 kHz speech stored at 16 kHz is a third).
+		uint32_t sampleRate = 0;
+
+		// Headerless PCM input (e.g. piped from ffmpeg -f s16le): interleaved unsigned 8-bit or signed 16-bit
+		// little-endian samples. Used when rawSampleRate is not 0; otherwise the input must have a header.
+		uint32_t rawSampleRate = 0;
+		int rawChannels = 1;
+		int rawBitDepth = 16;
+
+		// Read, pack and compress on three threads connected by lock-free rings, so one long file uses three cores.
+		// Batch mode turns this off and converts several files in parallel instead
+		bool pipeline = true;
+
+		// Packs inputs longer than 32 blocks of 64 rows as subtasks on this scheduler, which its idle workers
+		// steal (batch mode); shorter ones stay on the calling thread
+		TaskScheduler* scheduler = nullptr;
+
+		// Buffers, image backends and stb memory kept from earlier conversions on this thread (see ConversionContext.h);
+		// nullptr allocates everything anew
+		ConversionContext* context = nullptr;
+
+		// Called after every block of 64 rows is written
+		ProgressCallback progress;
+
+		// Checked before every block; once cancelled the encode stops, deletes the image file it created and fails
+		// with ConversionCancelled
+		const CancelToken* cancel = nullptr;
+
+		// Receives the progress messages; nullptr silences them. Errors always go to std::cerr
+		std::ostream* log = &std::cout;
+	};
+
+	// What the decoder writes
+	enum AudioOutput
+	{
+		AudioOutputByName, // Container from the output extension (the original one if unknown), original subtype where possible
+		AudioOutputWav, // 8/16-bit PCM WAV as stored; the header is written up front, so any stream works, pipes included
+		AudioOutputRaw, // Headerless PCM as stored: unsigned 8-bit or signed 16-bit little-endian
+	};
+
+	struct DecodeOptions
+	{
+		AudioOutput output = AudioOutputByName;
+
+		// As EncodeOptions::scheduler: long images are unpacked and checksummed as subtasks
+		TaskScheduler* scheduler = nullptr;
+
+		// As EncodeOptions::context
+		ConversionContext* context = nullptr;
+
+		// Write the audio on a second thread while the next rows are unpacked. Batch mode and the daemon,
+		// which convert several files at once, turn this off and write on the converting thread
+		bool pipeline = true;
+
+		// As in EncodeOptions; a cancelled decode deletes the audio file it created. PNG images are decompressed
+		// as a whole when opened, before the first check
+		ProgressCallback progress;
+		const CancelToken* cancel = nullptr;
+		std::ostream* log = &std::cout;
+	};
+
 	class Encoder
 	{
 	public:
-		// Encodes a WAV file to a PNG image
+		// Encodes an audio file to an image. Input is any format libsndfile reads (WAV, FLAC, Ogg, MP3, ...),
+		// stored as 8-bit if the source is 8-bit PCM and 16-bit otherwise. The backend is looked up in ImageCodecRegistry
+		// by the output extension (.png, .qoi, or uncompressed Netpbm .pam/.ppm/.pgm/.pnm)
 		// Returns true if successful, false otherwise
 		static bool encode(const std::string& wavPath, const std::string& pngPath);
+		// With options the result tells why a conversion failed, and what it cost
+		static ConversionResult encode(const std::string& wavPath, const std::string& pngPath, const EncodeOptions& options);
+
+		// Same, reading the audio from wav (e.g. a file already in memory, or a pipe) and writing the image to image.
+		// wavPath only names the input in messages; the pngPath extension still picks the backend.
+		// Input of unknown length (raw PCM or a streamed WAV from a pipe) is read into memory first,
+		// since the image height depends on it.
+		static ConversionResult encode(InputStream& wav, const std::string& wavPath, OutputStream& image, const std::string& pngPath, const EncodeOptions& options);
+		// Reading the audio from wav into the image file at pngPath, which is removed again if the encode fails
+		static ConversionResult encode(InputStream& wav, const std::string& wavPath, const std::string& pngPath, const EncodeOptions& options);
 	};
 
 	class Decoder
 	{
 	public:
-		// Decodes a PNG image to a WAV file
+		// Decodes an image to an audio file; the backend is chosen by the input extension.
+		// The output container follows the wavPath extension (the original one if unknown)
+		// and keeps the original subtype where possible, e.g. 24-bit WAV in, 24-bit WAV out.
+		// Images written with a checksum are verified while decoding; a mismatch fails the decode
 		static bool decode(const std::string& pngPath, const std::string& wavPath);
+		static ConversionResult decode(const std::string& pngPath, const std::string& wavPath, const DecodeOptions& options);
+
+		// Same, reading the image from image. WAV and raw output goes to wav; formats libsndfile writes
+		// (FLAC, 24-bit WAV, ...) need a seekable file, so they are written to wavPath and wav is left empty
+		static bool decode(InputStream& image, const std::string& pngPath, OutputStream& wav, const std::string& wavPath);
+		static ConversionResult decode(InputStream& image, const std::string& pngPath, OutputStream& wav, const std::string& wavPath, const DecodeOptions& options);
+		// Reading the image from image into the audio file at wavPath, which is removed again if the decode fails
+		static ConversionResult decode(InputStream& image, const std::string& pngPath, const std::string& wavPath, const DecodeOptions& options);
+
+		// Decodes without writing anything and compares the stored PCM checksum.
+		// Fails if the image is damaged or predates checksums. Safe to call from several threads.
+		static bool verify(const std::string& pngPath);
 	};
 }
 
@@ -0,0 +1,50 @@
+#ifndef SOUNDIMAGECONVERTER_HTTPSERVER_H
+#define SOUNDIMAGECONVERTER_HTTPSERVER_H
+
+#include "SoundImageConverter/Converter.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace SoundImageConverter
+{
+	// HTTP/1.1 front end of ConversionServer (ServerOptions::httpPort) for tools that only speak HTTP.
+	// Listens on 127.0.0.1 only and needs nothing beyond the socket API.
+	//   POST /encode?type=png&rate=16000   audio file in, image out (type defaults to png, rate to the input's)
+	//   POST /decode?type=png              image in, WAV out
+	// Request bodies may have a Content-Length or be chunked; answers are always chunked. Both are streamed
+	// through the converter with 64 KiB of buffering each way, so a connection's memory stays bounded for
+	// inputs that stream: PCM WAV with its length in the header when encoding, images whose backend reads
+	// rows on demand (qoi, pam) when decoding. Other inputs are gathered in memory first, as in Encoder and Decoder.
+	// The status line goes out with the first bytes of the answer: a conversion failing before that gets a
+	// 4xx/5xx with a one-line reason, one failing later is cut off without the last chunk, which clients
+	// report as an incomplete body. Clients must read the answer while they send (curl does), since it
+	// starts before the request has been read to its end.
+	class HttpConnection
+	{
+	public:
+		// Takes over fd, an accepted connection. Requests with a larger body are refused; long inputs are
+		// packed and unpacked as subtasks on scheduler if there is one
+		HttpConnection(int fd, uint64_t maxRequestBytes, TaskScheduler* scheduler = nullptr);
+		~HttpConnection();
+
+		HttpConnection(const HttpConnection&) = delete;
+		HttpConnection& operator=(const HttpConnection&) = delete;
+
+		// Answers requests until the client closes the connection or asks to, a body cannot be read to its end,
+		// or 30 s pass without a request. finished is called after every conversion
+		void serve(const std::function<void(const ConversionResult&)>& finished);
+
+		// Makes serve() return soon, cancelling its conversion. Safe to call from another thread
+		void shutdown();
+
+	private:
+		struct State;
+		std::unique_ptr<State> state_;
+	};
+
+	// Listens on 127.0.0.1:port; returns the socket, or -1 after printing why
+	int listenHttp(uint16_t port);
+}
+
+#endif // SOUNDIMAGECONVERTER_HTTPSERVER_H
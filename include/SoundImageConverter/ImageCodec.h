@@ -0,0 +1,133 @@
+#ifndef SOUNDIMAGECONVERTER_IMAGECODEC_H
+#define SOUNDIMAGECONVERTER_IMAGECODEC_H
+
+#include "SoundImageConverter/Stream.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Image geometry as seen by a backend; samples are always 8 bits per channel
+	struct ImageInfo
+	{
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+
+		size_t rowBytes() const { return static_cast<size_t>(width) * channels; }
+	};
+
+	// What a backend can store, checked by the Encoder before picking a pixel layout
+	enum ImageCapability : uint32_t
+	{
+		ImageCapGray = 1u << 0,
+		ImageCapRGB = 1u << 1,
+		ImageCapRGBA = 1u << 2,
+		ImageCapDepth8 = 1u << 3,
+		ImageCapDepth16 = 1u << 4,
+		ImageCapStreamingWrite = 1u << 5, // Rows go out as they are written, memory does not grow with height
+		ImageCapStreamingRead = 1u << 6,  // Rows are produced on demand, memory does not grow with height
+		ImageCapInPlaceRead = 1u << 7,    // readRowsInPlace: the whole image is held, and rows read may be overwritten
+	};
+
+	// Receives an image top to bottom, a block of rows at a time
+	class ImageSink
+	{
+	public:
+		virtual ~ImageSink() = default;
+
+		// Starts an image of the given geometry on out, which must outlive the sink
+		virtual bool begin(OutputStream& out, const ImageInfo& info) = 0;
+		// rows holds count * info.rowBytes() tightly packed bytes
+		virtual bool writeRows(const uint8_t* rows, int count) = 0;
+		// Completes the image after all rows were written
+		virtual bool finish() = 0;
+	};
+
+	// Produces an image top to bottom, a block of rows at a time
+	class ImageSource
+	{
+	public:
+		virtual ~ImageSource() = default;
+
+		// Reads the header from in, which must outlive the source
+		virtual bool open(InputStream& in, ImageInfo& info) = 0;
+		// Returns the next count rows (tightly packed), or nullptr on error or past the end.
+		// The pointer stays valid until the next call; it may point into the input's view.
+		virtual const uint8_t* readRows(int count) = 0;
+		// As readRows, for backends with ImageCapInPlaceRead: the rows stay valid until close() and are the caller's to
+		// overwrite, e.g. with the samples decoded from them. Other backends return nullptr
+		virtual uint8_t* readRowsInPlace(int count)
+		{
+			(void)count;
+			return nullptr;
+		}
+		// True if readRowsInPlace works for the image open now. A backend with ImageCapInPlaceRead may still stream an
+		// image too large for it to hold, as PNG does past 2 GB
+		virtual bool readsInPlace() const { return false; }
+		// Releases what open() holds, so a source kept for the next image costs no memory in between
+		virtual void close() {}
+	};
+
+	class ImageCodec
+	{
+	public:
+		virtual ~ImageCodec() = default;
+
+		virtual const char* name() const = 0;
+		// Lower-case extensions including the dot, the first one is the preferred one
+		virtual std::vector<std::string> extensions() const = 0;
+		virtual uint32_t capabilities() const = 0;
+
+		virtual std::unique_ptr<ImageSink> createSink() const = 0;
+		virtual std::unique_ptr<ImageSource> createSource() const = 0;
+
+		// What it can write to a file with the given extension (lower-case, with the dot): capabilities(), unless the
+		// extension fixes the layout, as .pgm and .ppm do
+		virtual uint32_t capabilitiesFor(const std::string& extension) const
+		{
+			(void)extension;
+			return capabilities();
+		}
+
+		bool supports(uint32_t caps) const { return (capabilities() & caps) == caps; }
+		bool supports(uint32_t caps, const std::string& extension) const { return (capabilitiesFor(extension) & caps) == caps; }
+	};
+
+	// All known backends, keyed by file extension
+	class ImageCodecRegistry
+	{
+	public:
+		// The process-wide registry, with the built-in backends already registered
+		static ImageCodecRegistry& instance();
+
+		// Adds a backend; its extensions take precedence over earlier registrations.
+		// Not synchronised: register at startup, before conversions run on other threads.
+		void add(std::unique_ptr<ImageCodec> codec);
+
+		// Returns nullptr if no backend handles the extension (with dot, any case)
+		const ImageCodec* findByExtension(const std::string& extension) const;
+		// Looks up the backend for a path's extension; returns nullptr if none matches
+		const ImageCodec* findForPath(const std::string& path) const;
+
+		const std::vector<std::unique_ptr<ImageCodec>>& codecs() const { return codecs_; }
+
+	private:
+		ImageCodecRegistry();
+
+		const ImageCodec* find(const char* extension, size_t size) const;
+
+		std::vector<std::unique_ptr<ImageCodec>> codecs_;
+		std::vector<std::pair<std::string, const ImageCodec*>> extensions_; // In registration order
+	};
+
+	// Built-in backends
+	std::unique_ptr<ImageCodec> createPngCodec();
+	std::unique_ptr<ImageCodec> createQoiCodec();
+	std::unique_ptr<ImageCodec> createNetpbmCodec();
+}
+
+#endif // SOUNDIMAGECONVERTER_IMAGECODEC_H
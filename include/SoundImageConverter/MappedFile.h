@@ -0,0 +1,42 @@
+#ifndef SOUNDIMAGECONVERTER_MAPPEDFILE_H
+#define SOUNDIMAGECONVERTER_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace SoundImageConverter
+{
+	// Read-only memory mapping of a whole file (mmap on POSIX, file mapping on Windows)
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Maps the file; returns true if successful, false otherwise
+		bool open(const std::string& path);
+#ifndef _WIN32
+		// Maps all of an open descriptor, e.g. shared memory received from another process.
+		// The descriptor stays the caller's; the mapping keeps its own reference
+		bool openDescriptor(int fd);
+#endif
+		void close();
+
+		const uint8_t* data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+		const uint8_t* data_ = nullptr;
+		size_t size_ = 0;
+#ifdef _WIN32
+		void* file_ = nullptr;
+		void* mapping_ = nullptr;
+#endif
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_MAPPEDFILE_H
@@ -0,0 +1,89 @@
+#ifndef SOUNDIMAGECONVERTER_MEMORYACCOUNT_H
+#define SOUNDIMAGECONVERTER_MEMORYACCOUNT_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace SoundImageConverter
+{
+	// What a conversion's memory is for, as counted by MemoryAccount
+	enum MemoryStage
+	{
+		MemoryStageRead, // Input: audio read and converted, or the image file read into memory
+		MemoryStagePack, // Row blocks and sample blocks
+		MemoryStageCodec, // Image compression and decompression state, stb memory included
+		MemoryStageWrite, // Output: the compressed image before it is written, or the audio writer
+		MemoryStageCount
+	};
+
+	// "read", "pack", "codec" or "write"
+	const char* memoryStageName(MemoryStage stage);
+
+	struct StageMemory
+	{
+		size_t current = 0; // Held when the usage was taken
+		size_t peak = 0; // Most held at once since the peaks were reset
+	};
+
+	// Bytes held per stage and in all, and the resident set size of the whole process
+	struct MemoryUsage
+	{
+		StageMemory stages[MemoryStageCount];
+		StageMemory total; // Peak of the sum, not the sum of the stage peaks
+		size_t residentBytes = 0; // RSS when the usage was taken, 0 where it cannot be read
+		size_t peakResidentBytes = 0; // Largest RSS sampled since the peaks were reset
+	};
+
+	// Current and peak bytes per stage. Buffers allocated through CacheAlignedAllocator (AlignedVector) and the stb
+	// hooks while a MemoryScope is open are counted against its account and stage until they are freed, on whichever
+	// thread; the account must outlive them. Allocations elsewhere (std::vector, libsndfile) show only in the RSS
+	class MemoryAccount
+	{
+	public:
+		void add(MemoryStage stage, size_t bytes);
+		void remove(MemoryStage stage, size_t bytes);
+
+		// Reads the RSS and keeps it if it is the largest since the peaks were reset. Allocates nothing
+		void sampleResident();
+		// Peaks back to what is held now, e.g. at the start of a conversion
+		void resetPeaks();
+		MemoryUsage usage() const;
+
+		// The account of the innermost MemoryScope on this thread, nullptr outside one
+		static MemoryAccount* current();
+		static MemoryStage currentStage();
+
+	private:
+		std::atomic<size_t> current_[MemoryStageCount + 1] = {}; // Per stage, then the total
+		std::atomic<size_t> peak_[MemoryStageCount + 1] = {};
+		std::atomic<size_t> resident_{ 0 };
+		std::atomic<size_t> peakResident_{ 0 };
+	};
+
+	// Makes an account and a stage current on this thread while it exists. Without an account the stage changes
+	// and the account stays; a null account counts nothing
+	class MemoryScope
+	{
+	public:
+		MemoryScope(MemoryAccount* account, MemoryStage stage);
+		explicit MemoryScope(MemoryStage stage);
+		~MemoryScope();
+
+		MemoryScope(const MemoryScope&) = delete;
+		MemoryScope& operator=(const MemoryScope&) = delete;
+
+	private:
+		MemoryAccount* previousAccount_;
+		MemoryStage previousStage_;
+	};
+
+	// Resident set size of this process from /proc/self/statm; 0 where there is none
+	size_t residentBytes();
+
+	// Cache line aligned memory counted against the current scope's account and stage, for CacheAlignedAllocator.
+	// Throws std::bad_alloc as operator new does
+	void* accountedAllocate(size_t size);
+	void accountedFree(void* data);
+}
+
+#endif // SOUNDIMAGECONVERTER_MEMORYACCOUNT_H
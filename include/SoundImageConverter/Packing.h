@@ -0,0 +1,73 @@
+#ifndef SOUNDIMAGECONVERTER_PACKING_H
+#define SOUNDIMAGECONVERTER_PACKING_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace SoundImageConverter
+{
+	// Pixel layout shared by Encoder and Decoder. Independent of the image backend:
+	// the first row holds the metadata, then one pixel per audio frame, left to right, top to bottom.
+	// Since version 1 a trailer row follows the data rows, holding the CRC32C of the decoded PCM.
+	// It sits at the end because rows are streamed top to bottom and the checksum is only known last.
+	//
+	// Metadata row bytes: 0-3 sample rate, 4 channels, 5 bit depth, 6 version, 7 flags, 8-15 frame count,
+	// 16-19 libsndfile format of the original input (0 if unknown), 20-23 sample rate of the input
+	// (bytes 0-3 hold the stored rate, which differs when the encoder resampled).
+	// Trailer row bytes: 0-3 CRC32C of the decoded 16-bit little-endian PCM. Multi-byte values are big-endian.
+	namespace Packing
+	{
+		const int imageWidth = 512;
+		const int formatVersion = 1;
+
+		// Rows are counted in an int, as PNG and QOI store 31-bit heights: about 1.1e12 frames, 265 days at 48 kHz
+		const int maxImageHeight = 0x7fffffff;
+		const uint64_t maxFrames = static_cast<uint64_t>(maxImageHeight - 2) * imageWidth;
+
+		const uint8_t flagChecksum = 1 << 0; // Trailer row with the PCM checksum
+
+		// Audio properties stored in the metadata row
+		struct Metadata
+		{
+			uint32_t sampleRate = 0;
+			int channels = 0; // 1 = mono, 2 = stereo
+			int bitDepth = 0; // 8 or 16
+			int version = 0; // 0 = legacy image: no frame count, no checksum
+			uint8_t flags = 0;
+			uint64_t frames = 0; // Version 1+: exact frame count, the rest of the last data row is padding
+			uint32_t sourceFormat = 0; // Version 1+: container | subtype of the input, so decoding can reproduce it
+			uint32_t originalSampleRate = 0; // Version 1+: rate of the input, 0 if unknown; sampleRate is the stored rate
+
+			bool hasChecksum() const { return version >= 1 && (flags & flagChecksum) != 0; }
+		};
+
+		// Rows needed for frames frames: metadata row, data rows, and the trailer row if any
+		inline uint64_t imageHeight(uint64_t frames, int width, bool withChecksum)
+		{
+			return 1 + (frames + width - 1) / width + (withChecksum ? 1 : 0);
+		}
+
+		// Grayscale for 8-bit mono, RGB for 8-bit stereo, RGBA for 16-bit
+		inline int channelsPerPixel(int bitDepth, int channels)
+		{
+			return (bitDepth == 8) ? (channels == 1 ? 1 : 3) : 4;
+		}
+
+		// Fills a zeroed metadata row (at least 24 bytes)
+		void writeMetadata(const Metadata& metadata, uint8_t* row);
+		// Parses the metadata row; returns false if it does not describe a supported layout
+		bool readMetadata(const uint8_t* row, size_t rowBytes, Metadata& metadata);
+
+		// Fills a zeroed trailer row (at least 4 bytes)
+		void writeTrailer(uint32_t checksum, uint8_t* row);
+		uint32_t readTrailer(const uint8_t* row);
+
+		// Packs frames interleaved 16-bit frames into frames pixels
+		void packFrames(const int16_t* samples, size_t frames, int channels, int channelsPerPixel, uint8_t* pixels);
+		// Converts pixelCount pixels back to interleaved samples, returns the number of samples written.
+		// samples may start at pixels when a pixel holds at least as many bytes as its samples: each pixel is read before its samples are stored
+		size_t unpackPixels(const uint8_t* pixels, size_t pixelCount, int channelsPerPixel, int channels, int16_t* samples);
+	}
+}
+
+#endif // SOUNDIMAGECONVERTER_PACKING_H
@@ -0,0 +1,47 @@
+#ifndef SOUNDIMAGECONVERTER_RESAMPLER_H
+#define SOUNDIMAGECONVERTER_RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Streaming polyphase FIR sample rate converter for interleaved 16-bit audio.
+	// The ratio is reduced to L/M; a Kaiser-windowed sinc low-pass (cut off below the lower Nyquist
+	// frequency) is split into L phases, and each output frame is one dot product per channel.
+	// The dot products use AVX2/FMA or SSE2 when available.
+	class Resampler
+	{
+	public:
+		// Returns false if the rates are zero or the reduced ratio needs more than maxPhases phases
+		bool init(uint32_t inRate, uint32_t outRate, int channels);
+
+		// Consumes frames input frames and appends the output frames that are now complete to out
+		void process(const int16_t* in, size_t frames, std::vector<int16_t>& out);
+
+		// Appends the remaining output frames, treating the input as followed by silence
+		void flush(std::vector<int16_t>& out);
+
+		// Output frames for inFrames input frames: one per output instant before the end of the input
+		static uint64_t outputFrames(uint64_t inFrames, uint32_t inRate, uint32_t outRate);
+
+		static const uint32_t maxPhases = 4096;
+
+	private:
+		void produce(std::vector<int16_t>& out, bool flushing);
+
+		int channels_ = 0;
+		uint64_t upFactor_ = 1; // L
+		uint64_t downFactor_ = 1; // M
+		size_t taps_ = 0; // Per phase, multiple of 8
+		std::vector<float> coefficients_; // [phase][tap]
+
+		std::vector<std::vector<float>> history_; // Per channel, starts at input index historyStart_
+		int64_t historyStart_ = 0;
+		uint64_t inputFrames_ = 0;
+		uint64_t outputIndex_ = 0;
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_RESAMPLER_H
@@ -0,0 +1,59 @@
+#ifndef SOUNDIMAGECONVERTER_SHAREDMEMORY_H
+#define SOUNDIMAGECONVERTER_SHAREDMEMORY_H
+
+#include "SoundImageConverter/Stream.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace SoundImageConverter
+{
+#ifndef _WIN32
+	// Anonymous shared memory handed between processes as a file descriptor, e.g. over a Unix domain socket
+	// with SCM_RIGHTS: memfd_create on Linux, an shm_open object unlinked right away elsewhere.
+	// Returns the descriptor, or -1 on failure
+	int createSharedMemory(const char* name, size_t size);
+
+	// Stops the memory from shrinking (Linux file seals), so whoever maps it cannot be killed by SIGBUS
+	// when the other side truncates it. Returns false on systems without seals, where it cannot be shared safely
+	bool sealSharedMemorySize(int fd);
+	// Whether the size is sealed; false on systems without seals and for other kinds of files
+	bool sharedMemorySizeSealed(int fd);
+
+	// Writes into shared memory through a mapping, doubling it as needed, so a converter writes its
+	// output straight into the memory another process will map
+	class SharedMemoryOutputStream : public OutputStream
+	{
+	public:
+		~SharedMemoryOutputStream() override;
+
+		// Creates the memory with room for capacity bytes (it grows past that)
+		bool create(size_t capacity);
+		// Writes from the start of existing shared memory instead, e.g. received from another process.
+		// Takes over fd; the memory only ever grows, so it can be reused without faulting in new pages
+		bool attach(int fd);
+		// Unmaps the memory; created memory is trimmed to the bytes written and its size sealed.
+		// Returns false if anything failed. The descriptor stays open until the stream is destroyed or releases it
+		bool finish();
+		// Hands the descriptor over to the caller
+		int releaseDescriptor();
+
+		bool write(const void* data, size_t size) override;
+
+		int descriptor() const { return fd_; }
+		uint64_t size() const { return size_; }
+
+	private:
+		bool grow(size_t needed);
+		void unmap();
+
+		int fd_ = -1;
+		uint8_t* data_ = nullptr;
+		size_t capacity_ = 0;
+		size_t size_ = 0;
+		bool attached_ = false;
+		bool failed_ = false;
+	};
+#endif
+}
+
+#endif // SOUNDIMAGECONVERTER_SHAREDMEMORY_H
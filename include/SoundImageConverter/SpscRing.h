@@ -0,0 +1,84 @@
+#ifndef SOUNDIMAGECONVERTER_SPSCRING_H
+#define SOUNDIMAGECONVERTER_SPSCRING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+namespace SoundImageConverter
+{
+	// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+	// Used to hand buffer indices between pipeline stages, so memory stays fixed.
+	template <typename T, size_t Capacity>
+	class SpscRing
+	{
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	public:
+		// Producer side; returns false if the ring is full
+		bool tryPush(const T& value)
+		{
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			if (tail - head_.load(std::memory_order_acquire) == Capacity)
+			{
+				return false;
+			}
+			items_[tail & (Capacity - 1)] = value;
+			tail_.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer side; returns false if the ring is empty
+		bool tryPop(T& value)
+		{
+			size_t head = head_.load(std::memory_order_relaxed);
+			if (head == tail_.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+			value = items_[head & (Capacity - 1)];
+			head_.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Blocking variants: spin briefly, then back off so a stalled stage does not burn a core
+		void push(const T& value)
+		{
+			for (int attempt = 0; !tryPush(value); attempt++)
+			{
+				backOff(attempt);
+			}
+		}
+
+		T pop()
+		{
+			T value;
+			for (int attempt = 0; !tryPop(value); attempt++)
+			{
+				backOff(attempt);
+			}
+			return value;
+		}
+
+	private:
+		static void backOff(int attempt)
+		{
+			if (attempt < 64)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}
+
+		// Separate cache lines so the two threads do not contend on each other's index
+		alignas(64) std::atomic<size_t> head_{ 0 };
+		alignas(64) std::atomic<size_t> tail_{ 0 };
+		T items_[Capacity];
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_SPSCRING_H
@@ -0,0 +1,168 @@
+#ifndef SOUNDIMAGECONVERTER_STREAM_H
+#define SOUNDIMAGECONVERTER_STREAM_H
+
+#include "SoundImageConverter/MappedFile.h"
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Byte sink used by the image backends
+	class OutputStream
+	{
+	public:
+		virtual ~OutputStream() = default;
+
+		// Returns true if all bytes were written, false otherwise
+		virtual bool write(const void* data, size_t size) = 0;
+	};
+
+	// Byte source used by the image backends
+	class InputStream
+	{
+	public:
+		virtual ~InputStream() = default;
+
+		// Reads up to size bytes, returns the number read (0 at end of stream or on error)
+		virtual size_t read(void* data, size_t size) = 0;
+
+		// Whole contents when the stream is backed by memory or a mapping, nullptr otherwise.
+		// Backends use this to read pixels in place instead of copying them.
+		virtual const uint8_t* view() const { return nullptr; }
+		virtual size_t viewSize() const { return 0; }
+	};
+
+	class FileOutputStream : public OutputStream
+	{
+	public:
+		~FileOutputStream() override;
+
+		bool open(const std::string& path);
+		// Writes to standard output in binary mode, e.g. into a pipe; close() flushes it but leaves it open
+		bool openStandardOutput();
+		// Flushes and closes the file, returns false if any write failed
+		bool close();
+
+		bool write(const void* data, size_t size) override;
+
+	private:
+		FILE* file_ = nullptr;
+		bool owned_ = false;
+		bool failed_ = false;
+	};
+
+	class FileInputStream : public InputStream
+	{
+	public:
+		~FileInputStream() override;
+
+		bool open(const std::string& path);
+		// Reads standard input in binary mode; close() leaves it open
+		bool openStandardInput();
+		void close();
+
+		size_t read(void* data, size_t size) override;
+
+	private:
+		FILE* file_ = nullptr;
+		bool owned_ = false;
+	};
+
+	// Reads from a caller-owned buffer
+	class MemoryInputStream : public InputStream
+	{
+	public:
+		MemoryInputStream(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+		size_t read(void* data, size_t size) override;
+		const uint8_t* view() const override { return data_; }
+		size_t viewSize() const override { return size_; }
+
+	private:
+		const uint8_t* data_;
+		size_t size_;
+		size_t pos_ = 0;
+	};
+
+	// Appends to a caller-owned vector
+	class MemoryOutputStream : public OutputStream
+	{
+	public:
+		explicit MemoryOutputStream(std::vector<uint8_t>& buffer) : buffer_(buffer) {}
+
+		bool write(const void* data, size_t size) override;
+
+	private:
+		std::vector<uint8_t>& buffer_;
+	};
+
+	// Memory-mapped file exposed as a stream with a view
+	class MappedInputStream : public InputStream
+	{
+	public:
+		bool open(const std::string& path);
+
+		size_t read(void* data, size_t size) override;
+		const uint8_t* view() const override { return file_.data(); }
+		size_t viewSize() const override { return file_.size(); }
+
+	private:
+		MappedFile file_;
+		size_t pos_ = 0;
+	};
+
+	// Counts the bytes read through to another stream. The view is passed through, so reads in place stay in place
+	// (and are not counted)
+	class CountingInputStream : public InputStream
+	{
+	public:
+		explicit CountingInputStream(InputStream& in) : in_(in) {}
+
+		size_t read(void* data, size_t size) override
+		{
+			size_t got = in_.read(data, size);
+			count_ += got;
+			return got;
+		}
+		const uint8_t* view() const override { return in_.view(); }
+		size_t viewSize() const override { return in_.viewSize(); }
+
+		uint64_t count() const { return count_; }
+
+	private:
+		InputStream& in_;
+		uint64_t count_ = 0;
+	};
+
+	// Counts the bytes written through to another stream
+	class CountingOutputStream : public OutputStream
+	{
+	public:
+		explicit CountingOutputStream(OutputStream& out) : out_(out) {}
+
+		bool write(const void* data, size_t size) override
+		{
+			count_ += size;
+			return out_.write(data, size);
+		}
+
+		uint64_t count() const { return count_; }
+
+	private:
+		OutputStream& out_;
+		uint64_t count_ = 0;
+	};
+
+	// Opens a file for reading, memory-mapped when possible (falls back to buffered reads)
+	// Returns nullptr if the file cannot be opened
+	std::unique_ptr<InputStream> openInputFile(const std::string& path);
+
+	// Deletes the output of a failed or cancelled conversion. Only regular files: a conversion written
+	// to a device or named pipe (/dev/null, mkfifo) leaves it alone
+	void removePartialOutput(const std::string& path);
+}
+
+#endif // SOUNDIMAGECONVERTER_STREAM_H
@@ -0,0 +1,92 @@
+#ifndef SOUNDIMAGECONVERTER_TASKSCHEDULER_H
+#define SOUNDIMAGECONVERTER_TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Work-stealing thread pool. Every worker has its own deque: it runs its newest task first (cache-warm
+	// subtasks of the file it is on) and idle workers steal the oldest task from another worker's deque
+	// (usually a whole file or a large slice of one). Batch conversions run each file as a task, and large
+	// files split their row work into subtasks, so the cores stay busy until the last file is done.
+	class TaskScheduler
+	{
+	public:
+		// Counts the unfinished tasks spawned into it
+		class TaskGroup
+		{
+		public:
+			TaskGroup() = default;
+			TaskGroup(const TaskGroup&) = delete;
+			TaskGroup& operator=(const TaskGroup&) = delete;
+
+		private:
+			friend class TaskScheduler;
+			std::atomic<size_t> pending_{ 0 };
+		};
+
+		// threads == 0: one worker per core
+		explicit TaskScheduler(unsigned threads = 0);
+		// Runs the tasks still queued, then stops the workers
+		~TaskScheduler();
+
+		TaskScheduler(const TaskScheduler&) = delete;
+		TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+		unsigned threadCount() const { return static_cast<unsigned>(workers_.size()); }
+
+		// Index of the calling thread among this scheduler's workers, -1 on other threads. A worker runs one
+		// spawned task at a time (wait() only runs subtasks of the group it waits for), so per-worker state can be
+		// indexed by it
+		int workerIndex() const;
+
+		// Queues task; from a worker it goes to that worker's own deque, from other threads to the next worker in turn
+		void spawn(TaskGroup& group, std::function<void()> task);
+
+		// Returns once every task of group has run. A worker runs the group's tasks still in its own deque
+		// meanwhile instead of blocking; anything else (stolen subtasks, other threads) just waits
+		void wait(TaskGroup& group);
+
+		// Tasks taken from another worker's deque so far
+		uint64_t steals() const { return steals_; }
+
+	private:
+		struct Task
+		{
+			TaskGroup* group = nullptr;
+			std::function<void()> run;
+		};
+
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks; // The owner uses the back, thieves the front
+			std::thread thread;
+		};
+
+		void workerLoop(size_t index);
+		bool popOwn(size_t index, Task& task, const TaskGroup* only);
+		bool steal(size_t thief, Task& task);
+		void finish(Task& task);
+
+		std::vector<std::unique_ptr<Worker>> workers_;
+		std::atomic<size_t> nextWorker_{ 0 };
+		std::atomic<size_t> queued_{ 0 };
+		std::atomic<uint64_t> steals_{ 0 };
+		bool stopping_ = false;
+		std::mutex sleepMutex_; // Guards stopping_ and the wake-ups below
+		std::condition_variable workAvailable_;
+		std::condition_variable groupDone_;
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_TASKSCHEDULER_H
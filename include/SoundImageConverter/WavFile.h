@@ -0,0 +1,81 @@
+#ifndef SOUNDIMAGECONVERTER_WAVFILE_H
+#define SOUNDIMAGECONVERTER_WAVFILE_H
+
+#include "SoundImageConverter/Stream.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SoundImageConverter
+{
+	// Built-in RIFF/WAVE support for plain integer PCM, the common case.
+	// Handles 8-bit unsigned and 16-bit little-endian PCM, WAVE_FORMAT_EXTENSIBLE headers,
+	// and RF64 for data larger than 4 GB. Anything else is left to libsndfile.
+	// Samples are exchanged as interleaved 16-bit values; 8-bit data is scaled the same way libsndfile does.
+	// Headerless PCM in the same layout as the data chunk (u8 or s16le) is handled too.
+	struct WavFormat
+	{
+		// Length of a stream whose writer could not know it, e.g. a WAV piped out of ffmpeg: read to the end
+		static const uint64_t unknownFrames = ~0ull;
+
+		uint32_t sampleRate = 0;
+		int channels = 0;
+		int bitsPerSample = 0; // 8 or 16
+		uint64_t frames = 0;
+
+		size_t blockAlign() const { return static_cast<size_t>(channels) * (bitsPerSample / 8); }
+	};
+
+	class WavReader
+	{
+	public:
+		// Parses the header up to the first sample. Returns false if the stream is not
+		// a WAV file this reader handles; the stream position is then undefined.
+		bool open(InputStream& in, WavFormat& format);
+
+		// Reads headerless samples in the layout of format (channels and bitsPerSample must be set).
+		// format.frames becomes the length of the view, or unknownFrames if the stream has none.
+		bool openRaw(InputStream& in, WavFormat& format);
+
+		// Reads up to frames frames of interleaved samples, returns the number of frames read
+		size_t readFrames(int16_t* samples, size_t frames);
+
+		// All format.frames frames in place when the stream has a view and the data needs no conversion
+		// (16-bit on a little-endian host); nullptr otherwise. Valid as long as the stream.
+		const int16_t* mappedSamples() const;
+
+	private:
+		bool readExact(void* data, size_t size);
+		bool skip(uint64_t size);
+
+		InputStream* in_ = nullptr;
+		WavFormat format_;
+		uint64_t framesLeft_ = 0;
+		uint64_t dataOffset_ = 0;
+	};
+
+	class WavWriter
+	{
+	public:
+		// Writes the header for format.frames frames, so the output never needs to seek.
+		// Switches to RF64 when the data does not fit a 32-bit RIFF size.
+		bool begin(OutputStream& out, const WavFormat& format);
+
+		// Writes the samples only, no header and no pad byte
+		bool beginRaw(OutputStream& out, const WavFormat& format);
+
+		// Appends frames frames of interleaved samples
+		bool writeFrames(const int16_t* samples, size_t frames);
+
+		// Writes the pad byte if needed. Returns false if the frame count does not match the header.
+		bool finish();
+
+	private:
+		OutputStream* out_ = nullptr;
+		WavFormat format_;
+		uint64_t framesWritten_ = 0;
+		bool raw_ = false;
+	};
+}
+
+#endif // SOUNDIMAGECONVERTER_WAVFILE_H
@@ -0,0 +1,139 @@
+#include "SoundImageConverter/AudioFormat.h"
+#include <sndfile.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+namespace SoundImageConverter
+{
+	namespace AudioFormat
+	{
+		namespace
+		{
+			// Container for a file extension, asking libsndfile so new containers work without changes here.
+			// Returns 0 if the extension is unknown.
+			int containerForPath(const std::string& path)
+			{
+				size_t dot = path.find_last_of('.');
+				size_t slash = path.find_last_of("/\\");
+				if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+				{
+					return 0;
+				}
+				std::string ext = path.substr(dot + 1);
+				std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+				if (ext == "wav")
+				{
+					return SF_FORMAT_WAV;
+				}
+				if (ext == "aif")
+				{
+					return SF_FORMAT_AIFF;
+				}
+
+				int count = 0;
+				sf_command(nullptr, SFC_GET_FORMAT_MAJOR_COUNT, &count, sizeof(count));
+				for (int i = 0; i < count; i++)
+				{
+					SF_FORMAT_INFO info = {};
+					info.format = i;
+					if (sf_command(nullptr, SFC_GET_FORMAT_MAJOR, &info, sizeof(info)) == 0 && info.extension && ext == info.extension)
+					{
+						return info.format & SF_FORMAT_TYPEMASK;
+					}
+				}
+				return 0;
+			}
+
+			int defaultSubtype(int container, int bitDepth)
+			{
+				switch (container)
+				{
+				case SF_FORMAT_OGG:
+					return SF_FORMAT_VORBIS;
+				case SF_FORMAT_MPEG:
+					return SF_FORMAT_MPEG_LAYER_III;
+				case SF_FORMAT_WAV:
+				case SF_FORMAT_W64:
+				case SF_FORMAT_RF64:
+					return bitDepth == 8 ? SF_FORMAT_PCM_U8 : SF_FORMAT_PCM_16;
+				default:
+					return bitDepth == 8 ? SF_FORMAT_PCM_S8 : SF_FORMAT_PCM_16;
+				}
+			}
+
+			bool canWrite(int format, int channels, int sampleRate)
+			{
+				if (isBuiltinWav(format))
+				{
+					return true;
+				}
+				SF_INFO info = {};
+				info.format = format;
+				info.channels = channels;
+				info.samplerate = sampleRate;
+				return sf_format_check(&info) != 0;
+			}
+
+			std::string formatName(int format)
+			{
+				SF_FORMAT_INFO info = {};
+				info.format = format;
+				if (sf_command(nullptr, SFC_GET_FORMAT_INFO, &info, sizeof(info)) == 0 && info.name)
+				{
+					return info.name;
+				}
+				char hex[16];
+				std::snprintf(hex, sizeof(hex), "0x%04X", static_cast<unsigned>(format));
+				return hex;
+			}
+		}
+
+		int storedBitDepth(int format)
+		{
+			int subtype = format & SF_FORMAT_SUBMASK;
+			return (subtype == SF_FORMAT_PCM_S8 || subtype == SF_FORMAT_PCM_U8 || subtype == SF_FORMAT_DPCM_8) ? 8 : 16;
+		}
+
+		bool isBuiltinWav(int format)
+		{
+			int subtype = format & SF_FORMAT_SUBMASK;
+			return (format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV && (format & SF_FORMAT_ENDMASK) == 0 &&
+				   (subtype == SF_FORMAT_PCM_16 || subtype == SF_FORMAT_PCM_U8);
+		}
+
+		int outputFormat(const std::string& path, int sourceFormat, int bitDepth, int channels, int sampleRate)
+		{
+			int container = containerForPath(path);
+			if (container == 0)
+			{
+				container = sourceFormat != 0 ? (sourceFormat & SF_FORMAT_TYPEMASK) : SF_FORMAT_WAV;
+			}
+
+			if (sourceFormat != 0)
+			{
+				int original = container | (sourceFormat & SF_FORMAT_SUBMASK);
+				if (canWrite(original, channels, sampleRate))
+				{
+					return original;
+				}
+			}
+			int fallback = container | defaultSubtype(container, bitDepth);
+			if (canWrite(fallback, channels, sampleRate))
+			{
+				return fallback;
+			}
+			return SF_FORMAT_WAV | (bitDepth == 8 ? SF_FORMAT_PCM_U8 : SF_FORMAT_PCM_16);
+		}
+
+		bool isAudioPath(const std::string& path)
+		{
+			return containerForPath(path) != 0;
+		}
+
+		std::string describe(int format)
+		{
+			return formatName(format & SF_FORMAT_TYPEMASK) + " (" + formatName(format & SF_FORMAT_SUBMASK) + ")";
+		}
+	}
+}
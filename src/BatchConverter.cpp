@@ -0,0 +1,195 @@
+#include "SoundImageConverter/BatchConverter.h"
+#include "SoundImageConverter/BatchIo.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/Stream.h"
+#include "SoundImageConverter/TaskScheduler.h"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace SoundImageConverter
+{
+	namespace
+	{
+		typedef bool (*ConvertFunction)(InputStream& in, const BatchJob& job, OutputStream& out, const BatchOptions& options, ConversionContext* context);
+
+		bool encodeJob(InputStream& in, const BatchJob& job, OutputStream& out, const BatchOptions& options, ConversionContext* context)
+		{
+			EncodeOptions encode = options.encode;
+			encode.pipeline = false; // The threads already work on separate files
+			encode.context = context;
+			return Encoder::encode(in, job.input, out, job.output, encode).ok();
+		}
+
+		bool decodeJob(InputStream& in, const BatchJob& job, OutputStream& out, const BatchOptions& options, ConversionContext* context)
+		{
+			DecodeOptions decode = options.decode;
+			decode.pipeline = false;
+			decode.context = context;
+			return Decoder::decode(in, job.input, out, job.output, decode).ok();
+		}
+
+		BatchResult run(const std::vector<BatchJob>& jobs, const BatchOptions& options, ConvertFunction convert)
+		{
+			unsigned threadCount = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+			threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(std::max<size_t>(1, jobs.size()))));
+			const size_t maxAhead = static_cast<size_t>(std::max(1u, options.queueDepth)) * threadCount;
+
+			// Workers convert, this thread does the I/O. With a single thread it converts too
+			std::unique_ptr<TaskScheduler> scheduler(threadCount > 1 ? new TaskScheduler(threadCount) : nullptr);
+			BatchOptions taskOptions = options;
+			taskOptions.encode.scheduler = scheduler.get();
+			taskOptions.decode.scheduler = scheduler.get();
+			taskOptions.encode.log = nullptr; // The per-file progress lines would dominate the run time
+			taskOptions.decode.log = nullptr;
+			BatchIo io;
+			io.init(static_cast<unsigned>(maxAhead), options.allowIoUring);
+			// Buffers and stb memory carry over from one file to the next on the same worker
+			std::unique_ptr<ConversionContext[]> contexts(new ConversionContext[threadCount]);
+
+			// Finished conversions wait here until this thread queues their writes
+			struct Converted
+			{
+				size_t tag;
+				bool ok;
+				std::vector<uint8_t> output;
+			};
+			std::mutex mutex;
+			std::condition_variable convertedSignal;
+			std::vector<Converted> finished;
+			std::vector<std::vector<uint8_t>> spareBuffers; // Written outputs come back for reuse
+
+			auto convertJob = [&](size_t tag, const std::vector<uint8_t>& input)
+			{
+				std::vector<uint8_t> output;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!spareBuffers.empty())
+					{
+						output = std::move(spareBuffers.back());
+						spareBuffers.pop_back();
+					}
+				}
+				MemoryInputStream in(input.data(), input.size());
+				MemoryOutputStream out(output);
+				ConversionContext* context = &contexts[scheduler ? std::max(0, scheduler->workerIndex()) : 0];
+				bool ok = convert(in, jobs[tag], out, taskOptions, context);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					finished.push_back(Converted{ tag, ok, std::move(output) });
+				}
+				convertedSignal.notify_one();
+			};
+
+			BatchResult result;
+			TaskScheduler::TaskGroup conversions;
+			size_t next = 0;
+			size_t reading = 0;
+			size_t converting = 0;
+			size_t writing = 0;
+			std::vector<Converted> ready;
+			BatchIo::Completion done;
+			for (;;)
+			{
+				// Read ahead while fewer than maxAhead inputs are being read or converted
+				for (; next < jobs.size() && reading + converting < maxAhead; next++, reading++)
+				{
+					io.read(jobs[next].input, next);
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					ready.swap(finished);
+				}
+				for (Converted& item : ready)
+				{
+					converting--;
+					if (!item.ok)
+					{
+						result.failed++;
+					}
+					else if (item.output.empty())
+					{
+						result.converted++; // Written by libsndfile straight to the output path
+					}
+					else
+					{
+						io.write(jobs[item.tag].output, std::move(item.output), item.tag);
+						writing++;
+					}
+				}
+				ready.clear();
+
+				if (reading + writing == 0)
+				{
+					if (converting == 0 && next == jobs.size())
+					{
+						break;
+					}
+					// Only conversions in flight: sleep until one finishes
+					std::unique_lock<std::mutex> lock(mutex);
+					convertedSignal.wait(lock, [&]() { return !finished.empty(); });
+					continue;
+				}
+
+				io.wait(done);
+				const BatchJob& job = jobs[done.tag];
+				if (done.write)
+				{
+					writing--;
+					if (done.ok)
+					{
+						result.converted++;
+					}
+					else
+					{
+						std::cerr << "Error: Could not write " << job.output << std::endl;
+						result.failed++;
+					}
+					done.data.clear();
+					std::lock_guard<std::mutex> lock(mutex);
+					spareBuffers.push_back(std::move(done.data));
+					continue;
+				}
+
+				reading--;
+				if (!done.ok)
+				{
+					std::cerr << "Error: Could not read " << job.input << std::endl;
+					result.failed++;
+					continue;
+				}
+				converting++;
+				if (scheduler)
+				{
+					scheduler->spawn(conversions, [&convertJob, tag = done.tag, input = std::move(done.data)]() { convertJob(tag, input); });
+				}
+				else
+				{
+					convertJob(done.tag, done.data);
+				}
+			}
+			if (scheduler)
+			{
+				scheduler->wait(conversions);
+				result.steals = scheduler->steals();
+			}
+
+			result.usedIoUring = io.usingIoUring();
+			return result;
+		}
+	}
+
+	BatchResult BatchConverter::encode(const std::vector<BatchJob>& jobs, const BatchOptions& options)
+	{
+		return run(jobs, options, encodeJob);
+	}
+
+	BatchResult BatchConverter::decode(const std::vector<BatchJob>& jobs, const BatchOptions& options)
+	{
+		return run(jobs, options, decodeJob);
+	}
+}
@@ -0,0 +1,474 @@
+#include "SoundImageConverter/BatchIo.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SIC_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef SIC_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace SoundImageConverter
+{
+	struct BatchIo::Request
+	{
+		size_t tag = 0;
+		bool write = false;
+		bool ok = true;
+		std::string path;
+		std::vector<uint8_t> data;
+		uint64_t done = 0; // Bytes read or written so far
+		int fd = -1;
+	};
+
+#ifdef SIC_HAVE_IO_URING
+	// The submission and completion rings shared with the kernel (one mapping, IORING_FEAT_SINGLE_MMAP)
+	struct BatchIo::Ring
+	{
+		int fd = -1;
+		void* rings = nullptr;
+		size_t ringsSize = 0;
+		io_uring_sqe* sqes = nullptr;
+		size_t sqesSize = 0;
+
+		unsigned* sqTail = nullptr;
+		unsigned sqMask = 0;
+		unsigned* sqArray = nullptr;
+		unsigned* cqHead = nullptr;
+		unsigned* cqTail = nullptr;
+		unsigned cqMask = 0;
+		io_uring_cqe* cqes = nullptr;
+		unsigned unsubmitted = 0;
+
+		~Ring()
+		{
+			if (sqes)
+			{
+				munmap(sqes, sqesSize);
+			}
+			if (rings)
+			{
+				munmap(rings, ringsSize);
+			}
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+		}
+
+		bool setup(unsigned entries)
+		{
+			io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+			fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+			if (fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP) || !supportsOperations())
+			{
+				return false;
+			}
+
+			ringsSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+								 params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+			void* map = mmap(nullptr, ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			if (map == MAP_FAILED)
+			{
+				return false;
+			}
+			rings = map;
+			sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			map = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+			if (map == MAP_FAILED)
+			{
+				return false;
+			}
+			sqes = static_cast<io_uring_sqe*>(map);
+
+			uint8_t* base = static_cast<uint8_t*>(rings);
+			sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+			sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+			sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+			cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+			cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+			cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+			cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+			return true;
+		}
+
+		// Opening and closing through the ring need Linux 5.6
+		bool supportsOperations()
+		{
+			const unsigned probeOps = 256;
+			std::vector<uint8_t> buffer(sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op), 0);
+			io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+			if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, probeOps) < 0)
+			{
+				return false;
+			}
+			const int needed[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE };
+			for (int op : needed)
+			{
+				if (op >= probe->ops_len || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// The ring is sized so that the in-flight requests never need more entries than it has
+		io_uring_sqe* next(uint8_t opcode, uint64_t userData)
+		{
+			unsigned tail = *sqTail;
+			unsigned index = tail & sqMask;
+			io_uring_sqe* sqe = &sqes[index];
+			std::memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = opcode;
+			sqe->user_data = userData;
+			sqArray[index] = index;
+			__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+			unsubmitted++;
+			return sqe;
+		}
+
+		// Submits everything queued and optionally waits for at least one completion
+		bool enter(bool waitForCompletion)
+		{
+			for (;;)
+			{
+				unsigned flags = waitForCompletion ? IORING_ENTER_GETEVENTS : 0;
+				long submitted = syscall(__NR_io_uring_enter, fd, unsubmitted, waitForCompletion ? 1u : 0u, flags, nullptr, 0);
+				if (submitted < 0)
+				{
+					if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+					{
+						continue;
+					}
+					return false;
+				}
+				unsubmitted -= static_cast<unsigned>(submitted);
+				return true;
+			}
+		}
+	};
+
+	namespace
+	{
+		// Low bits of the user data say which operation of a request completed
+		enum Operation : uint64_t
+		{
+			OperationOpen = 0,
+			OperationTransfer = 1,
+			OperationClose = 2,
+		};
+
+		const unsigned maxTransfer = 1u << 30;
+		const size_t initialReadSize = 64 * 1024;
+	}
+#else
+	struct BatchIo::Ring
+	{
+	};
+#endif
+
+	BatchIo::BatchIo() = default;
+
+	BatchIo::~BatchIo()
+	{
+#ifdef SIC_HAVE_IO_URING
+		// Buffers and paths in flight belong to the kernel until their completions arrive
+		queued_.clear();
+		Completion completion;
+		while (ring_ && !inFlight_.empty() && wait(completion))
+		{
+		}
+#endif
+	}
+
+	void BatchIo::init(unsigned queueDepth, bool allowIoUring)
+	{
+		queueDepth_ = std::max(1u, queueDepth);
+		ring_.reset();
+#ifdef SIC_HAVE_IO_URING
+		if (allowIoUring)
+		{
+			// Each request has one operation in flight at a time
+			std::unique_ptr<Ring> ring(new Ring());
+			if (ring->setup(queueDepth_))
+			{
+				ring_ = std::move(ring);
+			}
+		}
+#else
+		(void)allowIoUring;
+#endif
+	}
+
+	void BatchIo::read(const std::string& path, size_t tag)
+	{
+		std::unique_ptr<Request> request(new Request());
+		request->tag = tag;
+		request->path = path;
+		enqueue(std::move(request));
+	}
+
+	void BatchIo::write(const std::string& path, std::vector<uint8_t> data, size_t tag)
+	{
+		std::unique_ptr<Request> request(new Request());
+		request->tag = tag;
+		request->write = true;
+		request->path = path;
+		request->data = std::move(data);
+		enqueue(std::move(request));
+	}
+
+	void BatchIo::enqueue(std::unique_ptr<Request> request)
+	{
+		queued_.push_back(std::move(request));
+		startQueued();
+	}
+
+	bool BatchIo::wait(Completion& completion)
+	{
+		for (;;)
+		{
+			startQueued();
+#ifdef SIC_HAVE_IO_URING
+			if (ring_)
+			{
+				// Reap whatever the kernel has finished; this may queue follow-up operations
+				unsigned head = *ring_->cqHead;
+				while (head != __atomic_load_n(ring_->cqTail, __ATOMIC_ACQUIRE))
+				{
+					const io_uring_cqe& cqe = ring_->cqes[head & ring_->cqMask];
+					uint64_t userData = cqe.user_data;
+					int result = cqe.res;
+					__atomic_store_n(ring_->cqHead, ++head, __ATOMIC_RELEASE);
+					handleCompletion(userData, result);
+				}
+				startQueued();
+
+				// Keep the kernel busy while the caller works on the result
+				if (!finished_.empty() || inFlight_.empty())
+				{
+					if (ring_->unsubmitted > 0 && !ring_->enter(false))
+					{
+						abandonRing();
+					}
+				}
+				else if (!ring_->enter(true))
+				{
+					abandonRing();
+				}
+			}
+#endif
+			if (!ring_ && finished_.empty() && !queued_.empty())
+			{
+				runBlocking(*queued_.front());
+				finished_.push_back(std::move(queued_.front()));
+				queued_.pop_front();
+			}
+
+			if (!finished_.empty())
+			{
+				Request& request = *finished_.front();
+				completion.tag = request.tag;
+				completion.write = request.write;
+				completion.ok = request.ok;
+				completion.path = std::move(request.path);
+				completion.data = std::move(request.data);
+				finished_.pop_front();
+				return true;
+			}
+			if (inFlight_.empty() && queued_.empty())
+			{
+				return false;
+			}
+		}
+	}
+
+	void BatchIo::startQueued()
+	{
+#ifdef SIC_HAVE_IO_URING
+		while (ring_ && !queued_.empty() && inFlight_.size() < queueDepth_)
+		{
+			Request* request = queued_.front().get();
+			inFlight_.push_back(std::move(queued_.front()));
+			queued_.pop_front();
+
+			io_uring_sqe* open = ring_->next(IORING_OP_OPENAT, reinterpret_cast<uint64_t>(request) | OperationOpen);
+			open->fd = AT_FDCWD;
+			open->addr = reinterpret_cast<uint64_t>(request->path.c_str());
+			open->len = request->write ? 0644 : 0;
+			open->open_flags = request->write ? (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC);
+		}
+#endif
+	}
+
+	void BatchIo::handleCompletion(uint64_t userData, int result)
+	{
+#ifdef SIC_HAVE_IO_URING
+		Request* request = reinterpret_cast<Request*>(userData & ~uint64_t(3));
+		uint64_t id = reinterpret_cast<uint64_t>(request);
+		bool readToEnd = false;
+
+		switch (static_cast<Operation>(userData & 3))
+		{
+		case OperationOpen:
+			if (result < 0)
+			{
+				request->ok = false;
+				finish(request);
+				return;
+			}
+			request->fd = result;
+			break;
+		case OperationTransfer:
+			if (result < 0)
+			{
+				request->ok = false;
+			}
+			else if (result == 0 && !request->write)
+			{
+				readToEnd = true;
+			}
+			request->done += static_cast<uint64_t>(std::max(0, result));
+			break;
+		case OperationClose:
+			if (result < 0 && request->write)
+			{
+				request->ok = false; // Delayed write errors show up here on some file systems
+			}
+			finish(request);
+			return;
+		}
+
+		// Reads run until the file reports its end, growing the buffer as needed; no size is fetched first,
+		// as io_uring hands STATX to a worker thread, which costs more than the extra empty read
+		if (!request->write && request->ok && !readToEnd && request->done == request->data.size())
+		{
+			request->data.resize(std::max<size_t>(initialReadSize, request->data.size() * 2));
+		}
+
+		// Next transfer, or close once everything is read or written
+		if (request->ok && !readToEnd && request->done < request->data.size())
+		{
+			io_uring_sqe* transfer = ring_->next(request->write ? IORING_OP_WRITE : IORING_OP_READ, id | OperationTransfer);
+			transfer->fd = request->fd;
+			transfer->addr = reinterpret_cast<uint64_t>(request->data.data() + request->done);
+			transfer->len = static_cast<uint32_t>(std::min<uint64_t>(maxTransfer, request->data.size() - request->done));
+			transfer->off = request->done;
+		}
+		else
+		{
+			if (!request->write)
+			{
+				request->data.resize(static_cast<size_t>(request->done));
+			}
+			io_uring_sqe* close = ring_->next(IORING_OP_CLOSE, id | OperationClose);
+			close->fd = request->fd;
+		}
+#else
+		(void)userData;
+		(void)result;
+#endif
+	}
+
+	// The ring stopped accepting work: fail what was in flight and run the rest blocking
+	void BatchIo::abandonRing()
+	{
+		for (std::unique_ptr<Request>& request : inFlight_)
+		{
+			request->ok = false;
+			finished_.push_back(std::move(request));
+		}
+		inFlight_.clear();
+		ring_.reset();
+	}
+
+	void BatchIo::finish(Request* request)
+	{
+		auto it = std::find_if(inFlight_.begin(), inFlight_.end(), [request](const std::unique_ptr<Request>& r) { return r.get() == request; });
+		finished_.push_back(std::move(*it));
+		*it = std::move(inFlight_.back());
+		inFlight_.pop_back();
+	}
+
+#ifdef _WIN32
+	void BatchIo::runBlocking(Request& request)
+	{
+		FILE* file = std::fopen(request.path.c_str(), request.write ? "wb" : "rb");
+		if (!file)
+		{
+			request.ok = false;
+			return;
+		}
+		if (request.write)
+		{
+			request.ok = std::fwrite(request.data.data(), 1, request.data.size(), file) == request.data.size();
+		}
+		else
+		{
+			std::vector<uint8_t> chunk(1 << 16);
+			for (size_t count; (count = std::fread(chunk.data(), 1, chunk.size(), file)) > 0;)
+			{
+				request.data.insert(request.data.end(), chunk.begin(), chunk.begin() + count);
+			}
+			request.ok = !std::ferror(file);
+		}
+		request.ok = (std::fclose(file) == 0) && request.ok;
+	}
+#else
+	void BatchIo::runBlocking(Request& request)
+	{
+		int fd = request.write ? ::open(request.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+							   : ::open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			request.ok = false;
+			return;
+		}
+		if (!request.write)
+		{
+			struct stat st;
+			request.ok = fstat(fd, &st) == 0;
+			request.data.resize(request.ok ? static_cast<size_t>(st.st_size) : 0);
+		}
+		while (request.ok && request.done < request.data.size())
+		{
+			uint8_t* data = request.data.data() + request.done;
+			size_t size = request.data.size() - request.done;
+			ssize_t result = request.write ? pwrite(fd, data, size, static_cast<off_t>(request.done))
+										   : pread(fd, data, size, static_cast<off_t>(request.done));
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (result == 0 && !request.write)
+			{
+				request.data.resize(static_cast<size_t>(request.done)); // Shrank since it was sized
+				break;
+			}
+			if (result <= 0)
+			{
+				request.ok = false;
+				break;
+			}
+			request.done += static_cast<uint64_t>(result);
+		}
+		request.ok = (::close(fd) == 0 || !request.write) && request.ok;
+	}
+#endif
+}
@@ -0,0 +1,191 @@
+#include "SoundImageConverter/Checksum.h"
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIC_CRC32C_X64 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIC_TARGET_SSE42
+#else
+#define SIC_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+namespace SoundImageConverter
+{
+	namespace Checksum
+	{
+		namespace
+		{
+			const uint32_t polynomial = 0x82F63B78; // Reflected Castagnoli polynomial
+
+			// Slicing-by-8 tables for the portable path
+			struct Tables
+			{
+				uint32_t t[8][256];
+
+				Tables()
+				{
+					for (uint32_t i = 0; i < 256; i++)
+					{
+						uint32_t crc = i;
+						for (int bit = 0; bit < 8; bit++)
+						{
+							crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+						}
+						t[0][i] = crc;
+					}
+					for (uint32_t i = 0; i < 256; i++)
+					{
+						for (int k = 1; k < 8; k++)
+						{
+							t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+						}
+					}
+				}
+			};
+
+			// GF(2) 32x32 matrices for combine(), as in zlib's crc32_combine
+			uint32_t matrixTimes(const uint32_t* matrix, uint32_t vector)
+			{
+				uint32_t sum = 0;
+				for (; vector != 0; vector >>= 1, matrix++)
+				{
+					if (vector & 1)
+					{
+						sum ^= *matrix;
+					}
+				}
+				return sum;
+			}
+
+			void matrixSquare(uint32_t* square, const uint32_t* matrix)
+			{
+				for (int n = 0; n < 32; n++)
+				{
+					square[n] = matrixTimes(matrix, matrix[n]);
+				}
+			}
+
+			uint32_t crc32cSoftware(uint32_t crc, const uint8_t* p, size_t size)
+			{
+				static const Tables tables;
+				const auto& t = tables.t;
+				while (size >= 8)
+				{
+					uint32_t lo, hi;
+					std::memcpy(&lo, p, 4);
+					std::memcpy(&hi, p + 4, 4);
+					lo ^= crc; // Little-endian load, matching the reflected bit order
+					crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+						  t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+					p += 8;
+					size -= 8;
+				}
+				while (size--)
+				{
+					crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+				}
+				return crc;
+			}
+
+#ifdef SIC_CRC32C_X64
+			SIC_TARGET_SSE42 uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t size)
+			{
+				uint64_t crc64 = crc;
+				while (size >= 8)
+				{
+					uint64_t word;
+					std::memcpy(&word, p, 8);
+					crc64 = _mm_crc32_u64(crc64, word);
+					p += 8;
+					size -= 8;
+				}
+				uint32_t crc32 = static_cast<uint32_t>(crc64);
+				while (size--)
+				{
+					crc32 = _mm_crc32_u8(crc32, *p++);
+				}
+				return crc32;
+			}
+
+			bool detectSse42()
+			{
+#ifdef _MSC_VER
+				int info[4];
+				__cpuid(info, 1);
+				return (info[2] & (1 << 20)) != 0;
+#else
+				return __builtin_cpu_supports("sse4.2");
+#endif
+			}
+#endif
+		}
+
+		bool hardwareAccelerated()
+		{
+#ifdef SIC_CRC32C_X64
+			static const bool supported = detectSse42();
+			return supported;
+#else
+			return false;
+#endif
+		}
+
+		uint32_t crc32c(uint32_t crc, const void* data, size_t size)
+		{
+			const uint8_t* p = static_cast<const uint8_t*>(data);
+			crc = ~crc;
+#ifdef SIC_CRC32C_X64
+			if (hardwareAccelerated())
+			{
+				return ~crc32cHardware(crc, p, size);
+			}
+#endif
+			return ~crc32cSoftware(crc, p, size);
+		}
+
+		uint32_t combine(uint32_t first, uint32_t second, uint64_t secondSize)
+		{
+			// Appending secondSize zero bytes to the first part is a linear map; apply it by repeated squaring
+			uint32_t even[32];
+			uint32_t odd[32];
+			odd[0] = polynomial; // One zero bit
+			for (int n = 1; n < 32; n++)
+			{
+				odd[n] = 1u << (n - 1);
+			}
+			matrixSquare(even, odd); // Two zero bits
+			matrixSquare(odd, even); // Four zero bits
+			while (secondSize != 0)
+			{
+				matrixSquare(even, odd); // First pass: one zero byte
+				if (secondSize & 1)
+				{
+					first = matrixTimes(even, first);
+				}
+				secondSize >>= 1;
+				if (secondSize == 0)
+				{
+					break;
+				}
+				matrixSquare(odd, even);
+				if (secondSize & 1)
+				{
+					first = matrixTimes(odd, first);
+				}
+				secondSize >>= 1;
+			}
+			return first ^ second;
+		}
+
+		std::string toHex(uint32_t crc)
+		{
+			char hex[9];
+			std::snprintf(hex, sizeof(hex), "%08x", static_cast<unsigned>(crc));
+			return hex;
+		}
+	}
+}
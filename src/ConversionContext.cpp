@@ -0,0 +1,327 @@
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include <algorithm>
+#include <cstring>
+
+namespace SoundImageConverter
+{
+	namespace
+	{
+		// In front of every block from contextAllocate
+		struct BlockHeader
+		{
+			size_t size;
+			size_t start; // Arena blocks: where the arena's fill level goes back to when this is the last block and is freed
+			void* arena; // nullptr for heap blocks
+			MemoryAccount* account; // Heap blocks: counted here, under stage, while allocated
+			MemoryStage stage;
+		};
+
+		const size_t heapPrefix = cacheLineBytes; // Heap blocks: the header sits at the end of one cache line, the data starts the next
+
+		BlockHeader* headerOf(void* data)
+		{
+			return static_cast<BlockHeader*>(data) - 1;
+		}
+
+		void* heapAllocate(size_t size)
+		{
+			uint8_t* base = static_cast<uint8_t*>(::operator new(size + heapPrefix, std::align_val_t(cacheLineBytes), std::nothrow));
+			if (!base)
+			{
+				return nullptr;
+			}
+			void* data = base + heapPrefix;
+			MemoryAccount* account = MemoryAccount::current();
+			*headerOf(data) = BlockHeader{ size, 0, nullptr, account, MemoryAccount::currentStage() };
+			if (account)
+			{
+				account->add(headerOf(data)->stage, size + heapPrefix);
+			}
+			return data;
+		}
+
+		void heapFree(void* data)
+		{
+			const BlockHeader& header = *headerOf(data);
+			if (header.account)
+			{
+				header.account->remove(header.stage, header.size + heapPrefix);
+			}
+			::operator delete(static_cast<uint8_t*>(data) - heapPrefix, std::align_val_t(cacheLineBytes));
+		}
+
+		thread_local ConversionContext* currentContext = nullptr;
+	}
+
+	// One chunk, filled from the start and emptied when a scope ends. What does not fit goes to the heap and is
+	// counted, and the chunk is reallocated to hold all of it the next time, so repeated conversions settle on one allocation.
+	// The chunk counts as codec memory of the context's account
+	struct ConversionContext::Arena
+	{
+		explicit Arena(MemoryAccount& account) : account(account) {}
+
+		MemoryAccount& account;
+		uint8_t* chunk = nullptr;
+		size_t capacity = 0;
+		size_t used = 0;
+		size_t peak = 0; // Since the last reset
+		size_t missed = 0; // Bytes that went to the heap since the last reset
+
+		~Arena()
+		{
+			release();
+		}
+
+		// nullptr if the block does not fit
+		void* allocate(size_t size)
+		{
+			size_t align = size >= 4096 ? cacheLineBytes : alignof(std::max_align_t); // Large blocks are stb's image and zlib buffers
+			size_t offset = (used + sizeof(BlockHeader) + align - 1) / align * align;
+			if (offset > capacity || size > capacity - offset)
+			{
+				missed += size + heapPrefix;
+				return nullptr;
+			}
+			void* data = chunk + offset;
+			*headerOf(data) = BlockHeader{ size, used, this, nullptr, MemoryStageCodec };
+			used = offset + size;
+			peak = std::max(peak, used);
+			return data;
+		}
+
+		bool isLast(void* data) const
+		{
+			return static_cast<uint8_t*>(data) + headerOf(data)->size == chunk + used;
+		}
+
+		void free(void* data)
+		{
+			if (isLast(data))
+			{
+				used = headerOf(data)->start;
+			}
+		}
+
+		// Grows the last block in place; false if data is not the last block or the chunk is too small
+		bool extend(void* data, size_t size)
+		{
+			size_t offset = static_cast<size_t>(static_cast<uint8_t*>(data) - chunk);
+			if (!isLast(data) || size > capacity - offset)
+			{
+				return false;
+			}
+			headerOf(data)->size = size;
+			used = offset + size;
+			peak = std::max(peak, used);
+			return true;
+		}
+
+		void reset()
+		{
+			if (missed > 0)
+			{
+				// A quarter more, so a slightly larger input still fits
+				size_t needed = (peak + missed) / 4 * 5;
+				release();
+				chunk = static_cast<uint8_t*>(::operator new(needed, std::align_val_t(cacheLineBytes), std::nothrow));
+				capacity = chunk ? needed : 0;
+				account.add(MemoryStageCodec, capacity);
+			}
+			used = 0;
+			peak = 0;
+			missed = 0;
+		}
+
+		void release()
+		{
+			if (chunk)
+			{
+				account.remove(MemoryStageCodec, capacity);
+				::operator delete(chunk, std::align_val_t(cacheLineBytes));
+			}
+			chunk = nullptr;
+			capacity = 0;
+		}
+	};
+
+	ConversionContext::ConversionContext() : arena_(new Arena(memory_))
+	{
+	}
+
+	ConversionContext::~ConversionContext() = default;
+
+	template <>
+	std::vector<AlignedVector<uint8_t>>& ConversionContext::pool<uint8_t>()
+	{
+		return bytes_;
+	}
+
+	template <>
+	std::vector<AlignedVector<int16_t>>& ConversionContext::pool<int16_t>()
+	{
+		return samples_;
+	}
+
+	template <typename T>
+	AlignedVector<T> ConversionContext::take(size_t capacity)
+	{
+		std::vector<AlignedVector<T>>& buffers = pool<T>();
+		AlignedVector<T> buffer;
+		if (!buffers.empty())
+		{
+			// The smallest that fits, else the largest
+			auto best = std::min_element(buffers.begin(), buffers.end(), [capacity](const AlignedVector<T>& a, const AlignedVector<T>& b)
+				{
+					bool aFits = a.capacity() >= capacity;
+					bool bFits = b.capacity() >= capacity;
+					if (aFits != bFits)
+					{
+						return aFits;
+					}
+					return aFits ? a.capacity() < b.capacity() : a.capacity() > b.capacity();
+				});
+			buffer = std::move(*best);
+			*best = std::move(buffers.back());
+			buffers.pop_back();
+		}
+		buffer.reserve(capacity);
+		return buffer;
+	}
+
+	template AlignedVector<uint8_t> ConversionContext::take<uint8_t>(size_t capacity);
+	template AlignedVector<int16_t> ConversionContext::take<int16_t>(size_t capacity);
+
+	void ConversionContext::give(AlignedVector<uint8_t>&& buffer)
+	{
+		if (buffer.capacity() > 0)
+		{
+			buffer.clear();
+			bytes_.push_back(std::move(buffer));
+		}
+	}
+
+	void ConversionContext::give(AlignedVector<int16_t>&& buffer)
+	{
+		if (buffer.capacity() > 0)
+		{
+			buffer.clear();
+			samples_.push_back(std::move(buffer));
+		}
+	}
+
+	ImageSink& ConversionContext::sink(const ImageCodec& codec)
+	{
+		for (const auto& entry : sinks_)
+		{
+			if (entry.first == &codec)
+			{
+				return *entry.second;
+			}
+		}
+		sinks_.emplace_back(&codec, codec.createSink());
+		return *sinks_.back().second;
+	}
+
+	ImageSource& ConversionContext::source(const ImageCodec& codec)
+	{
+		for (const auto& entry : sources_)
+		{
+			if (entry.first == &codec)
+			{
+				return *entry.second;
+			}
+		}
+		sources_.emplace_back(&codec, codec.createSource());
+		return *sources_.back().second;
+	}
+
+	size_t ConversionContext::retainedBytes() const
+	{
+		size_t bytes = arena_->capacity;
+		for (const AlignedVector<uint8_t>& buffer : bytes_)
+		{
+			bytes += buffer.capacity();
+		}
+		for (const AlignedVector<int16_t>& buffer : samples_)
+		{
+			bytes += buffer.capacity() * sizeof(int16_t);
+		}
+		return bytes;
+	}
+
+	void ConversionContext::clear()
+	{
+		std::vector<AlignedVector<uint8_t>>().swap(bytes_);
+		std::vector<AlignedVector<int16_t>>().swap(samples_);
+		sinks_.clear();
+		sources_.clear();
+		arena_->release();
+	}
+
+	ConversionContext::Scope::Scope(ConversionContext* context) : context_(context), previous_(currentContext)
+	{
+		if (context_)
+		{
+			currentContext = context_;
+		}
+	}
+
+	ConversionContext::Scope::~Scope()
+	{
+		if (context_)
+		{
+			context_->arena_->reset();
+			currentContext = previous_;
+		}
+	}
+
+	ConversionContext* ConversionContext::current()
+	{
+		return currentContext;
+	}
+
+	void* contextAllocate(size_t size)
+	{
+		void* data = currentContext ? currentContext->arena_->allocate(size) : nullptr;
+		return data ? data : heapAllocate(size);
+	}
+
+	void* contextReallocate(void* data, size_t size)
+	{
+		if (!data)
+		{
+			return contextAllocate(size);
+		}
+		BlockHeader* header = headerOf(data);
+		ConversionContext::Arena* arena = static_cast<ConversionContext::Arena*>(header->arena);
+		if (arena && arena->extend(data, size))
+		{
+			return data;
+		}
+		void* moved = contextAllocate(size);
+		if (moved)
+		{
+			std::memcpy(moved, data, std::min(header->size, size));
+			contextFree(data);
+		}
+		return moved;
+	}
+
+	void contextFree(void* data)
+	{
+		if (!data)
+		{
+			return;
+		}
+		ConversionContext::Arena* arena = static_cast<ConversionContext::Arena*>(headerOf(data)->arena);
+		if (arena)
+		{
+			arena->free(data);
+		}
+		else
+		{
+			heapFree(data);
+		}
+	}
+}
@@ -0,0 +1,997 @@
+#include "SoundImageConverter/ConversionServer.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/HttpServer.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/SharedMemory.h"
+#include "SoundImageConverter/Stream.h"
+#include "SoundImageConverter/TaskScheduler.h"
+#include "SoundImageConverter/WavFile.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0 // macOS: a vanished peer raises SIGPIPE, which the daemon ignores
+#endif
+
+namespace SoundImageConverter
+{
+#ifndef _WIN32
+	namespace
+	{
+		const size_t requestHeaderBytes = 20;
+		const size_t responseHeaderBytes = 32;
+		const size_t payloadStepBytes = 64 << 10; // Least a payload buffer grows by while the request arrives
+		const char requestMagic[4] = { 'S', 'I', 'C', 'Q' };
+		const char responseMagic[4] = { 'S', 'I', 'C', 'A' };
+
+		inline uint16_t get16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+		inline uint32_t get32(const uint8_t* p) { return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16); }
+		inline uint64_t get64(const uint8_t* p) { return get32(p) | (static_cast<uint64_t>(get32(p + 4)) << 32); }
+
+		inline void put16(uint8_t*& p, uint16_t v) { *p++ = v & 0xFF; *p++ = v >> 8; }
+		inline void put32(uint8_t*& p, uint32_t v) { put16(p, v & 0xFFFF); put16(p, v >> 16); }
+		inline void put64(uint8_t*& p, uint64_t v) { put32(p, v & 0xFFFFFFFF); put32(p, static_cast<uint32_t>(v >> 32)); }
+
+		// Request and response buffers, reused so a steady stream of requests allocates nothing
+		class BufferPool
+		{
+		public:
+			// Allocates count buffers of bytes each and touches them, so their pages are mapped before the first request
+			void init(unsigned count, size_t bytes)
+			{
+				keepLimit_ = bytes * 16;
+				maxKept_ = count;
+				for (unsigned i = 0; i < count; i++)
+				{
+					std::vector<uint8_t> buffer(bytes);
+					buffer.clear();
+					spare_.push_back(std::move(buffer));
+				}
+			}
+
+			std::vector<uint8_t> acquire()
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (spare_.empty())
+				{
+					return std::vector<uint8_t>();
+				}
+				std::vector<uint8_t> buffer = std::move(spare_.back());
+				spare_.pop_back();
+				return buffer;
+			}
+
+			// One huge request should not pin its buffers for the life of the daemon
+			void release(std::vector<uint8_t> buffer)
+			{
+				buffer.clear();
+				if (buffer.capacity() == 0 || buffer.capacity() > keepLimit_)
+				{
+					return;
+				}
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (spare_.size() < maxKept_)
+				{
+					spare_.push_back(std::move(buffer));
+				}
+			}
+
+		private:
+			std::mutex mutex_;
+			std::vector<std::vector<uint8_t>> spare_;
+			size_t keepLimit_ = 0;
+			size_t maxKept_ = 0;
+		};
+
+		// Converts one request held in memory, with the buffers and backends of context if given
+		ServerResponse convertRequest(const ServerRequest& request, const uint8_t* data, size_t size, OutputStream& out, TaskScheduler* scheduler,
+			ConversionContext* context = nullptr)
+		{
+			std::string imagePath = "request." + request.type;
+			MemoryInputStream in(data, size);
+			ConversionResult result;
+			if (!ImageCodecRegistry::instance().findForPath(imagePath) || (request.operation != ServerEncode && request.operation != ServerDecode))
+			{
+				result.error = ConversionUnsupported;
+			}
+			else if (request.operation == ServerEncode)
+			{
+				EncodeOptions options;
+				options.sampleRate = request.sampleRate;
+				options.pipeline = false; // Requests already keep the workers busy
+				options.scheduler = scheduler;
+				options.context = context;
+				options.log = nullptr;
+				result = Encoder::encode(in, "request", out, imagePath, options);
+			}
+			else
+			{
+				DecodeOptions options;
+				options.output = AudioOutputWav;
+				options.pipeline = false;
+				options.scheduler = scheduler;
+				options.context = context;
+				options.log = nullptr;
+				result = Decoder::decode(in, imagePath, out, "request.wav", options);
+			}
+
+			ServerResponse response;
+			response.error = result.error;
+			response.frames = result.frames;
+			return response;
+		}
+
+		// A tenth of a second of a tone, the input of the warm-up conversions
+		std::vector<uint8_t> warmUpWav()
+		{
+			WavFormat format;
+			format.sampleRate = 8000;
+			format.channels = 1;
+			format.bitsPerSample = 16;
+			format.frames = 800;
+			std::vector<int16_t> samples(static_cast<size_t>(format.frames));
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				samples[i] = static_cast<int16_t>(8000 * std::sin(i * 0.25));
+			}
+			std::vector<uint8_t> wav;
+			MemoryOutputStream out(wav);
+			WavWriter writer;
+			writer.begin(out, format);
+			writer.writeFrames(samples.data(), samples.size());
+			writer.finish();
+			return wav;
+		}
+
+		typedef std::chrono::steady_clock Clock;
+
+		// A client still sending its request or waiting for the answer. The poll loop reads the request;
+		// from then until it is answered the connection belongs to the worker converting it
+		struct Connection
+		{
+			int fd = -1;
+			uint8_t header[requestHeaderBytes];
+			size_t headerGot = 0;
+			size_t typeLength = 0;
+			uint64_t payloadSize = 0;
+			uint64_t payloadGot = 0;
+			uint16_t flags = 0;
+			ServerRequest request;
+			std::vector<uint8_t> payload;
+			std::vector<int> descriptors; // Shared memory that came with the header
+			MappedFile shared;
+			uint64_t sharedSize = 0;
+			int sharedOutput = -1;
+			ConversionError rejected = ConversionOk; // Answered without converting
+			bool busy = false;
+			bool broken = false; // The answer could not be sent
+
+			Connection() = default;
+			Connection(const Connection&) = delete;
+			Connection& operator=(const Connection&) = delete;
+
+			// Whatever state the client left it in, e.g. a shared memory header without the rest of the request
+			~Connection()
+			{
+				::close(fd);
+				for (int descriptor : descriptors)
+				{
+					::close(descriptor);
+				}
+				if (sharedOutput >= 0)
+				{
+					::close(sharedOutput);
+				}
+			}
+		};
+
+		// Room for the descriptors of a shared memory request, input and output
+		const int maxDescriptors = 2;
+		union DescriptorMessage
+		{
+			cmsghdr header;
+			char space[CMSG_SPACE(sizeof(int) * maxDescriptors)];
+		};
+
+		// Writes all of the buffers, waiting for room on non-blocking sockets; descriptorCount descriptors go with
+		// the first byte. Gives up on a peer that takes more than 30 s to make room, so a stuck client cannot
+		// hold a worker forever
+		bool sendAll(int fd, iovec* parts, int count, const int* descriptors = nullptr, int descriptorCount = 0)
+		{
+			while (count > 0)
+			{
+				msghdr message = {};
+				message.msg_iov = parts;
+				message.msg_iovlen = count;
+				DescriptorMessage control;
+				if (descriptorCount > 0)
+				{
+					std::memset(&control, 0, sizeof(control));
+					message.msg_control = control.space;
+					message.msg_controllen = CMSG_SPACE(sizeof(int) * descriptorCount);
+					cmsghdr* header = CMSG_FIRSTHDR(&message);
+					header->cmsg_level = SOL_SOCKET;
+					header->cmsg_type = SCM_RIGHTS;
+					header->cmsg_len = CMSG_LEN(sizeof(int) * descriptorCount);
+					std::memcpy(CMSG_DATA(header), descriptors, sizeof(int) * descriptorCount);
+				}
+				ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+				if (sent < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					pollfd wait = { fd, POLLOUT, 0 };
+					if ((errno != EAGAIN && errno != EWOULDBLOCK) || poll(&wait, 1, 30000) <= 0)
+					{
+						return false;
+					}
+					continue;
+				}
+				descriptorCount = 0; // Sent along with the first byte
+				size_t left = static_cast<size_t>(sent);
+				while (count > 0 && left >= parts->iov_len)
+				{
+					left -= parts->iov_len;
+					parts++;
+					count--;
+				}
+				if (count > 0)
+				{
+					parts->iov_base = static_cast<uint8_t*>(parts->iov_base) + left;
+					parts->iov_len -= left;
+				}
+			}
+			return true;
+		}
+
+		// Reads up to size bytes like recv; descriptors sent along are added to descriptors
+		ssize_t receiveWithDescriptors(int fd, void* data, size_t size, std::vector<int>& descriptors)
+		{
+			iovec part = { data, size };
+			DescriptorMessage control;
+			msghdr message = {};
+			message.msg_iov = &part;
+			message.msg_iovlen = 1;
+			message.msg_control = control.space;
+			message.msg_controllen = sizeof(control.space);
+#ifdef MSG_CMSG_CLOEXEC
+			ssize_t got = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+#else
+			ssize_t got = recvmsg(fd, &message, 0);
+#endif
+			for (cmsghdr* header = got >= 0 ? CMSG_FIRSTHDR(&message) : nullptr; header; header = CMSG_NXTHDR(&message, header))
+			{
+				if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+				{
+					continue;
+				}
+				size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+				for (size_t i = 0; i < count; i++)
+				{
+					int received;
+					std::memcpy(&received, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+					descriptors.push_back(received);
+				}
+			}
+			return got;
+		}
+
+		// Blocking read of exactly size bytes
+		bool receiveAll(int fd, void* data, size_t size)
+		{
+			uint8_t* p = static_cast<uint8_t*>(data);
+			while (size > 0)
+			{
+				ssize_t got = recv(fd, p, size, 0);
+				if (got < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (got <= 0)
+				{
+					return false;
+				}
+				p += got;
+				size -= static_cast<size_t>(got);
+			}
+			return true;
+		}
+
+		uint64_t microsecondsSince(Clock::time_point start)
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+		}
+
+		// Fills in an answer header, returns its size
+		size_t responseHeader(uint8_t* header, const ServerResponse& response, uint64_t payloadSize)
+		{
+			uint8_t* p = header;
+			std::memcpy(p, responseMagic, 4);
+			p += 4;
+			put32(p, response.error);
+			put64(p, response.frames);
+			put64(p, response.serverMicroseconds);
+			put64(p, payloadSize);
+			return responseHeaderBytes;
+		}
+
+		bool setNonBlocking(int fd)
+		{
+			int flags = fcntl(fd, F_GETFL);
+			return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+		}
+
+		bool socketAddress(const std::string& path, sockaddr_un& address)
+		{
+			address = {};
+			address.sun_family = AF_UNIX;
+			if (path.empty() || path.size() >= sizeof(address.sun_path))
+			{
+				std::cerr << "Error: Socket path must be 1 to " << sizeof(address.sun_path) - 1 << " characters: " << path << std::endl;
+				return false;
+			}
+			std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+			return true;
+		}
+	}
+
+	// An HTTP connection and the thread answering it
+	struct HttpWorker
+	{
+		std::unique_ptr<HttpConnection> connection;
+		std::thread thread;
+		std::atomic<bool> done{ false };
+	};
+
+	struct ConversionServer::State
+	{
+		ServerOptions options;
+		std::unique_ptr<TaskScheduler> scheduler;
+		TaskScheduler::TaskGroup requests;
+		BufferPool buffers;
+		std::unique_ptr<ConversionContext[]> contexts; // One per worker
+		std::string socketPath;
+		int listener = -1;
+		int httpListener = -1;
+		int wakeRead = -1;
+		int wakeWrite = -1;
+		std::atomic<bool> stopping{ false };
+		std::vector<std::unique_ptr<Connection>> connections; // Only touched by the poll loop
+		std::vector<std::unique_ptr<HttpWorker>> httpWorkers; // Same
+
+		std::mutex mutex; // Guards answered and stats
+		std::vector<Connection*> answered;
+		ServerStats stats;
+
+		// Reads what the socket has; returns false once the connection should be closed
+		bool receive(Connection& connection);
+		void serve(Connection& connection, Clock::time_point received);
+		void serveHttp(HttpWorker& worker);
+		void wake();
+	};
+
+	bool ConversionServer::State::receive(Connection& connection)
+	{
+		for (;;)
+		{
+			uint8_t* target;
+			size_t wanted;
+			if (connection.headerGot < requestHeaderBytes)
+			{
+				target = connection.header + connection.headerGot;
+				wanted = requestHeaderBytes - connection.headerGot;
+			}
+			else if (connection.request.type.size() < connection.typeLength)
+			{
+				uint8_t name[255];
+				wanted = connection.typeLength - connection.request.type.size();
+				ssize_t got = recv(connection.fd, name, wanted, 0);
+				if (got <= 0)
+				{
+					return got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+				}
+				connection.request.type.append(reinterpret_cast<const char*>(name), static_cast<size_t>(got));
+				continue;
+			}
+			else
+			{
+				// The buffer grows with what has arrived, at most doubling, rather than to the size the header
+				// announces: clients that only announce large payloads would otherwise commit up to
+				// maxRequestBytes each
+				if (connection.payloadGot == connection.payload.size() && connection.payloadGot < connection.payloadSize)
+				{
+					uint64_t grown = std::max<uint64_t>({ connection.payload.capacity(), connection.payloadGot * 2, payloadStepBytes });
+					connection.payload.resize(static_cast<size_t>(std::min(connection.payloadSize, grown)));
+				}
+				target = connection.payload.data() + connection.payloadGot;
+				wanted = connection.payload.size() - static_cast<size_t>(connection.payloadGot);
+			}
+
+			if (wanted > 0)
+			{
+				// Shared memory comes with the first byte of the header
+				ssize_t got = connection.headerGot < requestHeaderBytes ? receiveWithDescriptors(connection.fd, target, wanted, connection.descriptors)
+																		: recv(connection.fd, target, wanted, 0);
+				if (got <= 0)
+				{
+					return got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+				}
+				if (connection.headerGot < requestHeaderBytes)
+				{
+					connection.headerGot += static_cast<size_t>(got);
+					if (connection.headerGot < requestHeaderBytes)
+					{
+						continue;
+					}
+					// Whole header: check it and take a payload buffer, or map the shared memory
+					const uint8_t* h = connection.header;
+					connection.flags = get16(h + 6);
+					if (std::memcmp(h, requestMagic, 4) != 0 || (connection.flags & ~ServerSharedMemory) != 0)
+					{
+						return false;
+					}
+					connection.request.operation = static_cast<ServerOperation>(h[4]);
+					connection.typeLength = h[5];
+					connection.request.type.clear();
+					connection.request.sampleRate = get32(h + 8);
+					connection.payloadSize = get64(h + 12);
+					connection.payloadGot = 0;
+					connection.rejected = ConversionOk;
+					if ((connection.flags & ServerSharedMemory) != 0)
+					{
+						connection.sharedSize = connection.payloadSize;
+						connection.payloadSize = 0;
+						// A client shrinking either memory under the converter would kill the daemon with SIGBUS
+						const std::vector<int>& received = connection.descriptors;
+						if (received.size() != 2 || !sharedMemorySizeSealed(received[0]) || !sharedMemorySizeSealed(received[1])
+							|| !connection.shared.openDescriptor(received[0]) || connection.shared.size() < connection.sharedSize)
+						{
+							connection.shared.close();
+							connection.rejected = ConversionInvalidInput;
+						}
+						else
+						{
+							connection.sharedOutput = received[1];
+							connection.descriptors.pop_back();
+						}
+					}
+					for (int descriptor : connection.descriptors)
+					{
+						::close(descriptor);
+					}
+					connection.descriptors.clear();
+					if (connection.payloadSize > options.maxRequestBytes)
+					{
+						// Answer why, then drop the connection rather than read a payload that size
+						uint8_t response[responseHeaderBytes];
+						ServerResponse rejected;
+						rejected.error = ConversionInvalidInput;
+						iovec part = { response, responseHeader(response, rejected, 0) };
+						sendAll(connection.fd, &part, 1);
+						return false;
+					}
+					connection.payload = buffers.acquire();
+				}
+				else
+				{
+					connection.payloadGot += static_cast<uint64_t>(got);
+				}
+				continue;
+			}
+
+			// Whole request: a worker converts and answers it
+			connection.busy = true;
+			connection.headerGot = 0;
+			Connection* owner = &connection;
+			Clock::time_point received = Clock::now();
+			scheduler->spawn(requests, [this, owner, received]() { serve(*owner, received); });
+			return true;
+		}
+	}
+
+	void ConversionServer::State::serve(Connection& connection, Clock::time_point received)
+	{
+		ServerResponse response;
+		response.error = connection.rejected;
+		uint8_t header[responseHeaderBytes];
+		int worker = scheduler->workerIndex();
+		ConversionContext* context = worker >= 0 ? &contexts[worker] : nullptr;
+		if ((connection.flags & ServerSharedMemory) != 0)
+		{
+			// Straight from the client's input mapping into its output mapping
+			SharedMemoryOutputStream out;
+			if (response.error == ConversionOk && !out.attach(connection.sharedOutput))
+			{
+				response.error = ConversionOpenOutputFailed;
+			}
+			connection.sharedOutput = -1; // The stream closes it
+			if (response.error == ConversionOk)
+			{
+				response = convertRequest(connection.request, connection.shared.data(), static_cast<size_t>(connection.sharedSize), out, scheduler.get(), context);
+				if (response.ok() && !out.finish())
+				{
+					response.error = ConversionWriteFailed;
+				}
+			}
+			connection.shared.close();
+			response.serverMicroseconds = microsecondsSince(received);
+			iovec part = { header, responseHeader(header, response, response.ok() ? out.size() : 0) };
+			connection.broken = !sendAll(connection.fd, &part, 1);
+		}
+		else
+		{
+			std::vector<uint8_t> output = buffers.acquire();
+			MemoryOutputStream out(output);
+			if (response.error == ConversionOk)
+			{
+				response = convertRequest(connection.request, connection.payload.data(), connection.payload.size(), out, scheduler.get(), context);
+			}
+			if (!response.ok())
+			{
+				output.clear();
+			}
+			response.serverMicroseconds = microsecondsSince(received);
+			iovec parts[2] = { { header, responseHeader(header, response, output.size()) }, { output.data(), output.size() } };
+			connection.broken = !sendAll(connection.fd, parts, output.empty() ? 1 : 2);
+			buffers.release(std::move(output));
+		}
+		buffers.release(std::move(connection.payload));
+		connection.payload = std::vector<uint8_t>();
+		if (context && context->retainedBytes() > options.bufferBytes * 16)
+		{
+			context->clear(); // As with the buffer pool, one huge request should not stay resident
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.requests++;
+			stats.failed += response.error != ConversionOk;
+			answered.push_back(&connection);
+		}
+		wake();
+	}
+
+	void ConversionServer::State::serveHttp(HttpWorker& worker)
+	{
+		worker.connection->serve([this](const ConversionResult& result)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.requests++;
+				stats.failed += result.error != ConversionOk;
+			});
+		worker.done = true;
+		wake();
+	}
+
+	void ConversionServer::State::wake()
+	{
+		char byte = 0;
+		ssize_t ignored = write(wakeWrite, &byte, 1); // A full pipe already has a wake-up pending
+		(void)ignored;
+	}
+
+	ConversionServer::ConversionServer(const ServerOptions& options) : state_(new State())
+	{
+		state_->options = options;
+	}
+
+	ConversionServer::~ConversionServer()
+	{
+		for (int fd : { state_->listener, state_->httpListener, state_->wakeRead, state_->wakeWrite })
+		{
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+		}
+		if (state_->listener >= 0)
+		{
+			unlink(state_->socketPath.c_str());
+		}
+	}
+
+	bool ConversionServer::start(const std::string& socketPath)
+	{
+		State& s = *state_;
+		if (s.listener >= 0 || s.httpListener >= 0 || s.wakeRead >= 0)
+		{
+			return false;
+		}
+
+		if (!socketPath.empty() || s.options.httpPort == 0)
+		{
+			sockaddr_un address;
+			if (!socketAddress(socketPath, address))
+			{
+				return false;
+			}
+
+			// Replace a socket left by a daemon that died, but not one that still answers, nor a file that is not a socket
+			struct stat info;
+			if (lstat(socketPath.c_str(), &info) == 0)
+			{
+				ConversionClient probe;
+				if (!S_ISSOCK(info.st_mode) || probe.connect(socketPath))
+				{
+					std::cerr << "Error: " << socketPath << (S_ISSOCK(info.st_mode) ? " is in use by another server" : " exists and is not a socket") << std::endl;
+					return false;
+				}
+				unlink(socketPath.c_str());
+			}
+
+			s.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (s.listener < 0 || !setNonBlocking(s.listener) || bind(s.listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+			{
+				std::cerr << "Error: Could not bind " << socketPath << ": " << std::strerror(errno) << std::endl;
+				if (s.listener >= 0)
+				{
+					::close(s.listener);
+					s.listener = -1;
+				}
+				return false;
+			}
+			s.socketPath = socketPath;
+			if (listen(s.listener, SOMAXCONN) != 0)
+			{
+				std::cerr << "Error: Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+				return false;
+			}
+		}
+		if (s.options.httpPort != 0 && ((s.httpListener = listenHttp(s.options.httpPort)) < 0 || !setNonBlocking(s.httpListener)))
+		{
+			return false;
+		}
+
+		int pipeEnds[2];
+		if (pipe(pipeEnds) != 0)
+		{
+			std::cerr << "Error: Could not create a pipe: " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		s.wakeRead = pipeEnds[0];
+		s.wakeWrite = pipeEnds[1];
+		setNonBlocking(s.wakeRead);
+		setNonBlocking(s.wakeWrite);
+
+		s.scheduler.reset(new TaskScheduler(s.options.threads));
+		unsigned buffers = s.options.buffers != 0 ? s.options.buffers : 4 * s.scheduler->threadCount();
+		s.buffers.init(buffers, s.options.bufferBytes);
+		s.contexts.reset(new ConversionContext[s.scheduler->threadCount()]);
+
+		// One round trip per backend: codec tables, code pages and the allocator are all warm afterwards
+		std::vector<uint8_t> wav = warmUpWav();
+		for (const std::unique_ptr<ImageCodec>& codec : ImageCodecRegistry::instance().codecs())
+		{
+			ServerRequest request;
+			request.type = codec->extensions().front().substr(1);
+			std::vector<uint8_t> image = s.buffers.acquire();
+			std::vector<uint8_t> decoded = s.buffers.acquire();
+			MemoryOutputStream imageOut(image);
+			MemoryOutputStream decodedOut(decoded);
+			convertRequest(request, wav.data(), wav.size(), imageOut, s.scheduler.get());
+			request.operation = ServerDecode;
+			convertRequest(request, image.data(), image.size(), decodedOut, s.scheduler.get());
+			s.buffers.release(std::move(image));
+			s.buffers.release(std::move(decoded));
+		}
+		return true;
+	}
+
+	bool ConversionServer::run()
+	{
+		State& s = *state_;
+		if (s.wakeRead < 0)
+		{
+			return false;
+		}
+
+		std::vector<pollfd> fds;
+		std::vector<Connection*> polled;
+		std::vector<Connection*> answered;
+		while (!s.stopping)
+		{
+			// Connections a worker owns are left out until it has answered; poll skips a listener that is -1
+			fds.assign({ { s.wakeRead, POLLIN, 0 }, { s.listener, POLLIN, 0 }, { s.httpListener, POLLIN, 0 } });
+			polled.assign(3, nullptr);
+			for (const std::unique_ptr<Connection>& connection : s.connections)
+			{
+				if (!connection->busy)
+				{
+					fds.push_back({ connection->fd, POLLIN, 0 });
+					polled.push_back(connection.get());
+				}
+			}
+			if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR)
+			{
+				std::cerr << "Error: poll failed: " << std::strerror(errno) << std::endl;
+				break;
+			}
+
+			std::vector<Connection*> closing;
+			if (fds[0].revents != 0)
+			{
+				char drain[64];
+				while (read(s.wakeRead, drain, sizeof(drain)) > 0)
+				{
+				}
+				{
+					std::lock_guard<std::mutex> lock(s.mutex);
+					answered.swap(s.answered);
+				}
+				for (Connection* connection : answered)
+				{
+					connection->busy = false;
+					if (connection->broken)
+					{
+						closing.push_back(connection);
+					}
+				}
+				answered.clear();
+
+				for (size_t i = 0; i < s.httpWorkers.size();)
+				{
+					if (s.httpWorkers[i]->done)
+					{
+						s.httpWorkers[i]->thread.join();
+						s.httpWorkers.erase(s.httpWorkers.begin() + static_cast<std::ptrdiff_t>(i));
+					}
+					else
+					{
+						i++;
+					}
+				}
+			}
+
+			for (size_t i = 3; i < fds.size(); i++)
+			{
+				if (fds[i].revents != 0 && !s.receive(*polled[i]))
+				{
+					closing.push_back(polled[i]);
+				}
+			}
+			for (Connection* connection : closing)
+			{
+				s.buffers.release(std::move(connection->payload));
+				s.connections.erase(std::find_if(s.connections.begin(), s.connections.end(),
+					[connection](const std::unique_ptr<Connection>& c) { return c.get() == connection; }));
+			}
+
+			if (fds[1].revents != 0)
+			{
+				for (;;)
+				{
+					int fd = accept(s.listener, nullptr, nullptr);
+					if (fd < 0)
+					{
+						break; // EAGAIN, or a client that gave up while queued
+					}
+					if (s.connections.size() + s.httpWorkers.size() >= s.options.maxConnections || !setNonBlocking(fd))
+					{
+						::close(fd);
+						continue;
+					}
+					std::unique_ptr<Connection> connection(new Connection());
+					connection->fd = fd;
+					s.connections.push_back(std::move(connection));
+					std::lock_guard<std::mutex> lock(s.mutex);
+					s.stats.connections++;
+				}
+			}
+
+			if (fds[2].revents != 0)
+			{
+				for (;;)
+				{
+					int fd = accept(s.httpListener, nullptr, nullptr);
+					if (fd < 0)
+					{
+						break;
+					}
+					if (s.connections.size() + s.httpWorkers.size() >= s.options.maxConnections)
+					{
+						::close(fd);
+						continue;
+					}
+					// Accepted sockets may inherit O_NONBLOCK from the listener on some systems; HTTP connections block
+					fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+					std::unique_ptr<HttpWorker> worker(new HttpWorker());
+					worker->connection.reset(new HttpConnection(fd, s.options.maxRequestBytes, s.scheduler.get()));
+					HttpWorker* owner = worker.get();
+					worker->thread = std::thread([&s, owner]() { s.serveHttp(*owner); });
+					s.httpWorkers.push_back(std::move(worker));
+					std::lock_guard<std::mutex> lock(s.mutex);
+					s.stats.connections++;
+				}
+			}
+		}
+
+		// Answer what is being converted, then hang up on everyone; HTTP conversions are cancelled instead,
+		// since their input may never end
+		for (const std::unique_ptr<HttpWorker>& worker : s.httpWorkers)
+		{
+			worker->connection->shutdown();
+		}
+		for (const std::unique_ptr<HttpWorker>& worker : s.httpWorkers)
+		{
+			worker->thread.join();
+		}
+		s.httpWorkers.clear();
+		s.scheduler->wait(s.requests);
+		s.connections.clear();
+		return true;
+	}
+
+	void ConversionServer::stop()
+	{
+		state_->stopping = true;
+		if (state_->wakeWrite >= 0)
+		{
+			state_->wake();
+		}
+	}
+
+	ServerStats ConversionServer::stats() const
+	{
+		std::lock_guard<std::mutex> lock(state_->mutex);
+		return state_->stats;
+	}
+
+	ConversionClient::~ConversionClient()
+	{
+		close();
+	}
+
+	bool ConversionClient::connect(const std::string& socketPath)
+	{
+		close();
+		sockaddr_un address;
+		if (!socketAddress(socketPath, address))
+		{
+			return false;
+		}
+		socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (socket_ < 0 || ::connect(socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void ConversionClient::close()
+	{
+		if (socket_ >= 0)
+		{
+			::close(socket_);
+			socket_ = -1;
+		}
+	}
+
+	bool ConversionClient::exchange(const ServerRequest& request, uint16_t flags, const uint8_t* data, uint64_t size, const int* descriptors,
+		uint64_t& answerSize, ServerResponse& response)
+	{
+		if (socket_ < 0 || request.type.size() > 255)
+		{
+			return false;
+		}
+
+		uint8_t header[requestHeaderBytes];
+		uint8_t* p = header;
+		std::memcpy(p, requestMagic, 4);
+		p += 4;
+		*p++ = request.operation;
+		*p++ = static_cast<uint8_t>(request.type.size());
+		put16(p, flags);
+		put32(p, request.sampleRate);
+		put64(p, size);
+		iovec parts[3] = { { header, sizeof(header) }, { const_cast<char*>(request.type.data()), request.type.size() },
+			{ const_cast<uint8_t*>(data), data ? static_cast<size_t>(size) : 0 } };
+
+		uint8_t answer[responseHeaderBytes];
+		if (!sendAll(socket_, parts, data ? 3 : 2, descriptors, descriptors ? maxDescriptors : 0)
+			|| !receiveAll(socket_, answer, sizeof(answer)) || std::memcmp(answer, responseMagic, 4) != 0)
+		{
+			close();
+			return false;
+		}
+		response.error = static_cast<ConversionError>(get32(answer + 4));
+		response.frames = get64(answer + 8);
+		response.serverMicroseconds = get64(answer + 16);
+		answerSize = get64(answer + 24);
+		return true;
+	}
+
+	bool ConversionClient::convert(const ServerRequest& request, const uint8_t* data, size_t size, std::vector<uint8_t>& output, ServerResponse& response)
+	{
+		output.clear();
+		uint64_t answerSize = 0;
+		static const uint8_t empty = 0;
+		if (!exchange(request, 0, data ? data : &empty, size, nullptr, answerSize, response))
+		{
+			return false;
+		}
+		output.resize(static_cast<size_t>(answerSize));
+		if (!receiveAll(socket_, output.data(), output.size()))
+		{
+			output.clear();
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool ConversionClient::convertShared(const ServerRequest& request, int input, uint64_t size, int output, uint64_t& outputSize, ServerResponse& response)
+	{
+		const int descriptors[maxDescriptors] = { input, output };
+		outputSize = 0;
+		return exchange(request, ServerSharedMemory, nullptr, size, descriptors, outputSize, response);
+	}
+#else
+	// Windows has no daemon; the conversion core is used in-process there
+	struct ConversionServer::State
+	{
+	};
+
+	ConversionServer::ConversionServer(const ServerOptions&) : state_(new State())
+	{
+	}
+
+	ConversionServer::~ConversionServer() = default;
+
+	bool ConversionServer::start(const std::string&)
+	{
+		std::cerr << "Error: The conversion server needs Unix domain sockets" << std::endl;
+		return false;
+	}
+
+	bool ConversionServer::run()
+	{
+		return false;
+	}
+
+	void ConversionServer::stop()
+	{
+	}
+
+	ServerStats ConversionServer::stats() const
+	{
+		return ServerStats();
+	}
+
+	ConversionClient::~ConversionClient() = default;
+
+	bool ConversionClient::connect(const std::string&)
+	{
+		return false;
+	}
+
+	void ConversionClient::close()
+	{
+	}
+
+	bool ConversionClient::convert(const ServerRequest&, const uint8_t*, size_t, std::vector<uint8_t>& output, ServerResponse&)
+	{
+		output.clear();
+		return false;
+	}
+#endif
+}
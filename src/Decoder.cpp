@@ -1,128 +1,455 @@
 #include "SoundImageConverter/Converter.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/Packing.h"
+#include "SoundImageConverter/Checksum.h"
+#include "SoundImageConverter/WavFile.h"
+#include "SoundImageConverter/AudioFormat.h"
+#include "SoundImageConverter/SpscRing.h"
+#include "SoundImageConverter/TaskScheduler.h"
 #include <sndfile.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
 #include <cstdint>
 #include <iostream>
 
 namespace SoundImageConverter
 {
-	// Decodes a PNG image to a WAV file following specific metadata and pixel encoding rules
-	bool Decoder::decode(const std::string& pngPath, const std::string& wavPath)
+	namespace
 	{
-		// Load PNG image
-		int width, height, channels;
-		unsigned char* image = stbi_load(pngPath.c_str(), &width, &height, &channels, 0);
-		if (!image)
-		{
-			std::cerr << "Error: Could not open PNG file: " << pngPath << std::endl;
-			return false;
-		}
+		typedef std::chrono::steady_clock Clock;
 
-		// Extract metada from first row
-		if (width < 6)
+		double secondsSince(Clock::time_point start)
 		{
-			std::cerr << "Error: PNG width too small to contain metadata." << std::endl;
-			stbi_image_free(image);
-			return false;
+			return std::chrono::duration<double>(Clock::now() - start).count();
 		}
-		uint32_t sampleRate = (static_cast<uint32_t>(image[0]) << 24) |
-							  (static_cast<uint32_t>(image[1]) << 16) |
-							  (static_cast<uint32_t>(image[2]) << 8) |
-								static_cast<uint32_t>(image[3]);
-		int numChannels = static_cast<int>(image[4]);
-		int bitDepth = static_cast<int>(image[5]);
-		if (numChannels < 1 || numChannels  > 2 || (bitDepth != 8 && bitDepth != 16))
+
+		// Shared by decode and verify. With wavPath == nullptr the samples are only checksummed:
+		// nothing is written and the debug output is skipped. imageIn and wavStream replace the files when given.
+		// Returns false after setting result.error
+		bool decodeImage(const std::string& pngPath, InputStream* imageIn, const std::string* wavPath, OutputStream* wavStream, const DecodeOptions& options, ConversionResult& result)
 		{
-			std::cerr << "Error: Invalid metadata (channels: " << numChannels << ", bit depth: " << bitDepth << ")." << std::endl;
-			stbi_image_free(image);
-			return false;
-		}
+			std::ostream silent(nullptr);
+			std::ostream& log = options.log ? *options.log : silent;
+
+			// Pick the image backend from the input extension
+			const ImageCodec* codec = ImageCodecRegistry::instance().findForPath(pngPath);
+			if (!codec)
+			{
+				std::cerr << "Error: Unsupported image format: " << pngPath << std::endl;
+				result.error = ConversionUnsupported;
+				return false;
+			}
 
-		// Calculate expected samples
-		int channelsPerPixel = (bitDepth == 8) ? (numChannels == 1 ? 1 : 3) : 4;
-		size_t totalPixels = static_cast<size_t>(width) * (height - 1); // Exclude metadata row
-		size_t expectedSamples = totalPixels; // One pixel == one sample
+			// Open the image; mapped inputs let streaming backends read pixels in place
+			std::unique_ptr<InputStream> file = imageIn ? nullptr : openInputFile(pngPath);
+			InputStream* opened = imageIn ? imageIn : file.get();
+			if (!opened)
+			{
+				std::cerr << "Error: Could not open image file: " << pngPath << std::endl;
+				result.error = ConversionOpenInputFailed;
+				return false;
+			}
+			CountingInputStream in(*opened);
+			std::unique_ptr<ImageSource> ownSource = options.context ? nullptr : codec->createSource();
+			ImageSource& source = options.context ? options.context->source(*codec) : *ownSource;
+			// A source kept in the context lets go of the image however the decode ends
+			struct SourceCloser
+			{
+				ImageSource& source;
+				~SourceCloser() { source.close(); }
+			} closer{ source };
+			ImageInfo info;
+			MemoryAccount* account = MemoryAccount::current(); // For the writer thread
+			MemoryScope decompressing(MemoryStageCodec); // Opening and reading the image; the other stages say so
+			Clock::time_point opening = Clock::now();
+			bool sourceOpened = source.open(in, info);
+			result.readSeconds += secondsSince(opening);
+			if (account)
+			{
+				account->sampleResident(); // PNG is decompressed whole by now
+			}
+			if (!sourceOpened)
+			{
+				std::cerr << "Error: Could not open image file: " << pngPath << std::endl;
+				result.error = ConversionOpenInputFailed;
+				return false;
+			}
 
-		// Debug: Print metadata
-		std::cout << "PNG Metadata: " << sampleRate << " Hz, " << numChannels << " channels, "
-			<< bitDepth << "-bit" << std::endl;
+			// Extract metada from first row
+			const uint8_t* metadataRow = source.readRows(1);
+			Packing::Metadata metadata;
+			if (!metadataRow || !Packing::readMetadata(metadataRow, info.rowBytes(), metadata))
+			{
+				std::cerr << "Error: Invalid or missing metadata row in: " << pngPath << std::endl;
+				result.error = ConversionInvalidInput;
+				return false;
+			}
+			int numChannels = metadata.channels;
+			int bitDepth = metadata.bitDepth;
+			bool hasChecksum = metadata.hasChecksum();
+			if (!wavPath && !hasChecksum)
+			{
+				std::cerr << "Error: No checksum stored in: " << pngPath << std::endl;
+				result.error = ConversionInvalidInput;
+				return false;
+			}
 
-		// Helper function to reverse sampleToPixel scaling
-		auto pixelToSample = [](uint8_t pixel) -> int16_t
-		{
-				return static_cast<int16_t>(pixel) * 256 - 32768; // Reverse the scaling applied in Encoder
-		};
+			// Calculate expected samples
+			int channelsPerPixel = Packing::channelsPerPixel(bitDepth, numChannels);
+			size_t layoutWidth = info.rowBytes() / channelsPerPixel; // QOI packs 8-bit mono rows as RGBA
+			int dataEnd = info.height - (hasChecksum ? 1 : 0); // Exclude the trailer row
+			uint64_t totalPixels = static_cast<uint64_t>(layoutWidth) * std::max(dataEnd - 1, 0); // Exclude metadata row, one pixel == one frame
+			if (metadata.version >= 1)
+			{
+				if (metadata.frames > totalPixels)
+				{
+					std::cerr << "Error: Image is too small for " << metadata.frames << " frames: " << pngPath << std::endl;
+					result.error = ConversionInvalidInput;
+					return false;
+				}
+				totalPixels = metadata.frames; // Drop the padding of the last row
+			}
 
-		// Decode pixels to samples
-		std::vector<int16_t> samples;
-		size_t pixelIndex = width * channelsPerPixel; // Start after metadata row
-		for (size_t i = 0; i < expectedSamples && pixelIndex < static_cast<size_t>(width * height * channelsPerPixel); i++)
-		{
-			if (channelsPerPixel == 1) // 8-bit mono (grayscale)
+			// 8/16-bit PCM WAV goes through the built-in writer: the frame count is known up front,
+			// so its header is written once and never patched. Other formats are written by libsndfile.
+			FileOutputStream wavOut;
+			CountingOutputStream countedOut(wavStream ? *wavStream : wavOut);
+			WavWriter wavWriter;
+			SNDFILE* audioFile = nullptr;
+			if (wavPath)
+			{
+				int format = AudioFormat::outputFormat(*wavPath, static_cast<int>(metadata.sourceFormat), bitDepth, numChannels, static_cast<int>(metadata.sampleRate));
+				if (options.output != AudioOutputByName)
+				{
+					format = (options.output == AudioOutputWav ? SF_FORMAT_WAV : SF_FORMAT_RAW) | (bitDepth == 8 ? SF_FORMAT_PCM_U8 : SF_FORMAT_PCM_16);
+				}
+				bool raw = (format & SF_FORMAT_TYPEMASK) == SF_FORMAT_RAW && (format & SF_FORMAT_SUBMASK) != SF_FORMAT_PCM_S8;
+
+				// Debug: Print metadata (the format description is only built when someone reads it)
+				if (options.log)
+				{
+					log << "Image Metadata: " << metadata.sampleRate << " Hz, " << numChannels << " channels, "
+						<< bitDepth << "-bit (" << codec->name() << "), writing " << AudioFormat::describe(format) << std::endl;
+				}
+				if (metadata.originalSampleRate != 0 && metadata.originalSampleRate != metadata.sampleRate)
+				{
+					log << "Stored at " << metadata.sampleRate << " Hz, resampled from " << metadata.originalSampleRate << " Hz" << std::endl;
+				}
+
+				// Open audio file
+				MemoryScope writing(MemoryStageWrite);
+				bool outputOpened;
+				if (AudioFormat::isBuiltinWav(format) || raw)
+				{
+					WavFormat wavFormat;
+					wavFormat.sampleRate = metadata.sampleRate;
+					wavFormat.channels = numChannels;
+					wavFormat.bitsPerSample = (format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_16 ? 16 : 8;
+					wavFormat.frames = totalPixels;
+					outputOpened = (wavStream || wavOut.open(*wavPath)) && (raw ? wavWriter.beginRaw(countedOut, wavFormat) : wavWriter.begin(countedOut, wavFormat));
+				}
+				else
+				{
+					SF_INFO sfInfo = {};
+					sfInfo.samplerate = static_cast<int>(metadata.sampleRate);
+					sfInfo.channels = numChannels;
+					sfInfo.format = format;
+					audioFile = sf_open(wavPath->c_str(), SFM_WRITE, &sfInfo);
+					outputOpened = audioFile != nullptr;
+				}
+				if (!outputOpened)
+				{
+					std::cerr << "Error: Could not open audio file for writing: " << *wavPath << std::endl;
+					result.error = ConversionOpenOutputFailed;
+					return false;
+				}
+			}
+
+			// Decode pixels to samples a block of rows at a time. When writing with options.pipeline, a second thread
+			// writes finished blocks while this one unpacks the next, so CPU and disk overlap; blocks cycle through
+			// two rings, so memory stays fixed at blockCount blocks. Without it one block is written in place. The checksum is updated on the samples as they are
+			// unpacked, so verifying costs no extra pass. With a scheduler, long images use larger blocks whose
+			// slices are unpacked and checksummed as subtasks, and the slice checksums are combined in order.
+			// A backend that holds the whole image may let rows be overwritten (ImageCapInPlaceRead); when a pixel has at
+			// least as many bytes as its samples (16-bit layouts), those are then unpacked front to back over the rows
+			// they come from and written from there, and no block buffers are allocated.
+			const int sliceRows = 64;
+			const int slicesPerBlock = 8;
+			const bool scheduled = options.scheduler && wavPath && dataEnd - 1 > 32 * sliceRows;
+			const int rowsPerBlock = scheduled ? slicesPerBlock * sliceRows : sliceRows;
+			const size_t blockCount = 4;
+			const size_t endOfStream = blockCount;
+			const bool threaded = wavPath && options.pipeline;
+			const size_t sampleBytes = static_cast<size_t>(numChannels) * sizeof(int16_t);
+			const bool inPlace = codec->supports(ImageCapInPlaceRead) && source.readsInPlace() && sampleBytes <= static_cast<size_t>(channelsPerPixel)
+				&& (!scheduled || sampleBytes == static_cast<size_t>(channelsPerPixel)); // Slices of smaller samples would overlap others' pixels
+			ContextBuffer<int16_t> blocks[blockCount];
+			int16_t* blockSamples[blockCount] = {};
+			size_t blockFrames[blockCount] = {};
+			for (size_t i = 0; i < (inPlace ? 0 : threaded ? blockCount : 1); i++)
 			{
-				samples.push_back(pixelToSample(image[pixelIndex++]));
+				MemoryScope packing(MemoryStagePack);
+				blocks[i].context = options.context;
+				fitBuffer(blocks[i].data, rowsPerBlock * layoutWidth * numChannels, options.context);
 			}
-			else if (channelsPerPixel == 3) // 8-bit stereo RGB
+			SpscRing<size_t, blockCount> freeBlocks;
+			SpscRing<size_t, blockCount> filledBlocks;
+			std::atomic<bool> writeFailed(false);
+			double writeSeconds = 0; // Written by the writer thread, read after it is joined
+			auto writeBlock = [&](size_t i)
+			{
+				if (!writeFailed)
+				{
+					MemoryScope writing(MemoryStageWrite);
+					Clock::time_point start = Clock::now();
+					sf_count_t frames = static_cast<sf_count_t>(blockFrames[i]);
+					bool written = audioFile ? sf_writef_short(audioFile, blockSamples[i], frames) == frames
+											 : wavWriter.writeFrames(blockSamples[i], blockFrames[i]);
+					writeFailed = !written;
+					writeSeconds += secondsSince(start);
+				}
+			};
+			std::thread writer;
+			if (threaded)
 			{
-				samples.push_back(pixelToSample(image[pixelIndex++]));     // Left channel (Red)
-				samples.push_back(pixelToSample(image[pixelIndex++])); // Right channel (Green)
-				pixelIndex++; // Skip Blue channel (constant value in Encoder)
+				for (size_t i = 0; i < blockCount; i++)
+				{
+					freeBlocks.push(i);
+				}
+				writer = std::thread([&]()
+				{
+					MemoryScope counting(account, MemoryStageWrite);
+					for (size_t i = filledBlocks.pop(); i != endOfStream; i = filledBlocks.pop())
+					{
+						// After a failure keep recycling blocks so the decoding side never waits forever
+						writeBlock(i);
+						freeBlocks.push(i);
+					}
+				});
 			}
-			else // 16-bit mono/stereo RGBA
+
+			uint64_t pixelsLeft = totalPixels;
+			uint64_t samplesWritten = 0;
+			uint32_t checksum = 0;
+			bool ok = true;
+			bool cancelled = false;
+			for (int row = 1; row < dataEnd && ok && !writeFailed; row += rowsPerBlock)
 			{
-				int16_t left = pixelToSample(image[pixelIndex++]); // Red channel
-				pixelIndex++; // Skip Green channel (half of Red in Encoder)
-				if (numChannels == 2)
+				if (options.cancel && options.cancel->cancelled())
+				{
+					cancelled = true;
+					ok = false;
+					break;
+				}
+				int rows = std::min(rowsPerBlock, dataEnd - row);
+				if (account && (row - 1) / rowsPerBlock % 16 == 0)
+				{
+					account->sampleResident();
+				}
+				Clock::time_point start = Clock::now();
+				uint8_t* writableRows = inPlace ? source.readRowsInPlace(rows) : nullptr;
+				const uint8_t* pixels = inPlace ? writableRows : source.readRows(rows);
+				result.readSeconds += secondsSince(start);
+				if (!pixels)
+				{
+					std::cerr << "Error: Failed to read image rows from: " << pngPath << std::endl;
+					result.error = ConversionReadFailed;
+					ok = false;
+					break;
+				}
+				start = Clock::now();
+				size_t block = threaded ? freeBlocks.pop() : 0;
+				int16_t* samples = inPlace ? reinterpret_cast<int16_t*>(writableRows) : blocks[block].data.data();
+				blockSamples[block] = samples;
+				size_t pixelCount = static_cast<size_t>(std::min<uint64_t>(rows * layoutWidth, pixelsLeft));
+				size_t count = 0;
+				if (!scheduled)
 				{
-					samples.push_back(left);
-					int16_t right = pixelToSample(image[pixelIndex++]); // Blue channel
-					samples.push_back(right);
-					pixelIndex++; // Skip Alpha channel
+					count = Packing::unpackPixels(pixels, pixelCount, channelsPerPixel, numChannels, samples);
+					if (hasChecksum)
+					{
+						checksum = Checksum::crc32c(checksum, samples, count * sizeof(int16_t));
+					}
 				}
 				else
 				{
-					samples.push_back(left);
-					pixelIndex += 2; // Skip Alpha and Blue channels
+					const size_t slicePixels = sliceRows * layoutWidth;
+					const size_t sliceCount = (pixelCount + slicePixels - 1) / slicePixels;
+					uint32_t sliceChecksums[slicesPerBlock] = {};
+					size_t sliceSamples[slicesPerBlock] = {};
+					TaskScheduler::TaskGroup slices;
+					for (size_t s = 0; s < sliceCount; s++)
+					{
+						options.scheduler->spawn(slices, [&, s]()
+						{
+							size_t first = s * slicePixels;
+							int16_t* out = samples + first * numChannels;
+							sliceSamples[s] = Packing::unpackPixels(pixels + first * channelsPerPixel, std::min(slicePixels, pixelCount - first), channelsPerPixel, numChannels, out);
+							sliceChecksums[s] = hasChecksum ? Checksum::crc32c(0, out, sliceSamples[s] * sizeof(int16_t)) : 0;
+						});
+					}
+					options.scheduler->wait(slices);
+					for (size_t s = 0; s < sliceCount; s++)
+					{
+						count += sliceSamples[s];
+						checksum = Checksum::combine(checksum, sliceChecksums[s], sliceSamples[s] * sizeof(int16_t));
+					}
+				}
+				pixelsLeft -= pixelCount;
+				result.packSeconds += secondsSince(start);
+
+				if (wavPath)
+				{
+					blockFrames[block] = pixelCount;
+					if (threaded)
+					{
+						filledBlocks.push(block);
+					}
+					else
+					{
+						writeBlock(block);
+					}
+				}
+				samplesWritten += count;
+				if (options.progress)
+				{
+					options.progress(totalPixels - pixelsLeft, totalPixels);
 				}
 			}
-		}
 
-		stbi_image_free(image);
+			if (threaded)
+			{
+				filledBlocks.push(endOfStream);
+				writer.join();
+			}
+			if (wavPath)
+			{
+				if (writeFailed)
+				{
+					std::cerr << "Error: Failed to write all samples to audio file" << std::endl;
+					result.error = ConversionWriteFailed;
+					ok = false;
+				}
+			}
 
-		// Debug: Print first few samples
-		std::cout << "First 10 decoded samples: ";
-		for (size_t i = 0; i < std::min<size_t>(10, samples.size()); i++)
-		{
-			std::cout << samples[i] << " ";
+			// Before the output is finished, so audio that fails it is removed like any other failed output
+			if (ok && hasChecksum)
+			{
+				const uint8_t* trailer = source.readRows(1);
+				uint32_t expected = trailer ? Packing::readTrailer(trailer) : 0;
+				if (!trailer)
+				{
+					std::cerr << "Error: Missing checksum row in: " << pngPath << std::endl;
+					result.error = ConversionChecksumMismatch;
+					ok = false;
+				}
+				else if (checksum != expected)
+				{
+					std::cerr << "Error: Checksum mismatch in " << pngPath << " (stored " << Checksum::toHex(expected)
+						<< ", decoded " << Checksum::toHex(checksum) << ")" << std::endl;
+					result.error = ConversionChecksumMismatch;
+					ok = false;
+				}
+			}
+
+			Clock::time_point closing = Clock::now();
+			if (audioFile)
+			{
+				sf_close(audioFile);
+			}
+			else if (wavPath && ok && !(wavWriter.finish() && (wavStream || wavOut.close())))
+			{
+				std::cerr << "Error: Failed to write all samples to WAV file" << std::endl;
+				result.error = ConversionWriteFailed;
+				ok = false;
+			}
+			result.writeSeconds = writeSeconds + secondsSince(closing);
+
+			result.frames = totalPixels - pixelsLeft;
+			result.bytesIn = opened->view() ? opened->viewSize() : in.count();
+			std::error_code ec;
+			result.bytesOut = audioFile ? std::filesystem::file_size(*wavPath, ec) : countedOut.count();
+			result.bytesOut = ec ? 0 : result.bytesOut;
+			for (const ContextBuffer<int16_t>& block : blocks)
+			{
+				result.peakBufferBytes += block.data.capacity() * sizeof(int16_t);
+			}
+			if (!ok)
+			{
+				// Leave no partial file behind; a stream given by the caller is the caller's to clean up
+				if (wavPath && (audioFile || !wavStream))
+				{
+					wavOut.close();
+					removePartialOutput(*wavPath);
+				}
+				if (cancelled)
+				{
+					log << "Cancelled decoding " << pngPath << std::endl;
+					result.error = ConversionCancelled;
+				}
+				return false;
+			}
+
+			if (wavPath)
+			{
+				log << "Decoded " << samplesWritten << " samples from " << pngPath << " to " << *wavPath
+					<< (hasChecksum ? " (checksum OK)" : " (no checksum)") << std::endl;
+			}
+			return true;
 		}
-		std::cout << std::endl;
-
-		// Write WAV file
-		SF_INFO sfInfo;
-		sfInfo.frames = samples.size() / numChannels;
-		sfInfo.samplerate = sampleRate;
-		sfInfo.channels = numChannels;
-		sfInfo.format = (bitDepth == 16 ? SF_FORMAT_WAV | SF_FORMAT_PCM_16 : SF_FORMAT_WAV | SF_FORMAT_PCM_U8);
-		SNDFILE* audioFile = sf_open(wavPath.c_str(), SFM_WRITE, &sfInfo);
-		if (!audioFile)
+
+		ConversionResult timedDecode(const std::string& pngPath, InputStream* imageIn, const std::string* wavPath, OutputStream* wavStream, const DecodeOptions& options)
 		{
-			std::cerr << "Error: Could not open WAV file for writing: " << wavPath << std::endl;
-			return false;
+			ConversionResult result;
+			Clock::time_point start = Clock::now();
+			MemoryAccount ownAccount; // Without a context everything it counts is freed before decodeImage returns
+			ConversionContext::Scope scope(options.context);
+			MemoryAccount& account = ConversionContext::current() ? ConversionContext::current()->memory() : ownAccount;
+			account.sampleResident();
+			account.resetPeaks();
+			MemoryScope memory(&account, MemoryStagePack);
+			decodeImage(pngPath, imageIn, wavPath, wavStream, options, result);
+			account.sampleResident();
+			result.memory = account.usage();
+			result.seconds = secondsSince(start);
+			return result;
 		}
+	}
 
-		sf_count_t writeCount = sf_write_short(audioFile, samples.data(), samples.size());
-		sf_close(audioFile);
+	// Decodes an image to a WAV file following specific metadata and pixel encoding rules
+	bool Decoder::decode(const std::string& pngPath, const std::string& wavPath)
+	{
+		return timedDecode(pngPath, nullptr, &wavPath, nullptr, DecodeOptions()).ok();
+	}
 
-		if (writeCount != static_cast<sf_count_t>(samples.size()))
-		{
-			std::cerr << "Error: Failed to write all samples to WAV file" << std::endl;
-			return false;
-		}
+	ConversionResult Decoder::decode(const std::string& pngPath, const std::string& wavPath, const DecodeOptions& options)
+	{
+		return timedDecode(pngPath, nullptr, &wavPath, nullptr, options);
+	}
 
-		std::cout << "Decoded " << pngPath << " to " << wavPath << std::endl;
-		return true;
+	bool Decoder::decode(InputStream& image, const std::string& pngPath, OutputStream& wav, const std::string& wavPath)
+	{
+		return timedDecode(pngPath, &image, &wavPath, &wav, DecodeOptions()).ok();
+	}
+
+	ConversionResult Decoder::decode(InputStream& image, const std::string& pngPath, OutputStream& wav, const std::string& wavPath, const DecodeOptions& options)
+	{
+		return timedDecode(pngPath, &image, &wavPath, &wav, options);
+	}
+
+	ConversionResult Decoder::decode(InputStream& image, const std::string& pngPath, const std::string& wavPath, const DecodeOptions& options)
+	{
+		return timedDecode(pngPath, &image, &wavPath, nullptr, options);
+	}
+
+	bool Decoder::verify(const std::string& pngPath)
+	{
+		return timedDecode(pngPath, nullptr, nullptr, nullptr, DecodeOptions()).ok();
 	}
 
 } // namespace SoundImageConverter
@@ -1,147 +1,926 @@
 #include "SoundImageConverter/Converter.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/Packing.h"
+#include "SoundImageConverter/Checksum.h"
+#include "SoundImageConverter/WavFile.h"
+#include "SoundImageConverter/AudioFormat.h"
+#include "SoundImageConverter/Resampler.h"
+#include "SoundImageConverter/SpscRing.h"
+#include "SoundImageConverter/TaskScheduler.h"
 #include <sndfile.h>
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
 #include <cstdint>
-#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <optional>
+#include <thread>
 
 namespace SoundImageConverter
 {
-	bool Encoder::encode(const std::string& wavPath, const std::string& pngPath)
+	namespace
 	{
-		// Open WAV file
-		SF_INFO sfInfo;
-		sfInfo.format = 0;
-		SNDFILE* audioFile = sf_open(wavPath.c_str(), SFM_READ, &sfInfo);
-		if (!audioFile)
+		void readAll(InputStream& in, AlignedVector<uint8_t>& data)
 		{
-			std::cerr << "Error: Could not open WAV file: " << wavPath << std::endl;
-			return false;
+			const size_t chunk = 1 << 20;
+			for (size_t got = chunk; got > 0;)
+			{
+				size_t size = data.size();
+				data.resize(size + chunk);
+				got = in.read(data.data() + size, chunk);
+				data.resize(size + got);
+			}
 		}
 
-		// Determine bit depth and channels
-		int channels = sfInfo.channels; // 1 = mono, 2 = stereo
-		int sampleRate = sfInfo.samplerate; // Sample rate in Hz
-		int bitDepth = (sfInfo.format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_16 ? 16 : 8;
-		sf_count_t numFrames = sfInfo.frames; // Total number of frames (samples per channel)
+		// Passes reads through, keeping a copy while recording
+		class RecordingInputStream : public InputStream
+		{
+		public:
+			RecordingInputStream(InputStream& in, bool recording) : in_(in), recording_(recording) {}
+
+			size_t read(void* data, size_t size) override
+			{
+				size_t got = in_.read(data, size);
+				if (recording_)
+				{
+					const uint8_t* bytes = static_cast<const uint8_t*>(data);
+					recorded_.insert(recorded_.end(), bytes, bytes + got);
+				}
+				return got;
+			}
+			const uint8_t* view() const override { return in_.view(); }
+			size_t viewSize() const override { return in_.viewSize(); }
+
+			void stopRecording()
+			{
+				recording_ = false;
+				AlignedVector<uint8_t>().swap(recorded_);
+			}
+			AlignedVector<uint8_t>& recorded() { return recorded_; }
 
-		// Calculate image dimensions
-		const int width = 512; // Width of the image
-		int channelsPerPixel = (bitDepth == 8) ? (channels == 1 ? 1 : 3) : 4;  // Grayscale for 8-bit mono, RGB for 8-bit stereo, RGBA for 16-bit
-		int samplesNeeded = static_cast<int>(numFrames);
-		int height = static_cast<int>(std::ceil(static_cast<double>(samplesNeeded) / width)) + 1; // +1 so that we have enough space for the metadata row
+		private:
+			InputStream& in_;
+			bool recording_;
+			AlignedVector<uint8_t> recorded_;
+		};
 
-		std::cout << "Image dimensions: " << width << "x" << height << " with " << channelsPerPixel << " channels per pixel." << std::endl;
+		// Rows on their way through the encoder stages
+		struct RowBlock
+		{
+			~RowBlock()
+			{
+				if (context)
+				{
+					context->give(std::move(copy));
+					context->give(std::move(pixels));
+					context->give(std::move(decoded));
+				}
+			}
 
+			ConversionContext* context = nullptr; // Where the buffers came from and go back to
+			int row = 0; // First image row
+			size_t rows = 0;
+			size_t frames = 0;
+			const int16_t* samples = nullptr; // Into the mapping, or into copy
+			AlignedVector<int16_t> copy;
+			AlignedVector<uint8_t> pixels;
 
-		// Read audio samples
-		std::vector<int16_t> samples(numFrames * channels);
-		sf_count_t readCount = sf_read_short(audioFile, samples.data(), numFrames * channels);
-		sf_close(audioFile);
+			// Packed as a subtask: scratch for the checksum, and the block's own CRC32C and packing time
+			AlignedVector<int16_t> decoded;
+			uint32_t checksum = 0;
+			double packSeconds = 0;
+		};
 
-		if (readCount != numFrames * channels)
+		// Time a stage spent working and waiting for its neighbours
+		struct StageTime
 		{
-			std::cerr << "Error: Failed to read all samples from WAV file. Expected: " << numFrames * channels << ", Read: " << readCount << std::endl;
-			return false;
-		}
+			double busy = 0;
+			double idle = 0;
+		};
 
-		// Debug: Check first few samples
-		std::cout << "First 10 samples: ";
-		for (int i = 0; i < std::min(10, static_cast<int>(readCount)); i++)
+		// Seconds since mark, and moves mark to now
+		double lap(std::chrono::steady_clock::time_point& mark)
 		{
-			std::cout << samples[i] << " ";
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			double seconds = std::chrono::duration<double>(now - mark).count();
+			mark = now;
+			return seconds;
 		}
-		std::cout << std::endl;
-
-		// Preapare image buffer
-		// Creating the image buffer as big as the image dimensions plus taking into account the amount of bytes per pixel (channelsPerPixel)
-		std::vector<uint8_t> image(width * height * channelsPerPixel, 0);
-
-		// Embed metada in first row
-		uint32_t sampleRate32 = static_cast<uint32_t>(sampleRate);
-		image[0] = (sampleRate32 >> 24) & 0xFF; // Sample rate: byte 1
-		image[1] = (sampleRate32 >> 16) & 0xFF; // Sample rate: byte 2
-		image[2] = (sampleRate32 >> 8) & 0xFF;  // Sample rate: byte 3
-		image[3] = sampleRate32 & 0xFF;         // Sample rate: byte 4
-		image[4] = static_cast<uint8_t>(channels); // Channels
-		image[5] = static_cast<uint8_t>(bitDepth); // Bit depth
-
-		// Helper function to convert 16-bit s ample to 8-bit pixel value
-		auto sampleToPixel = [](int16_t sample) -> uint8_t
+
+		// Interleaved 16-bit frames for the encoder, from the mapped WAV, the built-in reader or libsndfile,
+		// optionally through the resampler. Hands out exactly frames() frames, a block at a time.
+		class AudioInput
 		{
-			return static_cast<uint8_t>((sample + 32768) / 256);
+		public:
+			explicit AudioInput(ConversionContext* context) : context_(context) {}
+
+			~AudioInput()
+			{
+				if (audioFile_)
+				{
+					sf_close(audioFile_);
+				}
+				if (context_)
+				{
+					context_->give(std::move(buffer_));
+				}
+			}
+
+			// Plain 8/16-bit PCM WAV and headerless PCM are parsed directly, everything libsndfile reads
+			// (FLAC, Ogg, MP3, 24-bit, float, ...) is decoded by it a block at a time.
+			// stream, if given, is read instead of the file at path (which then only names the input)
+			bool open(const std::string& path, InputStream* stream, const EncodeOptions& options)
+			{
+				path_ = path;
+				bool callerStream = stream != nullptr;
+				if (!stream)
+				{
+					wavIn_ = openInputFile(path);
+					stream = wavIn_.get();
+				}
+				if (!stream)
+				{
+					std::cerr << "Error: Could not open WAV file: " << path << std::endl;
+					return false;
+				}
+				viewBytes_ = stream->viewSize();
+				stream = &counter_.emplace(*stream);
+
+				if (options.rawSampleRate != 0)
+				{
+					format_.sampleRate = options.rawSampleRate;
+					format_.channels = options.rawChannels;
+					format_.bitsPerSample = options.rawBitDepth;
+					if (!wavReader_.openRaw(*stream, format_))
+					{
+						std::cerr << "Error: Raw input must be 8 or 16-bit with at least one channel." << std::endl;
+						return false;
+					}
+					sourceFormat_ = SF_FORMAT_RAW | (format_.bitsPerSample == 16 ? SF_FORMAT_PCM_16 : SF_FORMAT_PCM_U8);
+				}
+				else
+				{
+					// A pipe cannot rewind: keep what the WAV parser reads in case libsndfile has to start over
+					recorder_.emplace(*stream, !stream->view());
+					if (wavReader_.open(*recorder_, format_))
+					{
+						recorder_->stopRecording();
+						sourceFormat_ = SF_FORMAT_WAV | (format_.bitsPerSample == 16 ? SF_FORMAT_PCM_16 : SF_FORMAT_PCM_U8);
+					}
+					else if (!openSndfile(callerStream, *stream))
+					{
+						return false;
+					}
+				}
+
+				if (!audioFile_ && format_.frames == WavFormat::unknownFrames)
+				{
+					// Streamed raw PCM or WAV: the image height depends on the length, so read the rest into memory first
+					readRemaining(*stream);
+				}
+				mapped_ = audioFile_ ? nullptr : wavReader_.mappedSamples(); // 16-bit PCM is packed straight from the mapping
+				outputRate_ = format_.sampleRate;
+				outputFrames_ = format_.frames;
+				return true;
+			}
+
+			// Converts to rate on the fly; returns false if the ratio is not supported
+			bool resampleTo(uint32_t rate)
+			{
+				if (rate == format_.sampleRate)
+				{
+					return true;
+				}
+				if (!resampler_.init(format_.sampleRate, rate, format_.channels))
+				{
+					std::cerr << "Error: Cannot resample from " << format_.sampleRate << " Hz to " << rate << " Hz." << std::endl;
+					return false;
+				}
+				resampling_ = true;
+				outputRate_ = rate;
+				outputFrames_ = Resampler::outputFrames(format_.frames, format_.sampleRate, rate);
+				return true;
+			}
+
+			const WavFormat& format() const { return format_; } // As stored in the input file
+			int sourceFormat() const { return sourceFormat_; }
+			uint32_t sampleRate() const { return outputRate_; }
+			uint64_t frames() const { return outputFrames_; }
+
+			// Size of the input: the mapping or memory it was in, or what was read from the stream
+			uint64_t inputBytes() const { return viewBytes_ != 0 ? viewBytes_ : counter_->count(); }
+
+			// Memory held in read, resampling and whole-input buffers
+			size_t bufferBytes() const
+			{
+				return (buffer_.capacity() + resampled_.capacity()) * sizeof(int16_t) + buffered_.capacity();
+			}
+
+			// True if read() returns pointers into the mapping, which stay valid after the next call
+			bool readsInPlace() const { return mapped_ && !resampling_; }
+
+			// Returns the next frames frames, nullptr on a read error. Valid until the next call.
+			const int16_t* read(size_t frames)
+			{
+				const size_t channels = static_cast<size_t>(format_.channels);
+				if (!resampling_)
+				{
+					if (mapped_)
+					{
+						const int16_t* block = mapped_ + sourcePosition_ * channels;
+						sourcePosition_ += frames;
+						return block;
+					}
+					fitBuffer(buffer_, frames * channels, context_);
+					return readSource(buffer_.data(), frames) ? buffer_.data() : nullptr;
+				}
+
+				// Feed the resampler until it has a block ready
+				resampled_.erase(resampled_.begin(), resampled_.begin() + resampledPosition_);
+				resampledPosition_ = 0;
+				const size_t chunkFrames = 16384;
+				while (resampled_.size() < frames * channels && sourcePosition_ < format_.frames)
+				{
+					size_t chunk = static_cast<size_t>(std::min<uint64_t>(chunkFrames, format_.frames - sourcePosition_));
+					const int16_t* input = mapped_ ? mapped_ + sourcePosition_ * channels : nullptr;
+					if (!input)
+					{
+						fitBuffer(buffer_, chunk * channels, context_);
+						if (!readSource(buffer_.data(), chunk))
+						{
+							return nullptr;
+						}
+						input = buffer_.data();
+					}
+					else
+					{
+						sourcePosition_ += chunk;
+					}
+					resampler_.process(input, chunk, resampled_);
+					if (sourcePosition_ == format_.frames)
+					{
+						resampler_.flush(resampled_);
+					}
+				}
+				if (resampled_.size() < frames * channels)
+				{
+					std::cerr << "Error: Resampler produced fewer frames than expected." << std::endl;
+					return nullptr;
+				}
+				resampledPosition_ = frames * channels;
+				return resampled_.data();
+			}
+
+		private:
+			bool openSndfile(bool callerStream, InputStream& stream)
+			{
+				SF_INFO sfInfo;
+				sfInfo.format = 0;
+				if (stream.view() && !callerStream)
+				{
+					// wavIn_ stays open: counter_ and recorder_ still refer to it
+					audioFile_ = sf_open(path_.c_str(), SFM_READ, &sfInfo);
+				}
+				else
+				{
+					// Already in memory (batch mode), or a pipe read to its end: libsndfile reads the bytes in place
+					memoryFile_.data = stream.view();
+					memoryFile_.size = static_cast<sf_count_t>(stream.viewSize());
+					if (!memoryFile_.data)
+					{
+						buffered_.swap(recorder_->recorded());
+						readAll(stream, buffered_);
+						memoryFile_.data = buffered_.data();
+						memoryFile_.size = static_cast<sf_count_t>(buffered_.size());
+					}
+					audioFile_ = memoryFile_.size > 0 ? sf_open_virtual(&memoryIo, SFM_READ, &sfInfo, &memoryFile_) : nullptr;
+				}
+				if (!audioFile_)
+				{
+					std::cerr << "Error: Could not open WAV file: " << path_ << std::endl;
+					return false;
+				}
+				if (sfInfo.frames < 0 || sfInfo.frames == SF_COUNT_MAX)
+				{
+					std::cerr << "Error: Length of the audio file is unknown: " << path_ << std::endl;
+					return false;
+				}
+				sourceFormat_ = sfInfo.format;
+				format_.sampleRate = static_cast<uint32_t>(sfInfo.samplerate);
+				format_.channels = sfInfo.channels;
+				format_.bitsPerSample = AudioFormat::storedBitDepth(sfInfo.format);
+				format_.frames = static_cast<uint64_t>(sfInfo.frames);
+				return true;
+			}
+
+			// Reads the rest of stream into memory and continues from there as headerless samples
+			void readRemaining(InputStream& stream)
+			{
+				readAll(stream, buffered_);
+				buffered_.resize(buffered_.size() - buffered_.size() % format_.blockAlign());
+				bufferedIn_.emplace(buffered_.data(), buffered_.size());
+				wavReader_.openRaw(*bufferedIn_, format_);
+			}
+
+			// libsndfile virtual I/O over a buffer
+			struct MemoryFile
+			{
+				const uint8_t* data = nullptr;
+				sf_count_t size = 0;
+				sf_count_t position = 0;
+			};
+
+			static sf_count_t memoryLength(void* user)
+			{
+				return static_cast<MemoryFile*>(user)->size;
+			}
+
+			static sf_count_t memorySeek(sf_count_t offset, int whence, void* user)
+			{
+				MemoryFile* file = static_cast<MemoryFile*>(user);
+				sf_count_t base = whence == SEEK_CUR ? file->position : whence == SEEK_END ? file->size : 0;
+				file->position = std::max<sf_count_t>(0, std::min(file->size, base + offset));
+				return file->position;
+			}
+
+			static sf_count_t memoryRead(void* data, sf_count_t count, void* user)
+			{
+				MemoryFile* file = static_cast<MemoryFile*>(user);
+				count = std::max<sf_count_t>(0, std::min(count, file->size - file->position));
+				std::memcpy(data, file->data + file->position, static_cast<size_t>(count));
+				file->position += count;
+				return count;
+			}
+
+			static sf_count_t memoryWrite(const void*, sf_count_t, void*)
+			{
+				return 0;
+			}
+
+			static sf_count_t memoryTell(void* user)
+			{
+				return static_cast<MemoryFile*>(user)->position;
+			}
+
+			static SF_VIRTUAL_IO memoryIo;
+
+			bool readSource(int16_t* samples, size_t frames)
+			{
+				const size_t channels = static_cast<size_t>(format_.channels);
+				size_t readFrames = audioFile_ ? static_cast<size_t>(sf_readf_short(audioFile_, samples, static_cast<sf_count_t>(frames)))
+											   : wavReader_.readFrames(samples, frames);
+				if (audioFile_ && readFrames < frames && sf_error(audioFile_) == SF_ERR_NO_ERROR)
+				{
+					// Compressed formats may report an estimated length; the image size is already fixed, so pad with silence
+					if (!inputEnded_)
+					{
+						std::cerr << "Warning: " << path_ << " ended " << (format_.frames - sourcePosition_ - readFrames)
+							<< " frames early, padding with silence." << std::endl;
+						inputEnded_ = true;
+					}
+					std::fill(samples + readFrames * channels, samples + frames * channels, static_cast<int16_t>(0));
+					readFrames = frames;
+				}
+				if (readFrames != frames)
+				{
+					std::cerr << "Error: Failed to read all samples from WAV file. Expected: " << format_.frames * channels
+						<< ", Read: " << (sourcePosition_ + readFrames) * channels << std::endl;
+					return false;
+				}
+				sourcePosition_ += frames;
+				return true;
+			}
+
+			ConversionContext* context_;
+			std::string path_;
+			std::unique_ptr<InputStream> wavIn_;
+			std::optional<CountingInputStream> counter_;
+			uint64_t viewBytes_ = 0;
+			std::optional<RecordingInputStream> recorder_;
+			AlignedVector<uint8_t> buffered_; // Input that had to be read into memory
+			std::optional<MemoryInputStream> bufferedIn_;
+			WavReader wavReader_;
+			MemoryFile memoryFile_;
+			SNDFILE* audioFile_ = nullptr;
+			WavFormat format_;
+			int sourceFormat_ = 0;
+			const int16_t* mapped_ = nullptr;
+			uint64_t sourcePosition_ = 0;
+			bool inputEnded_ = false;
+			AlignedVector<int16_t> buffer_;
+
+			bool resampling_ = false;
+			Resampler resampler_;
+			uint32_t outputRate_ = 0;
+			uint64_t outputFrames_ = 0;
+			std::vector<int16_t> resampled_;
+			size_t resampledPosition_ = 0;
 		};
 
+		SF_VIRTUAL_IO AudioInput::memoryIo = { memoryLength, memorySeek, memoryRead, memoryWrite, memoryTell };
 
-		// Encode samples to pixels
-		size_t pixelIndex = width * channelsPerPixel; // Start after metadata row
-		size_t samplesProcessed = 0;
+		// Bytes held by a block's buffers
+		size_t blockBytes(const RowBlock& block)
+		{
+			return (block.copy.capacity() + block.decoded.capacity()) * sizeof(int16_t) + block.pixels.capacity();
+		}
 
-		for (sf_count_t i = 0; i < numFrames && pixelIndex < image.size(); i++)
+		// Shared by the file and stream overloads; wavIn and imageOut replace the files at wavPath and pngPath when given.
+		// Returns false after setting result.error
+		bool encodeAudio(const std::string& wavPath, InputStream* wavIn, const std::string& pngPath, OutputStream* imageOut, const EncodeOptions& options, ConversionResult& result)
 		{
-			if (channelsPerPixel == 1) // Mono Grayscale
+			std::ostream silent(nullptr);
+			std::ostream& log = options.log ? *options.log : silent;
+
+			// Pick the image backend from the output extension
+			const ImageCodec* codec = ImageCodecRegistry::instance().findForPath(pngPath);
+			if (!codec)
+			{
+				std::cerr << "Error: Unsupported image format: " << pngPath << std::endl;
+				result.error = ConversionUnsupported;
+				return false;
+			}
+
+			// Open the audio file
+			ConversionContext* context = options.context;
+			MemoryAccount* account = MemoryAccount::current(); // For the stage threads
+			AudioInput input(context);
+			auto mark = std::chrono::steady_clock::now();
+			bool opened;
+			{
+				MemoryScope reading(MemoryStageRead);
+				opened = input.open(wavPath, wavIn, options);
+			}
+			result.readSeconds += lap(mark);
+			if (account)
+			{
+				account->sampleResident(); // Piped input may have been read to its end
+			}
+			if (!opened)
+			{
+				result.error = ConversionOpenInputFailed;
+				return false;
+			}
+			if (options.log)
+			{
+				log << "Input format: " << AudioFormat::describe(input.sourceFormat()) << std::endl; // Not built when nobody reads it
+			}
+
+			// Determine bit depth and channels
+			int channels = input.format().channels; // 1 = mono, 2 = stereo
+			int bitDepth = input.format().bitsPerSample;
+			if (channels < 1 || channels > 2)
+			{
+				std::cerr << "Error: Only mono and stereo audio is supported (got " << channels << " channels)." << std::endl;
+				result.error = ConversionInvalidInput;
+				return false;
+			}
+			if (options.sampleRate != 0 && !input.resampleTo(options.sampleRate))
+			{
+				result.error = ConversionUnsupported;
+				return false;
+			}
+			int sampleRate = static_cast<int>(input.sampleRate()); // Sample rate in Hz, as stored
+			uint64_t numFrames = input.frames(); // Total number of frames (samples per channel)
+			if (sampleRate != static_cast<int>(input.format().sampleRate))
+			{
+				log << "Resampling " << input.format().sampleRate << " Hz to " << sampleRate << " Hz." << std::endl;
+			}
+
+			// Calculate image dimensions
+			if (numFrames > Packing::maxFrames)
+			{
+				std::cerr << "Error: " << wavPath << " is too long for one image (" << numFrames << " frames, at most " << Packing::maxFrames << ")." << std::endl;
+				result.error = ConversionInvalidInput;
+				return false;
+			}
+			const int width = Packing::imageWidth; // Width of the image
+			int channelsPerPixel = Packing::channelsPerPixel(bitDepth, channels);
+			int height = static_cast<int>(Packing::imageHeight(numFrames, width, true)); // Metadata row, data rows, checksum trailer row
+
+			log << "Image dimensions: " << width << "x" << height << " with " << channelsPerPixel << " channels per pixel." << std::endl;
+
+			// Fit the layout to what the backend can store in a file of this type
+			std::string extension = pngPath.substr(pngPath.rfind('.')); // findForPath matched it
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			ImageInfo info;
+			info.height = height;
+			uint32_t layoutCaps = ImageCapDepth8 | (channelsPerPixel == 1 ? ImageCapGray : channelsPerPixel == 3 ? ImageCapRGB : ImageCapRGBA);
+			if (codec->supports(layoutCaps, extension))
+			{
+				info.width = width;
+				info.channels = channelsPerPixel;
+			}
+			else if (channelsPerPixel == 1 && codec->supports(ImageCapDepth8 | ImageCapRGBA, extension))
+			{
+				// No grayscale mode (QOI): store four samples per RGBA pixel.
+				// The byte stream is unchanged; the decoder recovers the layout from the metadata row.
+				info.width = width / 4;
+				info.channels = 4;
+			}
+			else
+			{
+				std::cerr << "Error: " << codec->name() << " cannot store a " << channelsPerPixel << "-channel image in a " << extension << " file." << std::endl;
+				result.error = ConversionUnsupported;
+				return false;
+			}
+
+			FileOutputStream file;
+			CountingOutputStream out(imageOut ? *imageOut : file);
+			std::unique_ptr<ImageSink> ownSink = context ? nullptr : codec->createSink();
+			ImageSink* sink = context ? &context->sink(*codec) : ownSink.get();
+			bool created = !imageOut && file.open(pngPath); // Deleted again if the encode fails
+			bool begun;
 			{
-				if (pixelIndex < image.size()) // Mono 8-bit
+				MemoryScope compressing(MemoryStageCodec);
+				begun = (imageOut || created) && sink->begin(out, info);
+			}
+			if (!begun)
+			{
+				std::cerr << "Error: Could not open image file for writing: " << pngPath << std::endl;
+				if (created)
 				{
-					image[pixelIndex++] = sampleToPixel(samples[i]);
-					samplesProcessed++;
+					file.close();
+					removePartialOutput(pngPath);
 				}
+				result.error = ConversionOpenOutputFailed;
+				return false;
+			}
+
+			// Rows are handled a block at a time in three stages: read (input decoding and resampling), pack
+			// (pixels and checksum) and write (compression and output), metadata row first
+			const size_t rowsPerBlock = 64;
+			const size_t rowBytes = static_cast<size_t>(width) * channelsPerPixel;
+			ContextBuffer<uint8_t> rowBuffer(context);
+			AlignedVector<uint8_t>& rows = rowBuffer.data;
+			fitBuffer(rows, rowBytes, context);
+
+			Packing::Metadata metadata;
+			metadata.sampleRate = static_cast<uint32_t>(sampleRate);
+			metadata.channels = channels;
+			metadata.bitDepth = bitDepth;
+			metadata.version = Packing::formatVersion;
+			metadata.flags = Packing::flagChecksum;
+			metadata.frames = numFrames;
+			metadata.sourceFormat = static_cast<uint32_t>(input.sourceFormat());
+			metadata.originalSampleRate = input.format().sampleRate;
+			Packing::writeMetadata(metadata, rows.data());
+			bool ok;
+			{
+				MemoryScope compressing(MemoryStageCodec);
+				ok = sink->writeRows(rows.data(), 1);
 			}
-			else if (channelsPerPixel == 3) // Stereo RGB
+
+			// The checksum covers the PCM the decoder will reproduce, i.e. the samples after 8-bit quantisation
+			ContextBuffer<int16_t> decodedBuffer(context);
+			AlignedVector<int16_t>& decoded = decodedBuffer.data;
+			uint32_t checksum = 0;
+			uint64_t samplesProcessed = 0;
+			uint64_t framesWritten = 0;
+			bool cancelled = false;
+			bool readFailed = false; // As opposed to a write failure
+			size_t peakBlockBytes = 0;
+			const int dataEnd = height - 1; // Last row is the checksum trailer
+			int nextRow = 1;
+
+			// Sizes a block's buffers up front, on this thread: of the stages on other threads only the reader
+			// (AudioInput's buffer) then reaches the context, and it is the only one using it meanwhile
+			auto prepareBlock = [&](RowBlock& block, bool keep, bool scratch)
+			{
+				block.context = context;
+				if (keep && !input.readsInPlace())
+				{
+					reserveBuffer(block.copy, rowsPerBlock * width * channels, context);
+				}
+				fitBuffer(block.pixels, rowsPerBlock * rowBytes, context);
+				if (scratch)
+				{
+					fitBuffer(block.decoded, rowsPerBlock * width * channels, context);
+				}
+			};
+
+			auto readBlock = [&](RowBlock& block, bool keep)
+			{
+				if (options.cancel && options.cancel->cancelled())
+				{
+					cancelled = true;
+					return false;
+				}
+				block.row = nextRow;
+				block.rows = std::min<size_t>(rowsPerBlock, static_cast<size_t>(dataEnd - nextRow));
+				block.frames = static_cast<size_t>(std::min<uint64_t>(block.rows * width, numFrames - samplesProcessed));
+				MemoryScope reading(MemoryStageRead);
+				block.samples = input.read(block.frames);
+				if (!block.samples)
+				{
+					readFailed = true;
+					return false;
+				}
+				if (keep && !input.readsInPlace())
+				{
+					block.copy.assign(block.samples, block.samples + block.frames * channels);
+					block.samples = block.copy.data();
+				}
+				nextRow += static_cast<int>(block.rows);
+				samplesProcessed += block.frames;
+				return true;
+			};
+
+			// Continues crc over the block, decoding into scratch
+			auto packBlock = [&](RowBlock& block, uint32_t& crc, AlignedVector<int16_t>& scratch)
+			{
+				block.pixels.resize(rowsPerBlock * rowBytes);
+				Packing::packFrames(block.samples, block.frames, channels, channelsPerPixel, block.pixels.data());
+				std::fill(block.pixels.begin() + block.frames * channelsPerPixel, block.pixels.begin() + block.rows * rowBytes, 0); // Padding after the last frame
+
+				scratch.resize(rowsPerBlock * width * channels);
+				size_t decodedCount = Packing::unpackPixels(block.pixels.data(), block.frames, channelsPerPixel, channels, scratch.data());
+				crc = Checksum::crc32c(crc, scratch.data(), decodedCount * sizeof(int16_t));
+			};
+
+			auto writeBlock = [&](const RowBlock& block)
 			{
-				if (pixelIndex + 2 < image.size())
+				MemoryScope compressing(MemoryStageCodec);
+				if (!sink->writeRows(block.pixels.data(), static_cast<int>(block.rows)))
+				{
+					return false;
+				}
+				if (account && (static_cast<size_t>(block.row) - 1) / rowsPerBlock % 16 == 0)
+				{
+					account->sampleResident();
+				}
+				framesWritten += block.frames;
+				if (options.progress)
 				{
-					image[pixelIndex++] = sampleToPixel(samples[i * 2]);     // Left channel (Red)
-					image[pixelIndex++] = sampleToPixel(samples[i * 2 + 1]); // Right channel (Green)
-					image[pixelIndex++] = 128; // Blue channel (constant value for variation)
-					samplesProcessed++;
+					options.progress(framesWritten, numFrames);
 				}
+				return true;
+			};
+
+			StageTime readTime, packTime, writeTime;
+			const size_t blockTotal = (static_cast<size_t>(std::max(dataEnd - 1, 0)) + rowsPerBlock - 1) / rowsPerBlock;
+			const bool scheduled = ok && options.scheduler && blockTotal > 32;
+			const bool pipelined = ok && !scheduled && options.pipeline && blockTotal > 2;
+			if (scheduled)
+			{
+				// Reads and writes stay on this thread, in order. Packing runs as one subtask per block: the next
+				// batch is packed, by this worker or whichever workers are idle, while this one is written.
+				// Block checksums are combined in order, so the result matches the other paths
+				const size_t batchBlocks = 16;
+				RowBlock batches[2][batchBlocks];
+				for (auto& batch : batches)
+				{
+					for (RowBlock& block : batch)
+					{
+						prepareBlock(block, true, true);
+					}
+				}
+				size_t counts[2] = {};
+				TaskScheduler::TaskGroup packing[2];
+				auto startBatch = [&](size_t b)
+				{
+					auto mark = std::chrono::steady_clock::now();
+					for (counts[b] = 0; counts[b] < batchBlocks && nextRow < dataEnd && ok; counts[b]++)
+					{
+						ok = readBlock(batches[b][counts[b]], true);
+					}
+					readTime.busy += lap(mark);
+					for (size_t i = 0; i < counts[b] && ok; i++)
+					{
+						options.scheduler->spawn(packing[b], [&, b, i]()
+						{
+							RowBlock& block = batches[b][i];
+							auto start = std::chrono::steady_clock::now();
+							block.checksum = 0;
+							packBlock(block, block.checksum, block.decoded);
+							block.packSeconds = lap(start);
+						});
+					}
+				};
+
+				size_t current = 0;
+				startBatch(current);
+				while (counts[current] > 0 && ok)
+				{
+					startBatch(1 - current);
+					auto mark = std::chrono::steady_clock::now();
+					options.scheduler->wait(packing[current]);
+					packTime.idle += lap(mark);
+					for (size_t i = 0; i < counts[current] && ok; i++)
+					{
+						RowBlock& block = batches[current][i];
+						checksum = Checksum::combine(checksum, block.checksum, static_cast<uint64_t>(block.frames) * channels * sizeof(int16_t));
+						packTime.busy += block.packSeconds;
+						ok = writeBlock(block);
+					}
+					writeTime.busy += lap(mark);
+					current = 1 - current;
+				}
+				options.scheduler->wait(packing[0]);
+				options.scheduler->wait(packing[1]);
+				for (const auto& batch : batches)
+				{
+					for (const RowBlock& block : batch)
+					{
+						peakBlockBytes += blockBytes(block);
+					}
+				}
+			}
+			else if (!pipelined)
+			{
+				RowBlock block;
+				prepareBlock(block, false, false);
+				fitBuffer(decoded, rowsPerBlock * width * channels, context);
+				auto mark = std::chrono::steady_clock::now();
+				while (nextRow < dataEnd && ok)
+				{
+					ok = readBlock(block, false);
+					readTime.busy += lap(mark);
+					if (ok)
+					{
+						packBlock(block, checksum, decoded);
+						packTime.busy += lap(mark);
+						ok = writeBlock(block);
+						writeTime.busy += lap(mark);
+					}
+				}
+				peakBlockBytes = blockBytes(block) + decoded.capacity() * sizeof(int16_t);
 			}
-			else if (channelsPerPixel == 4) // 16-bit RGBA
+			else
 			{
-				if (pixelIndex + 3 < image.size())
+				// One thread per stage. Blocks cycle free -> read -> pack -> write -> free through single-producer,
+				// single-consumer rings, so a slow stage holds the others back and memory stays at blockCount blocks.
+				// After a failure the later stages keep passing blocks on until the end marker, so nobody waits forever
+				const size_t blockCount = 8;
+				const size_t endOfStream = blockCount;
+				RowBlock blocks[blockCount];
+				for (RowBlock& block : blocks)
+				{
+					prepareBlock(block, true, false);
+				}
+				fitBuffer(decoded, rowsPerBlock * width * channels, context);
+				SpscRing<size_t, blockCount> freeBlocks;
+				SpscRing<size_t, blockCount> readBlocks;
+				SpscRing<size_t, blockCount> packedBlocks;
+				for (size_t i = 0; i < blockCount; i++)
 				{
-					int16_t left = (channels == 1) ? samples[i] : samples[i * 2];
-					image[pixelIndex++] = sampleToPixel(left); // Red channel
-					image[pixelIndex++] = sampleToPixel(left >> 1); // Green channel
+					freeBlocks.push(i);
+				}
+				std::atomic<bool> readStopped(false);
+				std::atomic<bool> writeFailed(false);
 
-					if (channels == 2)
+				std::thread reader([&]()
+				{
+					MemoryScope counting(account, MemoryStageRead);
+					auto mark = std::chrono::steady_clock::now();
+					while (nextRow < dataEnd && !writeFailed)
 					{
-						int16_t right = samples[i * 2 + 1];
-						image[pixelIndex++] = sampleToPixel(right); // Blue channel
-						image[pixelIndex++] = 255; // Alpha channel (fully opaque)
+						size_t i = freeBlocks.pop();
+						readTime.idle += lap(mark);
+						if (!readBlock(blocks[i], true))
+						{
+							readStopped = true;
+							break;
+						}
+						readTime.busy += lap(mark);
+						readBlocks.push(i);
+						readTime.idle += lap(mark);
 					}
-					else
+					readBlocks.push(endOfStream);
+				});
+
+				std::thread writer([&]()
+				{
+					MemoryScope counting(account, MemoryStageCodec);
+					auto mark = std::chrono::steady_clock::now();
+					for (size_t i = packedBlocks.pop(); i != endOfStream; i = packedBlocks.pop())
 					{
-						image[pixelIndex++] = sampleToPixel(left >> 2); // Blue channel
-						image[pixelIndex++] = 255; // Alpha channel (fully opaque)
+						writeTime.idle += lap(mark);
+						if (!writeFailed && !writeBlock(blocks[i]))
+						{
+							writeFailed = true;
+						}
+						writeTime.busy += lap(mark);
+						freeBlocks.push(i);
+						writeTime.idle += lap(mark);
 					}
-					samplesProcessed++;
+					writeTime.idle += lap(mark);
+				});
+
+				auto mark = std::chrono::steady_clock::now();
+				for (size_t i = readBlocks.pop(); i != endOfStream; i = readBlocks.pop())
+				{
+					packTime.idle += lap(mark);
+					packBlock(blocks[i], checksum, decoded);
+					packTime.busy += lap(mark);
+					packedBlocks.push(i);
+					packTime.idle += lap(mark);
 				}
+				packedBlocks.push(endOfStream);
+				reader.join();
+				writer.join();
+				packTime.idle += lap(mark);
+				ok = ok && !readStopped && !writeFailed;
+				for (const RowBlock& block : blocks)
+				{
+					peakBlockBytes += blockBytes(block);
+				}
+				peakBlockBytes += decoded.capacity() * sizeof(int16_t);
 			}
-		}
 
-		std::cout << "Processed " << samplesProcessed << " samples into " << pixelIndex << " bytes " << std::endl;
+			log << "Stage times" << (scheduled ? " (packing as subtasks)" : pipelined ? " (one thread each)" : " (one thread)") << ", busy/idle ms: read "
+				<< static_cast<int>(readTime.busy * 1000) << "/" << static_cast<int>(readTime.idle * 1000)
+				<< ", pack " << static_cast<int>(packTime.busy * 1000) << "/" << static_cast<int>(packTime.idle * 1000)
+				<< ", write " << static_cast<int>(writeTime.busy * 1000) << "/" << static_cast<int>(writeTime.idle * 1000) << std::endl;
 
-		// Debug: Check first few pixels
-		std::cout << "First 10 pixels after metadata: ";
-		size_t metadataEnd = width * channelsPerPixel;
-		for (int i = 0; i < std::min(10, static_cast<int>(image.size() - metadataEnd)); i++)
-		{
-			std::cout << static_cast<int>(image[metadataEnd + i]) << " ";
+			MemoryScope compressing(MemoryStageCodec); // The trailer row and the end of the image
+			if (ok)
+			{
+				std::fill(rows.begin(), rows.begin() + rowBytes, 0);
+				Packing::writeTrailer(checksum, rows.data());
+				ok = sink->writeRows(rows.data(), 1);
+			}
+
+			mark = std::chrono::steady_clock::now();
+			ok = ok && sink->finish();
+			ok = (imageOut || file.close()) && ok;
+			writeTime.busy += lap(mark);
+
+			result.frames = framesWritten;
+			result.bytesIn = input.inputBytes();
+			result.bytesOut = out.count();
+			result.peakBufferBytes = rows.capacity() + peakBlockBytes + input.bufferBytes();
+			result.readSeconds += readTime.busy;
+			result.packSeconds = packTime.busy;
+			result.writeSeconds = writeTime.busy;
+			if (!ok)
+			{
+				if (created)
+				{
+					removePartialOutput(pngPath);
+				}
+				if (cancelled)
+				{
+					log << "Cancelled encoding " << wavPath << std::endl;
+					result.error = ConversionCancelled;
+				}
+				else if (readFailed)
+				{
+					result.error = ConversionReadFailed; // AudioInput has said why
+				}
+				else
+				{
+					std::cerr << "Error: Failed to write " << codec->name() << " file: " << pngPath << std::endl;
+					result.error = ConversionWriteFailed;
+				}
+				return false;
+			}
+
+			log << "Processed " << samplesProcessed << " samples into " << static_cast<uint64_t>(height) * rowBytes << " bytes " << std::endl;
+			log << "Encoded " << wavPath << " to " << pngPath << " (PCM CRC32C " << Checksum::toHex(checksum) << ")" << std::endl;
+			return true;
 		}
 
-		// Write PNG
-		int result = stbi_write_png(pngPath.c_str(), width, height, channelsPerPixel, image.data(), width * channelsPerPixel);
-		if (!result)
+		ConversionResult timedEncode(const std::string& wavPath, InputStream* wavIn, const std::string& pngPath, OutputStream* imageOut, const EncodeOptions& options)
 		{
-			std::cerr << "Error: Failed to write PNG file: " << pngPath << std::endl;
-			return false;
+			ConversionResult result;
+			auto start = std::chrono::steady_clock::now();
+			MemoryAccount ownAccount; // Without a context everything it counts is freed before encodeAudio returns
+			ConversionContext::Scope scope(options.context);
+			MemoryAccount& account = ConversionContext::current() ? ConversionContext::current()->memory() : ownAccount;
+			account.sampleResident();
+			account.resetPeaks();
+			MemoryScope memory(&account, MemoryStagePack);
+			encodeAudio(wavPath, wavIn, pngPath, imageOut, options, result);
+			account.sampleResident();
+			result.memory = account.usage();
+			result.seconds = lap(start);
+			return result;
 		}
+	}
+
+	bool Encoder::encode(const std::string& wavPath, const std::string& pngPath)
+	{
+		return encode(wavPath, pngPath, EncodeOptions()).ok();
+	}
 
-		std::cout << "Encoded " << wavPath << " to " << pngPath << std::endl;
-		return true;
+	ConversionResult Encoder::encode(const std::string& wavPath, const std::string& pngPath, const EncodeOptions& options)
+	{
+		return timedEncode(wavPath, nullptr, pngPath, nullptr, options);
+	}
+
+	ConversionResult Encoder::encode(InputStream& wav, const std::string& wavPath, OutputStream& image, const std::string& pngPath, const EncodeOptions& options)
+	{
+		return timedEncode(wavPath, &wav, pngPath, &image, options);
+	}
+
+	ConversionResult Encoder::encode(InputStream& wav, const std::string& wavPath, const std::string& pngPath, const EncodeOptions& options)
+	{
+		return timedEncode(wavPath, &wav, pngPath, nullptr, options);
 	}
-} // namespace SoundImageConverter
\ No newline at end of file
+} // namespace SoundImageConverter
@@ -0,0 +1,677 @@
+#include "SoundImageConverter/HttpServer.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/Stream.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace SoundImageConverter
+{
+#ifndef _WIN32
+	namespace
+	{
+		const size_t ioBufferBytes = 64 * 1024;
+		const size_t maxHeaderBytes = 16 * 1024;
+		const int socketTimeoutSeconds = 30;
+
+		bool sendAll(int fd, iovec* parts, int count)
+		{
+			while (count > 0)
+			{
+				msghdr message = {};
+				message.msg_iov = parts;
+				message.msg_iovlen = count;
+				ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+				if (sent < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (sent < 0)
+				{
+					return false; // Including the send timeout
+				}
+				size_t left = static_cast<size_t>(sent);
+				while (count > 0 && left >= parts->iov_len)
+				{
+					left -= parts->iov_len;
+					parts++;
+					count--;
+				}
+				if (count > 0)
+				{
+					parts->iov_base = static_cast<uint8_t*>(parts->iov_base) + left;
+					parts->iov_len -= left;
+				}
+			}
+			return true;
+		}
+
+		bool sendText(int fd, const std::string& text)
+		{
+			iovec part = { const_cast<char*>(text.data()), text.size() };
+			return sendAll(fd, &part, 1);
+		}
+
+		// Buffered blocking reads from a socket
+		class SocketReader
+		{
+		public:
+			explicit SocketReader(int fd) : fd_(fd), buffer_(ioBufferBytes) {}
+
+			// Reads a line and strips its CRLF; false at the end of the stream, on a read error or timeout,
+			// or when the line is longer than limit
+			bool readLine(std::string& line, size_t limit)
+			{
+				line.clear();
+				for (;;)
+				{
+					const uint8_t* start = buffer_.data() + begin_;
+					const uint8_t* newline = static_cast<const uint8_t*>(std::memchr(start, '\n', end_ - begin_));
+					size_t take = newline ? static_cast<size_t>(newline - start) + 1 : end_ - begin_;
+					line.append(reinterpret_cast<const char*>(start), take);
+					begin_ += take;
+					if (line.size() > limit)
+					{
+						return false;
+					}
+					if (newline)
+					{
+						line.pop_back();
+						if (!line.empty() && line.back() == '\r')
+						{
+							line.pop_back();
+						}
+						return true;
+					}
+					if (!fill())
+					{
+						return false;
+					}
+				}
+			}
+
+			// Up to size bytes: buffered ones first, large reads straight from the socket
+			size_t read(void* data, size_t size)
+			{
+				if (begin_ == end_)
+				{
+					if (size >= buffer_.size())
+					{
+						ssize_t got;
+						do
+						{
+							got = recv(fd_, data, size, 0);
+						} while (got < 0 && errno == EINTR);
+						return got > 0 ? static_cast<size_t>(got) : 0;
+					}
+					if (!fill())
+					{
+						return 0;
+					}
+				}
+				size_t take = std::min(size, end_ - begin_);
+				std::memcpy(data, buffer_.data() + begin_, take);
+				begin_ += take;
+				return take;
+			}
+
+		private:
+			// Only called with the buffer used up
+			bool fill()
+			{
+				begin_ = 0;
+				end_ = 0;
+				ssize_t got;
+				do
+				{
+					got = recv(fd_, buffer_.data(), buffer_.size(), 0);
+				} while (got < 0 && errno == EINTR);
+				if (got <= 0)
+				{
+					return false;
+				}
+				end_ = static_cast<size_t>(got);
+				return true;
+			}
+
+			int fd_;
+			std::vector<uint8_t> buffer_;
+			size_t begin_ = 0;
+			size_t end_ = 0;
+		};
+
+		// A request body, unframed from its Content-Length or chunked transfer coding
+		class BodyInputStream : public InputStream
+		{
+		public:
+			BodyInputStream(SocketReader& reader, bool chunked, uint64_t length, uint64_t limit)
+				: reader_(reader), chunked_(chunked), left_(chunked ? 0 : length), limit_(limit)
+			{
+			}
+
+			size_t read(void* data, size_t size) override
+			{
+				uint8_t* out = static_cast<uint8_t*>(data);
+				size_t total = 0;
+				while (total < size && !done_ && !failed_)
+				{
+					if (left_ == 0)
+					{
+						if (!chunked_)
+						{
+							done_ = true;
+						}
+						else
+						{
+							nextChunk();
+						}
+						continue;
+					}
+					size_t got = reader_.read(out + total, static_cast<size_t>(std::min<uint64_t>(size - total, left_)));
+					if (got == 0)
+					{
+						failed_ = true; // Ended early, or timed out
+						break;
+					}
+					total += got;
+					left_ -= got;
+				}
+				return total;
+			}
+
+			// Reads and drops what the converter left, e.g. chunks after the WAV data; false if the body is broken
+			bool skipRest()
+			{
+				uint8_t scratch[4096];
+				while (!done_ && !failed_)
+				{
+					read(scratch, sizeof(scratch));
+				}
+				return done_ && !failed_;
+			}
+
+			bool tooLarge() const { return tooLarge_; }
+
+		private:
+			// Reads the CRLF after the previous chunk, the next size line, and the trailer after the last chunk
+			void nextChunk()
+			{
+				std::string line;
+				if (started_ && (!reader_.readLine(line, 2) || !line.empty()))
+				{
+					failed_ = true;
+					return;
+				}
+				started_ = true;
+				if (!reader_.readLine(line, 1024))
+				{
+					failed_ = true;
+					return;
+				}
+				// Hex digits only, at most 16 so the size fits (strtoull would also take a sign, "0x" or spaces).
+				// Chunk extensions after the size (";name=value") are ignored
+				uint64_t size = 0;
+				size_t digits = 0;
+				for (; digits < line.size() && std::isxdigit(static_cast<unsigned char>(line[digits])); digits++)
+				{
+					char c = static_cast<char>(std::tolower(static_cast<unsigned char>(line[digits])));
+					size = size << 4 | static_cast<uint64_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+				}
+				bool extension = digits < line.size() && (line[digits] == ';' || line[digits] == ' ' || line[digits] == '\t');
+				if (digits == 0 || digits > 16 || (digits < line.size() && !extension))
+				{
+					failed_ = true;
+					return;
+				}
+				if (size == 0)
+				{
+					do
+					{
+						if (!reader_.readLine(line, maxHeaderBytes))
+						{
+							failed_ = true;
+							return;
+						}
+					} while (!line.empty());
+					done_ = true;
+					return;
+				}
+				if (size > limit_ - received_) // received_ + size could wrap around
+				{
+					failed_ = true;
+					tooLarge_ = true;
+					return;
+				}
+				received_ += size;
+				left_ = size;
+			}
+
+			SocketReader& reader_;
+			bool chunked_;
+			uint64_t left_;
+			uint64_t limit_;
+			uint64_t received_ = 0;
+			bool started_ = false;
+			bool done_ = false;
+			bool failed_ = false;
+			bool tooLarge_ = false;
+		};
+
+		// The answer in chunked transfer coding, up to 64 KiB per chunk. The status line and headers
+		// go out with the first chunk, so an answer can still turn into an error until then
+		class ChunkedOutputStream : public OutputStream
+		{
+		public:
+			ChunkedOutputStream(int fd, std::string head) : fd_(fd), head_(std::move(head))
+			{
+				buffer_.reserve(ioBufferBytes);
+			}
+
+			bool write(const void* data, size_t size) override
+			{
+				const uint8_t* p = static_cast<const uint8_t*>(data);
+				while (!failed_ && size > 0)
+				{
+					if (buffer_.empty() && size >= ioBufferBytes)
+					{
+						// Whole blocks of rows go out as they are, without a copy
+						failed_ = !sendChunk(p, size);
+						break;
+					}
+					size_t take = std::min(size, ioBufferBytes - buffer_.size());
+					buffer_.insert(buffer_.end(), p, p + take);
+					p += take;
+					size -= take;
+					if (buffer_.size() == ioBufferBytes)
+					{
+						failed_ = !sendChunk(buffer_.data(), buffer_.size());
+						buffer_.clear();
+					}
+				}
+				return !failed_;
+			}
+
+			// Sends what is buffered and the last chunk
+			bool finish()
+			{
+				if (!failed_ && !buffer_.empty())
+				{
+					failed_ = !sendChunk(buffer_.data(), buffer_.size());
+					buffer_.clear();
+				}
+				return !failed_ && sendChunk(nullptr, 0);
+			}
+
+			bool started() const { return started_; }
+
+		private:
+			bool sendChunk(const uint8_t* data, size_t size)
+			{
+				char sizeLine[32];
+				int sizeLength = std::snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", size);
+				char end[] = "\r\n";
+				iovec parts[4];
+				int count = 0;
+				if (!started_)
+				{
+					parts[count++] = { const_cast<char*>(head_.data()), head_.size() };
+					started_ = true;
+				}
+				parts[count++] = { sizeLine, static_cast<size_t>(sizeLength) };
+				if (size > 0)
+				{
+					parts[count++] = { const_cast<uint8_t*>(data), size };
+				}
+				parts[count++] = { end, 2 };
+				return sendAll(fd_, parts, count);
+			}
+
+			int fd_;
+			std::string head_;
+			std::vector<uint8_t> buffer_;
+			bool started_ = false;
+			bool failed_ = false;
+		};
+
+		std::string lowerCase(std::string text)
+		{
+			std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			return text;
+		}
+
+		std::string trim(const std::string& text)
+		{
+			size_t first = text.find_first_not_of(" \t");
+			size_t last = text.find_last_not_of(" \t");
+			return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+		}
+
+		// Value of name in a query string, fallback if it is not there
+		std::string queryValue(const std::string& query, const std::string& name, const std::string& fallback)
+		{
+			size_t start = 0;
+			while (start < query.size())
+			{
+				size_t end = std::min(query.find('&', start), query.size());
+				std::string pair = query.substr(start, end - start);
+				size_t equals = pair.find('=');
+				if (pair.substr(0, equals) == name)
+				{
+					return equals == std::string::npos ? std::string() : pair.substr(equals + 1);
+				}
+				start = end + 1;
+			}
+			return fallback;
+		}
+
+		// Status line for a conversion that failed before any of the answer was sent
+		const char* statusFor(ConversionError error)
+		{
+			switch (error)
+			{
+			case ConversionUnsupported: return "415 Unsupported Media Type";
+			case ConversionOpenInputFailed:
+			case ConversionInvalidInput:
+			case ConversionChecksumMismatch: return "422 Unprocessable Content";
+			case ConversionReadFailed: return "400 Bad Request";
+			case ConversionCancelled: return "503 Service Unavailable";
+			default: return "500 Internal Server Error";
+			}
+		}
+
+		const char* reasonFor(ConversionError error)
+		{
+			switch (error)
+			{
+			case ConversionUnsupported: return "unsupported format, layout or sample rate";
+			case ConversionOpenInputFailed: return "input is not audio, or not an image of that type";
+			case ConversionInvalidInput: return "input is damaged or too long";
+			case ConversionReadFailed: return "request body ended early";
+			case ConversionChecksumMismatch: return "checksum mismatch, the image is damaged";
+			case ConversionCancelled: return "server is shutting down";
+			default: return "conversion failed";
+			}
+		}
+	}
+
+	struct HttpConnection::State
+	{
+		explicit State(int socket) : fd(socket), reader(socket) {}
+
+		int fd;
+		uint64_t maxRequestBytes = 0;
+		TaskScheduler* scheduler = nullptr;
+		SocketReader reader;
+		CancelToken cancel;
+		ConversionContext context; // Buffers and backends kept between the requests of this connection
+
+		// A short answer with a text body
+		bool answer(const std::string& status, const std::string& text, bool keepAlive, const std::string& extraHeaders = std::string())
+		{
+			return sendText(fd, "HTTP/1.1 " + status + "\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(text.size() + 1)
+				+ "\r\n" + extraHeaders + (keepAlive ? "" : "Connection: close\r\n") + "\r\n" + text + "\n");
+		}
+	};
+
+	HttpConnection::HttpConnection(int fd, uint64_t maxRequestBytes, TaskScheduler* scheduler) : state_(new State(fd))
+	{
+		state_->maxRequestBytes = maxRequestBytes;
+		state_->scheduler = scheduler;
+		// Answers are written in large chunks already; Nagle would only hold back the last one
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		timeval timeout = { socketTimeoutSeconds, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	}
+
+	HttpConnection::~HttpConnection()
+	{
+		::close(state_->fd);
+	}
+
+	void HttpConnection::shutdown()
+	{
+		state_->cancel.cancel();
+		::shutdown(state_->fd, SHUT_RDWR);
+	}
+
+	void HttpConnection::serve(const std::function<void(const ConversionResult&)>& finished)
+	{
+		State& s = *state_;
+		std::string line;
+		while (!s.cancel.cancelled())
+		{
+			// Request line; clients may send empty lines between requests
+			do
+			{
+				if (!s.reader.readLine(line, maxHeaderBytes))
+				{
+					return; // Closed, idle too long, or garbage
+				}
+			} while (line.empty());
+			size_t firstSpace = line.find(' ');
+			size_t lastSpace = line.rfind(' ');
+			if (firstSpace == std::string::npos || firstSpace == lastSpace)
+			{
+				s.answer("400 Bad Request", "malformed request line", false);
+				return;
+			}
+			std::string method = line.substr(0, firstSpace);
+			std::string target = line.substr(firstSpace + 1, lastSpace - firstSpace - 1);
+			std::string version = line.substr(lastSpace + 1);
+
+			bool chunked = false;
+			bool hasLength = false;
+			bool expectContinue = false;
+			bool keepAlive = version == "HTTP/1.1";
+			uint64_t length = 0;
+			size_t headerBytes = 0;
+			const char* badFraming = nullptr; // Guessing where a body ends would desync the connection
+			for (;;)
+			{
+				if (!s.reader.readLine(line, maxHeaderBytes) || (headerBytes += line.size()) > maxHeaderBytes)
+				{
+					s.answer("431 Request Header Fields Too Large", "headers too large or cut off", false);
+					return;
+				}
+				if (line.empty())
+				{
+					break;
+				}
+				size_t colon = line.find(':');
+				std::string name = lowerCase(line.substr(0, colon));
+				std::string value = colon == std::string::npos ? std::string() : lowerCase(trim(line.substr(colon + 1)));
+				if (name == "content-length")
+				{
+					if (hasLength || value.empty() || value.size() > 19 || value.find_first_not_of("0123456789") != std::string::npos)
+					{
+						badFraming = "invalid or repeated Content-Length";
+					}
+					hasLength = true;
+					length = std::strtoull(value.c_str(), nullptr, 10);
+				}
+				else if (name == "transfer-encoding")
+				{
+					if (chunked || value != "chunked")
+					{
+						badFraming = "only a single Transfer-Encoding: chunked is supported";
+					}
+					chunked = true;
+				}
+				else if (name == "connection")
+				{
+					keepAlive = value == "close" ? false : value == "keep-alive" ? true : keepAlive;
+				}
+				else if (name == "expect")
+				{
+					expectContinue = value == "100-continue";
+				}
+			}
+			if (chunked && hasLength)
+			{
+				badFraming = "both Content-Length and Transfer-Encoding";
+			}
+			if (badFraming)
+			{
+				s.answer("400 Bad Request", badFraming, false);
+				return;
+			}
+			bool hasBody = chunked || (hasLength && length > 0);
+
+			// Refusals before the body is read close the connection if a body follows, rather than skip it
+			size_t question = target.find('?');
+			std::string path = target.substr(0, question);
+			std::string query = question == std::string::npos ? std::string() : target.substr(question + 1);
+			std::string type = lowerCase(queryValue(query, "type", "png"));
+			bool encode = path == "/encode";
+			if (method != "POST")
+			{
+				s.answer("405 Method Not Allowed", "use POST /encode or POST /decode", keepAlive && !hasBody, "Allow: POST\r\n");
+			}
+			else if (!encode && path != "/decode")
+			{
+				s.answer("404 Not Found", "use POST /encode or POST /decode", keepAlive && !hasBody);
+			}
+			else if (!ImageCodecRegistry::instance().findForPath("request." + type))
+			{
+				s.answer("415 Unsupported Media Type", "unknown image type: " + type, keepAlive && !hasBody);
+			}
+			else if (length > s.maxRequestBytes)
+			{
+				s.answer("413 Content Too Large", "request body too large", false);
+				return;
+			}
+			else
+			{
+				if (expectContinue && !sendText(s.fd, "HTTP/1.1 100 Continue\r\n\r\n"))
+				{
+					return;
+				}
+				const char* contentType = !encode ? "audio/wav" : type == "png" ? "image/png" : "application/octet-stream";
+				BodyInputStream body(s.reader, chunked, length, s.maxRequestBytes);
+				ChunkedOutputStream out(s.fd, std::string("HTTP/1.1 200 OK\r\nContent-Type: ") + contentType
+					+ "\r\nTransfer-Encoding: chunked\r\n" + (keepAlive ? "" : "Connection: close\r\n") + "\r\n");
+				ConversionResult result;
+				if (encode)
+				{
+					EncodeOptions options;
+					options.sampleRate = static_cast<uint32_t>(std::strtoul(queryValue(query, "rate", "0").c_str(), nullptr, 10));
+					options.pipeline = false; // Each connection already has its own thread
+					options.scheduler = s.scheduler;
+					options.context = &s.context;
+					options.cancel = &s.cancel;
+					options.log = nullptr;
+					result = Encoder::encode(body, "request", out, "request." + type, options);
+				}
+				else
+				{
+					DecodeOptions options;
+					options.output = AudioOutputWav;
+					options.pipeline = false;
+					options.scheduler = s.scheduler;
+					options.context = &s.context;
+					options.cancel = &s.cancel;
+					options.log = nullptr;
+					result = Decoder::decode(body, "request." + type, out, "request.wav", options);
+				}
+				if (result.ok() && !out.finish())
+				{
+					result.error = ConversionWriteFailed;
+				}
+
+				keepAlive = keepAlive && body.skipRest();
+				if (!result.ok() && !out.started())
+				{
+					if (body.tooLarge())
+					{
+						s.answer("413 Content Too Large", "request body too large", false);
+					}
+					else
+					{
+						s.answer(statusFor(result.error), reasonFor(result.error), keepAlive);
+					}
+				}
+				else if (!result.ok())
+				{
+					keepAlive = false; // Cut off: without the last chunk the client knows the answer is incomplete
+				}
+				finished(result);
+				if (!keepAlive)
+				{
+					return;
+				}
+				continue;
+			}
+			if (!keepAlive || hasBody)
+			{
+				return;
+			}
+		}
+	}
+
+	int listenHttp(uint16_t port)
+	{
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		int on = 1;
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // Never reachable from other machines
+		if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+			|| bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0)
+		{
+			std::cerr << "Error: Could not listen on 127.0.0.1:" << port << ": " << std::strerror(errno) << std::endl;
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+			return -1;
+		}
+		return fd;
+	}
+#else
+	struct HttpConnection::State
+	{
+	};
+
+	HttpConnection::HttpConnection(int, uint64_t, TaskScheduler*) : state_(new State())
+	{
+	}
+
+	HttpConnection::~HttpConnection() = default;
+
+	void HttpConnection::serve(const std::function<void(const ConversionResult&)>&)
+	{
+	}
+
+	void HttpConnection::shutdown()
+	{
+	}
+
+	int listenHttp(uint16_t)
+	{
+		std::cerr << "Error: The HTTP endpoint is only built on POSIX systems" << std::endl;
+		return -1;
+	}
+#endif
+}
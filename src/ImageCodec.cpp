@@ -0,0 +1,69 @@
+#include "SoundImageConverter/ImageCodec.h"
+#include <cctype>
+
+namespace SoundImageConverter
+{
+	ImageCodecRegistry::ImageCodecRegistry()
+	{
+		// Registered explicitly: self-registering statics would be dropped when linking the static core library
+		add(createPngCodec());
+		add(createQoiCodec());
+		add(createNetpbmCodec());
+	}
+
+	ImageCodecRegistry& ImageCodecRegistry::instance()
+	{
+		static ImageCodecRegistry registry;
+		return registry;
+	}
+
+	void ImageCodecRegistry::add(std::unique_ptr<ImageCodec> codec)
+	{
+		if (codec)
+		{
+			for (const std::string& extension : codec->extensions())
+			{
+				extensions_.emplace_back(extension, codec.get());
+			}
+			codecs_.push_back(std::move(codec));
+		}
+	}
+
+	const ImageCodec* ImageCodecRegistry::findByExtension(const std::string& extension) const
+	{
+		return find(extension.data(), extension.size());
+	}
+
+	const ImageCodec* ImageCodecRegistry::findForPath(const std::string& path) const
+	{
+		// The extension as std::filesystem::path has it: from the last dot of the file name, unless the name starts there
+		size_t nameStart = path.find_last_of("/\\");
+		nameStart = nameStart == std::string::npos ? 0 : nameStart + 1;
+		size_t dot = path.rfind('.');
+		if (dot == std::string::npos || dot <= nameStart || path.compare(nameStart, std::string::npos, "..") == 0)
+		{
+			return find("", 0);
+		}
+		return find(path.data() + dot, path.size() - dot);
+	}
+
+	const ImageCodec* ImageCodecRegistry::find(const char* extension, size_t size) const
+	{
+		// Latest registration wins, so a specialised backend can override a built-in one. Compared in place,
+		// as this runs for every conversion
+		for (auto it = extensions_.rbegin(); it != extensions_.rend(); ++it)
+		{
+			const std::string& known = it->first;
+			bool same = known.size() == size;
+			for (size_t i = 0; same && i < size; i++)
+			{
+				same = std::tolower(static_cast<unsigned char>(extension[i])) == known[i];
+			}
+			if (same)
+			{
+				return it->second;
+			}
+		}
+		return nullptr;
+	}
+}
@@ -0,0 +1,130 @@
+#include "SoundImageConverter/MappedFile.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SoundImageConverter
+{
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+#ifdef _WIN32
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		// Files larger than the address space (32-bit builds) are read as a stream instead
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		file_ = file;
+		mapping_ = mapping;
+		data_ = static_cast<const uint8_t*>(view);
+		size_ = static_cast<size_t>(fileSize.QuadPart);
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (data_)
+		{
+			UnmapViewOfFile(data_);
+			CloseHandle(static_cast<HANDLE>(mapping_));
+			CloseHandle(static_cast<HANDLE>(file_));
+		}
+		data_ = nullptr;
+		size_ = 0;
+		file_ = nullptr;
+		mapping_ = nullptr;
+	}
+#else
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		bool mapped = openDescriptor(fd);
+		::close(fd); // The mapping keeps its own reference to the file
+		return mapped;
+	}
+
+	bool MappedFile::openDescriptor(int fd)
+	{
+		close();
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0 || static_cast<uint64_t>(st.st_size) > SIZE_MAX)
+		{
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+
+		// Conversions walk the file front to back exactly once
+		madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+		// Fewer TLB misses on large inputs, where the kernel can back the page cache with huge pages
+		if (st.st_size >= 64 * 1024 * 1024)
+		{
+			madvise(view, static_cast<size_t>(st.st_size), MADV_HUGEPAGE);
+		}
+#endif
+
+		data_ = static_cast<const uint8_t*>(view);
+		size_ = static_cast<size_t>(st.st_size);
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (data_)
+		{
+			munmap(const_cast<uint8_t*>(data_), size_);
+		}
+		data_ = nullptr;
+		size_ = 0;
+	}
+#endif
+}
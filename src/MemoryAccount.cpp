@@ -0,0 +1,172 @@
+#include "SoundImageConverter/MemoryAccount.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace SoundImageConverter
+{
+	namespace
+	{
+		// At the start of the cache line in front of every block from accountedAllocate
+		struct AccountHeader
+		{
+			MemoryAccount* account; // nullptr when allocated outside a MemoryScope
+			size_t size;
+			MemoryStage stage;
+		};
+
+		const size_t accountPrefix = cacheLineBytes; // Keeps the data cache line aligned
+
+		thread_local MemoryAccount* threadAccount = nullptr;
+		thread_local MemoryStage threadStage = MemoryStagePack;
+
+		void raise(std::atomic<size_t>& peak, size_t value)
+		{
+			size_t seen = peak.load(std::memory_order_relaxed);
+			while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+			{
+			}
+		}
+	}
+
+	const char* memoryStageName(MemoryStage stage)
+	{
+		switch (stage)
+		{
+		case MemoryStageRead:
+			return "read";
+		case MemoryStagePack:
+			return "pack";
+		case MemoryStageCodec:
+			return "codec";
+		case MemoryStageWrite:
+			return "write";
+		default:
+			return "?";
+		}
+	}
+
+	void MemoryAccount::add(MemoryStage stage, size_t bytes)
+	{
+		raise(peak_[stage], current_[stage].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+		raise(peak_[MemoryStageCount], current_[MemoryStageCount].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	}
+
+	void MemoryAccount::remove(MemoryStage stage, size_t bytes)
+	{
+		current_[stage].fetch_sub(bytes, std::memory_order_relaxed);
+		current_[MemoryStageCount].fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	void MemoryAccount::sampleResident()
+	{
+		size_t bytes = residentBytes();
+		resident_.store(bytes, std::memory_order_relaxed);
+		raise(peakResident_, bytes);
+	}
+
+	void MemoryAccount::resetPeaks()
+	{
+		for (size_t i = 0; i <= MemoryStageCount; i++)
+		{
+			peak_[i].store(current_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		peakResident_.store(resident_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	MemoryUsage MemoryAccount::usage() const
+	{
+		MemoryUsage usage;
+		for (size_t i = 0; i < MemoryStageCount; i++)
+		{
+			usage.stages[i].current = current_[i].load(std::memory_order_relaxed);
+			usage.stages[i].peak = peak_[i].load(std::memory_order_relaxed);
+		}
+		usage.total.current = current_[MemoryStageCount].load(std::memory_order_relaxed);
+		usage.total.peak = peak_[MemoryStageCount].load(std::memory_order_relaxed);
+		usage.residentBytes = resident_.load(std::memory_order_relaxed);
+		usage.peakResidentBytes = peakResident_.load(std::memory_order_relaxed);
+		return usage;
+	}
+
+	MemoryAccount* MemoryAccount::current()
+	{
+		return threadAccount;
+	}
+
+	MemoryStage MemoryAccount::currentStage()
+	{
+		return threadStage;
+	}
+
+	MemoryScope::MemoryScope(MemoryAccount* account, MemoryStage stage) : previousAccount_(threadAccount), previousStage_(threadStage)
+	{
+		threadAccount = account;
+		threadStage = stage;
+	}
+
+	MemoryScope::MemoryScope(MemoryStage stage) : previousAccount_(threadAccount), previousStage_(threadStage)
+	{
+		threadStage = stage;
+	}
+
+	MemoryScope::~MemoryScope()
+	{
+		threadAccount = previousAccount_;
+		threadStage = previousStage_;
+	}
+
+	size_t residentBytes()
+	{
+#ifdef __linux__
+		// "size resident shared ..." in pages. Read into a stack buffer, so sampling during a conversion allocates nothing
+		int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			return 0;
+		}
+		char text[128];
+		ssize_t got = read(fd, text, sizeof(text) - 1);
+		close(fd);
+		if (got <= 0)
+		{
+			return 0;
+		}
+		text[got] = '\0';
+		char* end = nullptr;
+		std::strtoull(text, &end, 10);
+		unsigned long long pages = std::strtoull(end, nullptr, 10);
+		return static_cast<size_t>(pages) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+		return 0;
+#endif
+	}
+
+	void* accountedAllocate(size_t size)
+	{
+		uint8_t* base = static_cast<uint8_t*>(::operator new(size + accountPrefix, std::align_val_t(cacheLineBytes)));
+		*reinterpret_cast<AccountHeader*>(base) = AccountHeader{ threadAccount, size, threadStage };
+		if (threadAccount)
+		{
+			threadAccount->add(threadStage, size);
+		}
+		return base + accountPrefix;
+	}
+
+	void accountedFree(void* data)
+	{
+		uint8_t* base = static_cast<uint8_t*>(data) - accountPrefix;
+		const AccountHeader& header = *reinterpret_cast<AccountHeader*>(base);
+		if (header.account)
+		{
+			header.account->remove(header.stage, header.size);
+		}
+		::operator delete(base, std::align_val_t(cacheLineBytes));
+	}
+}
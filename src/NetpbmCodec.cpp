@@ -0,0 +1,261 @@
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+
+namespace SoundImageConverter
+{
+	// Uncompressed Netpbm backend: PGM (P5) for grayscale, PPM (P6) for RGB, PAM (P7) for RGBA.
+	// .pgm and .ppm files only take their own layout and .pnm either of them, so RGBA is only written to .pam.
+	// Meant for transient intermediates where compression is pure overhead: rows are written
+	// straight from the caller's buffer, and a mapped input is read in place without a copy.
+	namespace
+	{
+		// Header tokenizer over a byte supplier, so the same code serves views and plain streams
+		class HeaderReader
+		{
+		public:
+			explicit HeaderReader(InputStream& in) : in_(in), view_(in.view()), viewSize_(in.viewSize()) {}
+
+			// Number of header bytes consumed so far
+			size_t consumed() const { return pos_; }
+
+			std::string token()
+			{
+				int c = next();
+				while (c == '#' || (c >= 0 && std::isspace(c)))
+				{
+					if (c == '#')
+					{
+						while (c >= 0 && c != '\n')
+						{
+							c = next();
+						}
+					}
+					c = next();
+				}
+				std::string text;
+				while (c >= 0 && !std::isspace(c) && c != '#')
+				{
+					text.push_back(static_cast<char>(c));
+					c = next();
+				}
+				last_ = c;
+				return text;
+			}
+
+			bool number(int& value)
+			{
+				std::string text = token();
+				if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != std::string::npos)
+				{
+					return false;
+				}
+				value = std::stoi(text);
+				return true;
+			}
+
+			// Byte that terminated the last token
+			int last() const { return last_; }
+
+			// Skips to just after the next newline (or does nothing if the last token ended on one)
+			void skipLine()
+			{
+				for (int c = last_; c >= 0 && c != '\n'; c = next())
+				{
+				}
+				last_ = '\n';
+			}
+
+		private:
+			int next()
+			{
+				if (view_)
+				{
+					return pos_ < viewSize_ ? view_[pos_++] : -1;
+				}
+				uint8_t byte;
+				if (in_.read(&byte, 1) != 1)
+				{
+					return -1;
+				}
+				pos_++;
+				return byte;
+			}
+
+			InputStream& in_;
+			const uint8_t* view_;
+			size_t viewSize_;
+			size_t pos_ = 0;
+			int last_ = -1;
+		};
+
+		class NetpbmSink : public ImageSink
+		{
+		public:
+			bool begin(OutputStream& out, const ImageInfo& info) override
+			{
+				char header[128];
+				int length;
+				if (info.channels == 1 || info.channels == 3)
+				{
+					length = std::snprintf(header, sizeof(header), "%s\n%d %d\n255\n", info.channels == 1 ? "P5" : "P6", info.width, info.height);
+				}
+				else if (info.channels == 4)
+				{
+					length = std::snprintf(header, sizeof(header), "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", info.width, info.height);
+				}
+				else
+				{
+					std::cerr << "Error: Unsupported channel count for Netpbm: " << info.channels << std::endl;
+					return false;
+				}
+				out_ = &out;
+				info_ = info;
+				return out.write(header, static_cast<size_t>(length));
+			}
+
+			bool writeRows(const uint8_t* rows, int count) override
+			{
+				return out_->write(rows, info_.rowBytes() * count);
+			}
+
+			bool finish() override
+			{
+				return true;
+			}
+
+		private:
+			OutputStream* out_ = nullptr;
+			ImageInfo info_;
+		};
+
+		class NetpbmSource : public ImageSource
+		{
+		public:
+			bool open(InputStream& in, ImageInfo& info) override
+			{
+				HeaderReader reader(in);
+				std::string magic = reader.token();
+				int maxValue = 0;
+				bool ok = false;
+
+				if (magic == "P5" || magic == "P6")
+				{
+					info.channels = (magic == "P5") ? 1 : 3;
+					// A single whitespace byte ends the header, already consumed by the tokenizer
+					ok = reader.number(info.width) && reader.number(info.height) && reader.number(maxValue);
+				}
+				else if (magic == "P7")
+				{
+					ok = true;
+					for (std::string key = reader.token(); !key.empty() && key != "ENDHDR"; key = reader.token())
+					{
+						if (key == "WIDTH") ok = reader.number(info.width);
+						else if (key == "HEIGHT") ok = reader.number(info.height);
+						else if (key == "DEPTH") ok = reader.number(info.channels);
+						else if (key == "MAXVAL") ok = reader.number(maxValue);
+						else if (key == "TUPLTYPE") reader.token();
+						if (!ok)
+						{
+							break;
+						}
+					}
+					// Raster starts after the newline that ends the ENDHDR line
+					reader.skipLine();
+				}
+
+				if (!ok || maxValue != 255 || info.width <= 0 || info.height <= 0 || info.channels < 1 || info.channels > 4)
+				{
+					std::cerr << "Error: Unsupported Netpbm file (8-bit P5/P6/P7 only)." << std::endl;
+					return false;
+				}
+
+				in_ = &in;
+				info_ = info;
+				nextRow_ = 0;
+				raster_ = nullptr;
+				if (in.view())
+				{
+					if (in.viewSize() - reader.consumed() < static_cast<uint64_t>(info.rowBytes()) * info.height)
+					{
+						std::cerr << "Error: Truncated Netpbm file." << std::endl;
+						return false;
+					}
+					raster_ = in.view() + reader.consumed();
+				}
+				return true;
+			}
+
+			const uint8_t* readRows(int count) override
+			{
+				if (count < 0 || nextRow_ + count > info_.height)
+				{
+					return nullptr;
+				}
+				size_t bytes = info_.rowBytes() * count;
+				const uint8_t* rows = nullptr;
+				if (raster_)
+				{
+					rows = raster_ + info_.rowBytes() * nextRow_; // Zero-copy: straight from the mapping
+				}
+				else
+				{
+					MemoryScope reading(MemoryStageRead); // The raster is the file as it is
+					rows_.resize(bytes);
+					size_t got = 0;
+					while (got < bytes)
+					{
+						size_t n = in_->read(rows_.data() + got, bytes - got);
+						if (n == 0)
+						{
+							std::cerr << "Error: Truncated Netpbm file." << std::endl;
+							return nullptr;
+						}
+						got += n;
+					}
+					rows = rows_.data();
+				}
+				nextRow_ += count;
+				return rows;
+			}
+
+		private:
+			InputStream* in_ = nullptr;
+			ImageInfo info_;
+			const uint8_t* raster_ = nullptr;
+			AlignedVector<uint8_t> rows_;
+			int nextRow_ = 0;
+		};
+
+		class NetpbmCodec : public ImageCodec
+		{
+		public:
+			const char* name() const override { return "Netpbm"; }
+			std::vector<std::string> extensions() const override { return { ".pam", ".ppm", ".pgm", ".pnm" }; }
+			uint32_t capabilities() const override
+			{
+				return ImageCapGray | ImageCapRGB | ImageCapRGBA | ImageCapDepth8 | ImageCapStreamingWrite | ImageCapStreamingRead;
+			}
+
+			uint32_t capabilitiesFor(const std::string& extension) const override
+			{
+				const uint32_t layouts = ImageCapGray | ImageCapRGB | ImageCapRGBA;
+				uint32_t layout = extension == ".pgm" ? ImageCapGray
+					: extension == ".ppm" ? ImageCapRGB
+					: extension == ".pnm" ? ImageCapGray | ImageCapRGB
+					: layouts;
+				return (capabilities() & ~layouts) | layout;
+			}
+
+			std::unique_ptr<ImageSink> createSink() const override { return std::unique_ptr<ImageSink>(new NetpbmSink()); }
+			std::unique_ptr<ImageSource> createSource() const override { return std::unique_ptr<ImageSource>(new NetpbmSource()); }
+		};
+	}
+
+	std::unique_ptr<ImageCodec> createNetpbmCodec()
+	{
+		return std::unique_ptr<ImageCodec>(new NetpbmCodec());
+	}
+}
@@ -0,0 +1,154 @@
+#include "SoundImageConverter/Packing.h"
+
+namespace SoundImageConverter
+{
+	namespace Packing
+	{
+		namespace
+		{
+			// Converts a 16-bit sample to an 8-bit pixel value
+			inline uint8_t sampleToPixel(int16_t sample)
+			{
+				return static_cast<uint8_t>((sample + 32768) / 256);
+			}
+
+			// Reverses the sampleToPixel scaling
+			inline int16_t pixelToSample(uint8_t pixel)
+			{
+				return static_cast<int16_t>(pixel * 256 - 32768);
+			}
+		}
+
+		void writeMetadata(const Metadata& metadata, uint8_t* row)
+		{
+			row[0] = (metadata.sampleRate >> 24) & 0xFF; // Sample rate: byte 1
+			row[1] = (metadata.sampleRate >> 16) & 0xFF; // Sample rate: byte 2
+			row[2] = (metadata.sampleRate >> 8) & 0xFF;  // Sample rate: byte 3
+			row[3] = metadata.sampleRate & 0xFF;         // Sample rate: byte 4
+			row[4] = static_cast<uint8_t>(metadata.channels); // Channels
+			row[5] = static_cast<uint8_t>(metadata.bitDepth); // Bit depth
+			row[6] = static_cast<uint8_t>(metadata.version);
+			row[7] = metadata.flags;
+			for (int i = 0; i < 8; i++)
+			{
+				row[8 + i] = static_cast<uint8_t>(metadata.frames >> (56 - 8 * i)); // Frame count, big-endian
+			}
+			for (int i = 0; i < 4; i++)
+			{
+				row[16 + i] = static_cast<uint8_t>(metadata.sourceFormat >> (24 - 8 * i)); // Original format, big-endian
+				row[20 + i] = static_cast<uint8_t>(metadata.originalSampleRate >> (24 - 8 * i)); // Original rate, big-endian
+			}
+		}
+
+		bool readMetadata(const uint8_t* row, size_t rowBytes, Metadata& metadata)
+		{
+			if (rowBytes < 6)
+			{
+				return false;
+			}
+			metadata.sampleRate = (static_cast<uint32_t>(row[0]) << 24) |
+								  (static_cast<uint32_t>(row[1]) << 16) |
+								  (static_cast<uint32_t>(row[2]) << 8) |
+								  static_cast<uint32_t>(row[3]);
+			metadata.channels = static_cast<int>(row[4]);
+			metadata.bitDepth = static_cast<int>(row[5]);
+			metadata.version = 0;
+			metadata.flags = 0;
+			metadata.frames = 0;
+			metadata.sourceFormat = 0;
+			metadata.originalSampleRate = 0;
+			if (rowBytes >= 24 && row[6] != 0)
+			{
+				// Legacy images have zeros here
+				metadata.version = static_cast<int>(row[6]);
+				metadata.flags = row[7];
+				for (int i = 0; i < 8; i++)
+				{
+					metadata.frames = (metadata.frames << 8) | row[8 + i];
+				}
+				for (int i = 0; i < 4; i++)
+				{
+					metadata.sourceFormat = (metadata.sourceFormat << 8) | row[16 + i];
+					metadata.originalSampleRate = (metadata.originalSampleRate << 8) | row[20 + i];
+				}
+				if (metadata.version > formatVersion)
+				{
+					return false;
+				}
+			}
+			return metadata.channels >= 1 && metadata.channels <= 2 && (metadata.bitDepth == 8 || metadata.bitDepth == 16);
+		}
+
+		void writeTrailer(uint32_t checksum, uint8_t* row)
+		{
+			row[0] = (checksum >> 24) & 0xFF;
+			row[1] = (checksum >> 16) & 0xFF;
+			row[2] = (checksum >> 8) & 0xFF;
+			row[3] = checksum & 0xFF;
+		}
+
+		uint32_t readTrailer(const uint8_t* row)
+		{
+			return (static_cast<uint32_t>(row[0]) << 24) | (static_cast<uint32_t>(row[1]) << 16) |
+				   (static_cast<uint32_t>(row[2]) << 8) | static_cast<uint32_t>(row[3]);
+		}
+
+		void packFrames(const int16_t* samples, size_t frames, int channels, int channelsPerPixel, uint8_t* pixels)
+		{
+			for (size_t i = 0; i < frames; i++)
+			{
+				if (channelsPerPixel == 1) // Mono Grayscale
+				{
+					*pixels++ = sampleToPixel(samples[i]);
+				}
+				else if (channelsPerPixel == 3) // Stereo RGB
+				{
+					*pixels++ = sampleToPixel(samples[i * 2]);     // Left channel (Red)
+					*pixels++ = sampleToPixel(samples[i * 2 + 1]); // Right channel (Green)
+					*pixels++ = 128; // Blue channel (constant value for variation)
+				}
+				else // 16-bit RGBA
+				{
+					int16_t left = (channels == 1) ? samples[i] : samples[i * 2];
+					*pixels++ = sampleToPixel(left); // Red channel
+					*pixels++ = sampleToPixel(left >> 1); // Green channel
+					if (channels == 2)
+					{
+						*pixels++ = sampleToPixel(samples[i * 2 + 1]); // Blue channel
+					}
+					else
+					{
+						*pixels++ = sampleToPixel(left >> 2); // Blue channel
+					}
+					*pixels++ = 255; // Alpha channel (fully opaque)
+				}
+			}
+		}
+
+		size_t unpackPixels(const uint8_t* pixels, size_t pixelCount, int channelsPerPixel, int channels, int16_t* samples)
+		{
+			size_t sampleIndex = 0;
+			for (size_t i = 0; i < pixelCount; i++, pixels += channelsPerPixel)
+			{
+				if (channelsPerPixel == 1) // 8-bit mono (grayscale)
+				{
+					samples[sampleIndex++] = pixelToSample(pixels[0]);
+				}
+				else if (channelsPerPixel == 3) // 8-bit stereo RGB
+				{
+					samples[sampleIndex++] = pixelToSample(pixels[0]); // Left channel (Red)
+					samples[sampleIndex++] = pixelToSample(pixels[1]); // Right channel (Green), Blue is constant
+				}
+				else // 16-bit mono/stereo RGBA
+				{
+					samples[sampleIndex++] = pixelToSample(pixels[0]); // Red channel, Green is half of Red
+					if (channels == 2)
+					{
+						samples[sampleIndex++] = pixelToSample(pixels[2]); // Blue channel
+					}
+				}
+			}
+			return sampleIndex;
+		}
+	}
+}
@@ -0,0 +1,1335 @@
+#include "SoundImageConverter/ConversionContext.h"
+#include "SoundImageConverter/ImageCodec.h"
+// stb's buffers come from the arena of the current conversion context, when there is one
+#define STBI_MALLOC(size) SoundImageConverter::contextAllocate(size)
+#define STBI_REALLOC(data, size) SoundImageConverter::contextReallocate(data, size)
+#define STBI_FREE(data) SoundImageConverter::contextFree(data)
+#define STBIW_MALLOC(size) SoundImageConverter::contextAllocate(size)
+#define STBIW_REALLOC(data, size) SoundImageConverter::contextReallocate(data, size)
+#define STBIW_FREE(data) SoundImageConverter::contextFree(data)
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace SoundImageConverter
+{
+	namespace
+	{
+		// zlib tables for the fixed Huffman code (RFC 1951 3.2.5), as in stbi_zlib_compress
+		const uint16_t lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259 };
+		const uint8_t lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		const uint16_t distanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+			4097, 6145, 8193, 12289, 16385, 24577, 32768 };
+		const uint8_t distanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		void putBigEndian(uint8_t* p, uint32_t value)
+		{
+			p[0] = static_cast<uint8_t>(value >> 24);
+			p[1] = static_cast<uint8_t>(value >> 16);
+			p[2] = static_cast<uint8_t>(value >> 8);
+			p[3] = static_cast<uint8_t>(value);
+		}
+
+		// A zlib stream written as it is fed, in IDAT chunks of about 64 KiB. The matcher is stbi_zlib_compress's
+		// (3-byte hash, the 16 most recent candidates, one step of lazy matching, fixed Huffman codes), over a
+		// 32 KiB sliding window instead of the whole image. Blocks end every 16 KiB of input, and a block that
+		// came out larger than its input is stored instead, where stb stores the whole stream or none of it.
+		// Memory stays the same whatever the length of the image
+		class IdatWriter
+		{
+		public:
+			void begin(OutputStream& out)
+			{
+				out_ = &out;
+				failed_ = false;
+				window_.resize(windowCapacity);
+				head_.assign(hashSize, 0);
+				prev_.resize(windowSize);
+				base_ = 0;
+				end_ = 0;
+				at_ = 0;
+				adler1_ = 1;
+				adler2_ = 0;
+				{
+					MemoryScope output(MemoryStageWrite); // The chunk on its way out
+					pending_.reserve(chunkBytes + 2 * blockBytes);
+				}
+				pending_.assign(8, 0); // Room for the chunk's length and type
+				pending_.push_back(0x78); // DEFLATE, 32 KiB window
+				pending_.push_back(0x5e);
+				bits_ = 0;
+				bitCount_ = 0;
+				beginBlock();
+			}
+
+			bool write(const uint8_t* data, size_t size)
+			{
+				updateAdler(data, size);
+				while (size > 0)
+				{
+					if (end_ == windowCapacity)
+					{
+						compress(false);
+						// Keep the window and the current block, which may still be stored
+						size_t keep = std::min(at_ - windowSize, static_cast<size_t>(blockStart_ - base_));
+						std::memmove(window_.data(), window_.data() + keep, end_ - keep);
+						base_ += keep;
+						end_ -= keep;
+						at_ -= keep;
+					}
+					size_t take = std::min(size, windowCapacity - end_);
+					std::memcpy(window_.data() + end_, data, take);
+					end_ += take;
+					data += take;
+					size -= take;
+				}
+				return !failed_;
+			}
+
+			bool finish()
+			{
+				compress(true);
+				endBlock();
+				putBits(1, 1); // An empty final block
+				putBits(1, 2);
+				putCode(256);
+				if (bitCount_ > 0)
+				{
+					putBits(0, 8 - bitCount_);
+				}
+				uint8_t adler[4];
+				putBigEndian(adler, adler2_ << 16 | adler1_);
+				pending_.insert(pending_.end(), adler, adler + 4);
+				flushChunk();
+				return !failed_;
+			}
+
+		private:
+			static const size_t windowSize = 32768;
+			static const size_t windowCapacity = 3 * windowSize;
+			static const size_t hashSize = 16384;
+			static const int maxChain = 16;
+			static const int maxMatch = 258;
+			static const uint64_t blockBytes = 16384;
+			static const size_t chunkBytes = 65536;
+
+			void updateAdler(const uint8_t* data, size_t size)
+			{
+				while (size > 0)
+				{
+					size_t count = std::min<size_t>(size, 5552);
+					for (size_t i = 0; i < count; i++)
+					{
+						adler1_ += data[i];
+						adler2_ += adler1_;
+					}
+					adler1_ %= 65521;
+					adler2_ %= 65521;
+					data += count;
+					size -= count;
+				}
+			}
+
+			void putBits(uint32_t code, int count)
+			{
+				bits_ |= code << bitCount_;
+				bitCount_ += count;
+				while (bitCount_ >= 8)
+				{
+					pending_.push_back(static_cast<uint8_t>(bits_));
+					bits_ >>= 8;
+					bitCount_ -= 8;
+				}
+			}
+
+			// A literal/length symbol in the fixed Huffman code
+			void putCode(int n)
+			{
+				if (n <= 143)
+				{
+					putBits(stbiw__zlib_bitrev(0x30 + n, 8), 8);
+				}
+				else if (n <= 255)
+				{
+					putBits(stbiw__zlib_bitrev(0x190 + n - 144, 9), 9);
+				}
+				else if (n <= 279)
+				{
+					putBits(stbiw__zlib_bitrev(n - 256, 7), 7);
+				}
+				else
+				{
+					putBits(stbiw__zlib_bitrev(0xc0 + n - 280, 8), 8);
+				}
+			}
+
+			void putMatch(int length, int distance)
+			{
+				int j = 0;
+				while (length > lengthBase[j + 1] - 1)
+				{
+					j++;
+				}
+				putCode(j + 257);
+				if (lengthExtra[j])
+				{
+					putBits(static_cast<uint32_t>(length - lengthBase[j]), lengthExtra[j]);
+				}
+				j = 0;
+				while (distance > distanceBase[j + 1] - 1)
+				{
+					j++;
+				}
+				putBits(stbiw__zlib_bitrev(j, 5), 5);
+				if (distanceExtra[j])
+				{
+					putBits(static_cast<uint32_t>(distance - distanceBase[j]), distanceExtra[j]);
+				}
+			}
+
+			void beginBlock()
+			{
+				blockStart_ = base_ + at_;
+				blockBytes_ = pending_.size();
+				blockBits_ = bits_;
+				blockBitCount_ = bitCount_;
+				putBits(0, 1); // Not final
+				putBits(1, 2); // Fixed Huffman codes
+			}
+
+			// Ends the current block, storing it instead if that is smaller, and sends full chunks
+			void endBlock()
+			{
+				putCode(256);
+				size_t length = static_cast<size_t>(base_ + at_ - blockStart_);
+				uint64_t written = (pending_.size() - blockBytes_) * 8 + bitCount_ - blockBitCount_;
+				uint64_t stored = 3 + (8 - (blockBitCount_ + 3) % 8) % 8 + 32 + 8 * static_cast<uint64_t>(length);
+				if (written > stored)
+				{
+					pending_.resize(blockBytes_);
+					bits_ = blockBits_;
+					bitCount_ = blockBitCount_;
+					putBits(0, 3); // Not final, stored
+					if (bitCount_ > 0)
+					{
+						putBits(0, 8 - bitCount_);
+					}
+					uint8_t header[4] = { static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+						static_cast<uint8_t>(~length), static_cast<uint8_t>(~length >> 8) };
+					pending_.insert(pending_.end(), header, header + 4);
+					const uint8_t* data = window_.data() + (blockStart_ - base_);
+					pending_.insert(pending_.end(), data, data + length);
+				}
+				if (pending_.size() >= chunkBytes)
+				{
+					flushChunk();
+				}
+			}
+
+			void flushChunk()
+			{
+				if (failed_ || pending_.size() == 8)
+				{
+					return;
+				}
+				uint32_t size = static_cast<uint32_t>(pending_.size() - 8);
+				putBigEndian(pending_.data(), size);
+				std::memcpy(pending_.data() + 4, "IDAT", 4);
+				uint8_t crc[4];
+				putBigEndian(crc, stbiw__crc32(pending_.data() + 4, static_cast<int>(size + 4)));
+				failed_ = !out_->write(pending_.data(), pending_.size()) || !out_->write(crc, 4);
+				pending_.resize(8);
+			}
+
+			// The most recent earlier position with the same hash as at, within the window, better than best
+			// (longer, or for lazy only strictly longer); returns its match length
+			int longestMatch(size_t at, int best, size_t& found)
+			{
+				uint64_t position = base_ + at;
+				int limit = static_cast<int>(std::min<size_t>(end_ - at, maxMatch));
+				uint64_t candidate = head_[stbiw__zhash(window_.data() + at) & (hashSize - 1)];
+				for (int chain = 0; candidate != 0 && chain < maxChain; chain++)
+				{
+					uint64_t earlier = candidate - 1;
+					if (position - earlier >= windowSize)
+					{
+						break;
+					}
+					int length = static_cast<int>(stbiw__zlib_countm(window_.data() + (earlier - base_), window_.data() + at, limit));
+					if (length > best)
+					{
+						best = length;
+						found = static_cast<size_t>(earlier - base_);
+					}
+					candidate = prev_[earlier & (windowSize - 1)];
+				}
+				return best;
+			}
+
+			// Compresses what is in the window; all of it at the end, else leaving enough for the longest match
+			void compress(bool last)
+			{
+				size_t stop = last ? (end_ >= 3 ? end_ - 3 : 0) : end_ - maxMatch - 1;
+				while (at_ < stop)
+				{
+					if (base_ + at_ - blockStart_ >= blockBytes)
+					{
+						endBlock();
+						beginBlock();
+					}
+					size_t found = 0;
+					int best = longestMatch(at_, 2, found);
+					unsigned h = stbiw__zhash(window_.data() + at_) & (hashSize - 1);
+					prev_[(base_ + at_) & (windowSize - 1)] = head_[h];
+					head_[h] = base_ + at_ + 1;
+					if (best >= 3)
+					{
+						// Lazy matching: a longer match at the next byte makes this one a literal
+						size_t next = 0;
+						if (longestMatch(at_ + 1, best, next) > best)
+						{
+							best = 0;
+						}
+					}
+					if (best >= 3)
+					{
+						putMatch(best, static_cast<int>(at_ - found));
+						at_ += static_cast<size_t>(best);
+					}
+					else
+					{
+						putCode(window_[at_]);
+						at_++;
+					}
+				}
+				if (last)
+				{
+					for (; at_ < end_; at_++)
+					{
+						putCode(window_[at_]);
+					}
+				}
+			}
+
+			OutputStream* out_ = nullptr;
+			bool failed_ = false;
+			AlignedVector<uint8_t> window_;
+			AlignedVector<uint64_t> head_; // Per hash, the last position with it plus one; 0 for none
+			AlignedVector<uint64_t> prev_; // Per position in the window, the one before it with the same hash, as head_
+			uint64_t base_ = 0; // Stream position of window_[0]
+			size_t end_ = 0;
+			size_t at_ = 0; // Next byte to compress
+			uint32_t adler1_ = 1;
+			uint32_t adler2_ = 0;
+			AlignedVector<uint8_t> pending_; // The chunk being filled, after 8 bytes for its header
+			uint32_t bits_ = 0;
+			int bitCount_ = 0;
+			uint64_t blockStart_ = 0; // Where the current block starts: stream position, and pending_ and the bit state
+			size_t blockBytes_ = 0;
+			uint32_t blockBits_ = 0;
+			int blockBitCount_ = 0;
+		};
+
+		// Filters each row as it arrives, with the filter stb_image_write would pick, and compresses it straight into
+		// the IDAT chunks: only the last row of the previous block is kept
+		class PngSink : public ImageSink
+		{
+		public:
+			bool begin(OutputStream& out, const ImageInfo& info) override
+			{
+				static const uint8_t colorTypes[5] = { 0, 0, 4, 2, 6 };
+				out_ = &out;
+				info_ = info;
+				rowsWritten_ = 0;
+				size_t rowBytes = info.rowBytes();
+				line_.resize(rowBytes + 1);
+				pair_.resize(2 * rowBytes);
+
+				uint8_t header[33] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+				putBigEndian(header + 8, 13);
+				std::memcpy(header + 12, "IHDR", 4);
+				putBigEndian(header + 16, static_cast<uint32_t>(info.width));
+				putBigEndian(header + 20, static_cast<uint32_t>(info.height));
+				header[24] = 8;
+				header[25] = colorTypes[info.channels];
+				putBigEndian(header + 29, stbiw__crc32(header + 12, 17));
+				if (!out.write(header, sizeof(header)))
+				{
+					return false;
+				}
+				idat_.begin(out);
+				return true;
+			}
+
+			bool writeRows(const uint8_t* rows, int count) override
+			{
+				size_t rowBytes = info_.rowBytes();
+				for (int j = 0; j < count; j++)
+				{
+					// stbiw__encode_png_line reads the row above just before the row; the first of a block is paired with the kept one
+					unsigned char* pixels = const_cast<unsigned char*>(rows);
+					int y = j;
+					if (j == 0 && rowsWritten_ > 0)
+					{
+						std::memcpy(pair_.data() + rowBytes, rows, rowBytes);
+						pixels = pair_.data();
+						y = 1;
+					}
+					filterRow(pixels, y);
+					if (!idat_.write(line_.data(), line_.size()))
+					{
+						return false;
+					}
+					rowsWritten_++;
+				}
+				if (count > 0)
+				{
+					std::memcpy(pair_.data(), rows + rowBytes * (count - 1), rowBytes);
+				}
+				return true;
+			}
+
+			bool finish() override
+			{
+				if (rowsWritten_ != info_.height)
+				{
+					std::cerr << "Error: PNG image is missing rows." << std::endl;
+					return false;
+				}
+				uint8_t trailer[12] = {};
+				std::memcpy(trailer + 4, "IEND", 4);
+				putBigEndian(trailer + 8, stbiw__crc32(trailer + 4, 4));
+				return idat_.finish() && out_->write(trailer, sizeof(trailer));
+			}
+
+		private:
+			// The filter with the smallest sum of absolute values, as stbi_write_png_to_mem; leaves the filter type and row in line_
+			void filterRow(unsigned char* pixels, int y)
+			{
+				signed char* filtered = reinterpret_cast<signed char*>(line_.data() + 1);
+				int width = info_.width;
+				int n = info_.channels;
+				int bestFilter = 0;
+				int bestSum = INT_MAX;
+				int filter;
+				for (filter = 0; filter < 5; filter++)
+				{
+					stbiw__encode_png_line(pixels, static_cast<int>(info_.rowBytes()), width, info_.height, y, n, filter, filtered);
+					int sum = 0;
+					for (int i = 0; i < width * n; i++)
+					{
+						sum += std::abs(filtered[i]);
+					}
+					if (sum < bestSum)
+					{
+						bestSum = sum;
+						bestFilter = filter;
+					}
+				}
+				if (bestFilter != filter - 1)
+				{
+					stbiw__encode_png_line(pixels, static_cast<int>(info_.rowBytes()), width, info_.height, y, n, bestFilter, filtered);
+				}
+				line_[0] = static_cast<uint8_t>(bestFilter);
+			}
+
+			OutputStream* out_ = nullptr;
+			ImageInfo info_;
+			int rowsWritten_ = 0;
+			IdatWriter idat_;
+			AlignedVector<uint8_t> line_; // Filter type and filtered row
+			AlignedVector<uint8_t> pair_; // The last row written, then room for the next
+		};
+
+		uint32_t getBigEndian(const uint8_t* p)
+		{
+			return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+		}
+
+		// Undoes one row's filter. out may overlap src if it starts no later; prior is the row above (zeros for the first).
+		// false for an unknown filter type
+		bool unfilterRow(uint8_t type, const uint8_t* src, uint8_t* out, const uint8_t* prior, size_t size, size_t bpp)
+		{
+			size_t i = 0;
+			switch (type)
+			{
+			case 0:
+				std::memmove(out, src, size);
+				return true;
+			case 1:
+				std::memmove(out, src, bpp);
+				for (i = bpp; i < size; i++)
+				{
+					out[i] = static_cast<uint8_t>(src[i] + out[i - bpp]);
+				}
+				return true;
+			case 2:
+				for (; i < size; i++)
+				{
+					out[i] = static_cast<uint8_t>(src[i] + prior[i]);
+				}
+				return true;
+			case 3:
+				for (; i < bpp; i++)
+				{
+					out[i] = static_cast<uint8_t>(src[i] + (prior[i] >> 1));
+				}
+				for (; i < size; i++)
+				{
+					out[i] = static_cast<uint8_t>(src[i] + ((out[i - bpp] + prior[i]) >> 1));
+				}
+				return true;
+			case 4:
+				for (; i < bpp; i++)
+				{
+					out[i] = static_cast<uint8_t>(src[i] + prior[i]); // The predictor of (0, up, 0) is up
+				}
+				for (; i < size; i++)
+				{
+					int a = out[i - bpp];
+					int b = prior[i];
+					int c = prior[i - bpp];
+					int pa = std::abs(b - c);
+					int pb = std::abs(a - c);
+					int pc = std::abs(a + b - 2 * c);
+					out[i] = static_cast<uint8_t>(src[i] + (pa <= pb && pa <= pc ? a : pb <= pc ? b : c));
+				}
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// Reads exactly size bytes unless the stream ends first
+		bool readFully(InputStream& in, uint8_t* data, size_t size)
+		{
+			while (size > 0)
+			{
+				size_t got = in.read(data, size);
+				if (got == 0)
+				{
+					return false;
+				}
+				data += got;
+				size -= got;
+			}
+			return true;
+		}
+
+		// The zlib data of a PNG's IDAT chunks, a piece at a time: in place from the file's view, or read from a
+		// stream into a 64 KiB buffer. Other chunks and the CRCs are skipped
+		class IdatReader
+		{
+		public:
+			// The chunks of file start at offset at
+			void open(const uint8_t* file, size_t size, size_t at)
+			{
+				in_ = nullptr;
+				file_ = file;
+				size_ = size;
+				at_ = at;
+			}
+
+			// The chunks are the rest of in, which must outlive the reader
+			void open(InputStream& in)
+			{
+				in_ = &in;
+				file_ = nullptr;
+				chunkLeft_ = 0;
+				started_ = false; // The IHDR chunk and its CRC have been read
+				buffer_.resize(pieceBytes);
+			}
+
+			void close()
+			{
+				buffer_ = AlignedVector<uint8_t>();
+			}
+
+			// The next piece of zlib data; false at IEND, or at the end of the input or a damaged chunk
+			bool next(const uint8_t*& data, size_t& size)
+			{
+				return in_ ? nextFromStream(data, size) : nextFromView(data, size);
+			}
+
+		private:
+			static const size_t pieceBytes = 65536;
+
+			bool nextFromView(const uint8_t*& data, size_t& size)
+			{
+				while (size_ - at_ >= 12)
+				{
+					uint32_t length = getBigEndian(file_ + at_);
+					const uint8_t* chunk = file_ + at_;
+					if (length > size_ - at_ - 12 || std::memcmp(chunk + 4, "IEND", 4) == 0)
+					{
+						return false;
+					}
+					at_ += 12 + static_cast<size_t>(length);
+					if (length > 0 && std::memcmp(chunk + 4, "IDAT", 4) == 0)
+					{
+						data = chunk + 8;
+						size = length;
+						return true;
+					}
+				}
+				return false;
+			}
+
+			bool nextFromStream(const uint8_t*& data, size_t& size)
+			{
+				while (chunkLeft_ == 0)
+				{
+					// The CRC of the chunk before, if there was one, then the next chunk's length and type
+					uint8_t header[12];
+					size_t crcBytes = started_ ? 4 : 0;
+					if (!readFully(*in_, header + 4 - crcBytes, 8 + crcBytes))
+					{
+						return false;
+					}
+					started_ = true;
+					chunkLeft_ = getBigEndian(header + 4);
+					if (std::memcmp(header + 8, "IEND", 4) == 0)
+					{
+						return false;
+					}
+					while (std::memcmp(header + 8, "IDAT", 4) != 0 && chunkLeft_ > 0)
+					{
+						size_t skip = static_cast<size_t>(std::min<uint64_t>(chunkLeft_, buffer_.size()));
+						if (!readFully(*in_, buffer_.data(), skip))
+						{
+							return false;
+						}
+						chunkLeft_ -= skip;
+					}
+				}
+				size = in_->read(buffer_.data(), static_cast<size_t>(std::min<uint64_t>(chunkLeft_, buffer_.size())));
+				chunkLeft_ -= size;
+				data = buffer_.data();
+				return size > 0;
+			}
+
+			InputStream* in_ = nullptr;
+			const uint8_t* file_ = nullptr;
+			size_t size_ = 0;
+			size_t at_ = 0;
+			uint64_t chunkLeft_ = 0; // Of the current chunk's data
+			bool started_ = false;
+			AlignedVector<uint8_t> buffer_;
+		};
+
+		// Inflates a zlib stream (RFC 1950, 1951) a piece at a time, keeping the last 32 KiB of output as the window.
+		// For images too large for stb_image's decoder, which inflates into one buffer of at most 2 GB.
+		// Huffman codes are decoded as in stb_image: a table for codes of up to 9 bits, a search by length for the rest
+		class Inflater
+		{
+		public:
+			// Reads the zlib header; false if it is not one PNG allows
+			bool start(IdatReader& reader)
+			{
+				reader_ = &reader;
+				next_ = end_ = nullptr;
+				bits_ = 0;
+				bitCount_ = 0;
+				paddingBits_ = 0;
+				written_ = 0;
+				copyLeft_ = 0;
+				storedLeft_ = 0;
+				block_ = NoBlock;
+				final_ = false;
+				failed_ = false;
+				uint32_t header = getBits(16);
+				uint32_t method = header & 0xFF;
+				uint32_t flags = header >> 8;
+				failed_ = failed_ || (method & 15) != 8 || (method >> 4) > 7 || (method << 8 | flags) % 31 != 0 || (flags & 0x20) != 0;
+				return !failed_;
+			}
+
+			// Fills data with the next size bytes of output; false if the stream is damaged or ends before that
+			bool read(uint8_t* data, size_t size)
+			{
+				size_t done = 0;
+				while (done < size && !failed_)
+				{
+					if (copyLeft_ > 0)
+					{
+						size_t count = std::min(copyLeft_, size - done);
+						for (size_t i = 0; i < count; i++)
+						{
+							put(data[done++] = window_[(written_ - distance_) & windowMask]);
+						}
+						copyLeft_ -= count;
+					}
+					else if (block_ == StoredBlock)
+					{
+						if (storedLeft_ == 0)
+						{
+							block_ = NoBlock;
+							continue;
+						}
+						put(data[done++] = static_cast<uint8_t>(getBits(8)));
+						storedLeft_--;
+					}
+					else if (block_ == HuffmanBlock)
+					{
+						int symbol = decode(literals_);
+						if (symbol < 0)
+						{
+							failed_ = true;
+						}
+						else if (symbol < 256)
+						{
+							put(data[done++] = static_cast<uint8_t>(symbol));
+						}
+						else if (symbol == 256)
+						{
+							block_ = NoBlock;
+						}
+						else
+						{
+							match(symbol - 257);
+						}
+					}
+					else if (final_)
+					{
+						failed_ = true; // The stream ends before size bytes
+					}
+					else
+					{
+						startBlock();
+					}
+				}
+				return !failed_ && done == size;
+			}
+
+		private:
+			static const size_t windowMask = 32767;
+			static const int fastBits = 9;
+
+			enum BlockType
+			{
+				NoBlock,
+				StoredBlock,
+				HuffmanBlock,
+			};
+
+			struct Huffman
+			{
+				uint16_t fast[1 << fastBits]; // (length << 9 | symbol) for the next fastBits bits, 0 for a longer code
+				uint16_t firstCode[16];
+				uint16_t firstSymbol[16];
+				int maxCode[17]; // Past the last code of each length, shifted up to 16 bits
+				uint8_t size[288];
+				uint16_t value[288];
+
+				// Canonical code from the code length of every symbol; false if the lengths are oversubscribed
+				bool build(const uint8_t* lengths, int count)
+				{
+					int sizes[16] = {};
+					int nextCode[16] = {};
+					std::memset(fast, 0, sizeof(fast));
+					for (int i = 0; i < count; i++)
+					{
+						sizes[lengths[i]]++;
+					}
+					sizes[0] = 0;
+					int code = 0;
+					int symbols = 0;
+					for (int i = 1; i < 16; i++)
+					{
+						if (sizes[i] > (1 << i))
+						{
+							return false;
+						}
+						nextCode[i] = code;
+						firstCode[i] = static_cast<uint16_t>(code);
+						firstSymbol[i] = static_cast<uint16_t>(symbols);
+						code += sizes[i];
+						if (sizes[i] > 0 && code - 1 >= (1 << i))
+						{
+							return false;
+						}
+						maxCode[i] = code << (16 - i);
+						code <<= 1;
+						symbols += sizes[i];
+					}
+					maxCode[16] = 0x10000;
+					for (int i = 0; i < count; i++)
+					{
+						int length = lengths[i];
+						if (length > 0)
+						{
+							int slot = nextCode[length] - firstCode[length] + firstSymbol[length];
+							size[slot] = static_cast<uint8_t>(length);
+							value[slot] = static_cast<uint16_t>(i);
+							if (length <= fastBits)
+							{
+								for (int j = reverseBits(nextCode[length], length); j < (1 << fastBits); j += 1 << length)
+								{
+									fast[j] = static_cast<uint16_t>(length << 9 | i);
+								}
+							}
+							nextCode[length]++;
+						}
+					}
+					return true;
+				}
+			};
+
+			static int reverseBits(int code, int length)
+			{
+				int reversed = 0;
+				for (int i = 0; i < length; i++, code >>= 1)
+				{
+					reversed = reversed << 1 | (code & 1);
+				}
+				return reversed;
+			}
+
+			// At least 57 bits in bits_; past the end of the data the bits are zeros, and using them is an error
+			void refill()
+			{
+				while (bitCount_ <= 56)
+				{
+					if (next_ == end_)
+					{
+						size_t size = 0;
+						if (!reader_->next(next_, size))
+						{
+							next_ = end_ = nullptr;
+							bitCount_ += 8;
+							paddingBits_ += 8;
+							continue;
+						}
+						end_ = next_ + size;
+					}
+					bits_ |= static_cast<uint64_t>(*next_++) << bitCount_;
+					bitCount_ += 8;
+				}
+			}
+
+			void consume(int count)
+			{
+				bits_ >>= count;
+				bitCount_ -= count;
+				failed_ = failed_ || bitCount_ < paddingBits_;
+			}
+
+			uint32_t getBits(int count)
+			{
+				if (bitCount_ < count)
+				{
+					refill();
+				}
+				uint32_t value = static_cast<uint32_t>(bits_ & ((1ull << count) - 1));
+				consume(count);
+				return value;
+			}
+
+			// The next symbol, -1 for a code that is not in the table
+			int decode(const Huffman& huffman)
+			{
+				if (bitCount_ < 16)
+				{
+					refill();
+				}
+				int fast = huffman.fast[bits_ & ((1 << fastBits) - 1)];
+				if (fast != 0)
+				{
+					consume(fast >> 9);
+					return fast & 511;
+				}
+				int code = reverseBits(static_cast<int>(bits_ & 0xFFFF), 16);
+				int length = fastBits + 1;
+				while (code >= huffman.maxCode[length])
+				{
+					length++;
+				}
+				if (length >= 16)
+				{
+					return -1;
+				}
+				int slot = (code >> (16 - length)) - huffman.firstCode[length] + huffman.firstSymbol[length];
+				if (slot >= 288 || huffman.size[slot] != length)
+				{
+					return -1;
+				}
+				consume(length);
+				return huffman.value[slot];
+			}
+
+			void put(uint8_t value)
+			{
+				window_[written_++ & windowMask] = value;
+			}
+
+			// A length symbol (less 257) and the distance after it
+			void match(int symbol)
+			{
+				if (symbol >= 29)
+				{
+					failed_ = true;
+					return;
+				}
+				size_t length = lengthBase[symbol] + getBits(lengthExtra[symbol]);
+				int code = decode(distances_);
+				if (code < 0 || code >= 30)
+				{
+					failed_ = true;
+					return;
+				}
+				distance_ = distanceBase[code] + getBits(distanceExtra[code]);
+				failed_ = failed_ || distance_ > written_;
+				copyLeft_ = length;
+			}
+
+			void startBlock()
+			{
+				final_ = getBits(1) != 0;
+				uint32_t type = getBits(2);
+				if (type == 0)
+				{
+					consume(bitCount_ & 7); // To the byte boundary
+					uint32_t length = getBits(16);
+					uint32_t complement = getBits(16);
+					failed_ = failed_ || length != (~complement & 0xFFFF);
+					storedLeft_ = length;
+					block_ = StoredBlock;
+				}
+				else if (type == 1)
+				{
+					uint8_t lengths[288 + 32];
+					std::memset(lengths, 8, 144);
+					std::memset(lengths + 144, 9, 112);
+					std::memset(lengths + 256, 7, 24);
+					std::memset(lengths + 280, 8, 8);
+					std::memset(lengths + 288, 5, 32);
+					literals_.build(lengths, 288);
+					distances_.build(lengths + 288, 32);
+					block_ = HuffmanBlock;
+				}
+				else if (type == 2 && readCodes())
+				{
+					block_ = HuffmanBlock;
+				}
+				else
+				{
+					failed_ = true;
+				}
+			}
+
+			// The code lengths of a dynamic block, themselves Huffman coded
+			bool readCodes()
+			{
+				static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+				int literalCount = static_cast<int>(getBits(5)) + 257;
+				int distanceCount = static_cast<int>(getBits(5)) + 1;
+				int codeLengthCount = static_cast<int>(getBits(4)) + 4;
+				uint8_t codeLengths[19] = {};
+				for (int i = 0; i < codeLengthCount; i++)
+				{
+					codeLengths[order[i]] = static_cast<uint8_t>(getBits(3));
+				}
+				Huffman& lengthCode = distances_; // Free until the distance code is built
+				if (!lengthCode.build(codeLengths, 19))
+				{
+					return false;
+				}
+				uint8_t lengths[288 + 32];
+				int count = 0;
+				while (count < literalCount + distanceCount && !failed_)
+				{
+					int symbol = decode(lengthCode);
+					if (symbol >= 0 && symbol < 16)
+					{
+						lengths[count++] = static_cast<uint8_t>(symbol);
+						continue;
+					}
+					int repeat = 0; // 16 repeats the previous length, 17 and 18 give runs of zeros
+					uint8_t value = 0;
+					if (symbol == 16 && count > 0)
+					{
+						repeat = 3 + static_cast<int>(getBits(2));
+						value = lengths[count - 1];
+					}
+					else if (symbol == 17)
+					{
+						repeat = 3 + static_cast<int>(getBits(3));
+					}
+					else if (symbol == 18)
+					{
+						repeat = 11 + static_cast<int>(getBits(7));
+					}
+					if (repeat == 0 || count + repeat > literalCount + distanceCount)
+					{
+						return false;
+					}
+					std::memset(lengths + count, value, repeat);
+					count += repeat;
+				}
+				return !failed_ && literals_.build(lengths, literalCount) && distances_.build(lengths + literalCount, distanceCount);
+			}
+
+			IdatReader* reader_ = nullptr;
+			const uint8_t* next_ = nullptr; // Of the current piece of input
+			const uint8_t* end_ = nullptr;
+			uint64_t bits_ = 0; // Least significant first
+			int bitCount_ = 0;
+			int paddingBits_ = 0; // Zeros added at the top of bits_ after the end of the data
+			uint64_t written_ = 0;
+			uint8_t window_[windowMask + 1];
+			size_t copyLeft_ = 0; // Of the current match
+			uint64_t distance_ = 0;
+			uint32_t storedLeft_ = 0;
+			BlockType block_ = NoBlock;
+			bool final_ = false;
+			bool failed_ = false;
+			Huffman literals_;
+			Huffman distances_;
+		};
+
+		// The image is inflated whole by stb_image's zlib decoder, into one buffer that then also holds the pixels: rows
+		// are unfiltered as they are read, front to back, each moved down over the filter bytes, so they end up tightly
+		// packed where stb_image would have kept the filtered and the final image at once. Callers may overwrite the rows
+		// they have read (readRowsInPlace). Interlaced, palette and 16-bit files, which sic does not write, go through stbi_load.
+		// An image past stb_image's limits (2 GB filtered, or a 2 GB file) is inflated a block of rows at a time instead,
+		// from the view or straight from the stream, so its memory does not grow with its height
+		class PngSource : public ImageSource
+		{
+		public:
+			~PngSource() override
+			{
+				close();
+			}
+
+			bool open(InputStream& in, ImageInfo& info) override
+			{
+				close();
+				ConversionContext* context = ConversionContext::current();
+				const uint8_t* file = in.view();
+				size_t fileSize = in.viewSize();
+				if (!file)
+				{
+					readAll(in, context, headerBytes);
+					if (parseHeader(file_.data(), file_.size(), info) && tooLarge(info, 0))
+					{
+						release(file_, context);
+						MemoryScope reading(MemoryStageRead);
+						idat_.open(in);
+						return stream(info);
+					}
+					readAll(in, context, SIZE_MAX);
+					file = file_.data();
+					fileSize = file_.size();
+				}
+				if (parseHeader(file, fileSize, info) && tooLarge(info, fileSize))
+				{
+					idat_.open(file, fileSize, headerBytes); // file_ is kept until close() if that is the file
+					return stream(info);
+				}
+				if (fileSize > INT_MAX)
+				{
+					std::cerr << "Error: PNG file too large." << std::endl;
+					release(file_, context);
+					return false;
+				}
+				bool ok = parse(file, fileSize, info) ? inflate(file, info, context) : load(file, fileSize, info);
+				release(file_, context);
+				release(compressed_, context);
+				if (ok)
+				{
+					info_ = info;
+					nextRow_ = 0;
+					previous_.assign(info.rowBytes(), 0); // The first row's prior
+				}
+				return ok;
+			}
+
+			const uint8_t* readRows(int count) override
+			{
+				return streaming_ ? inflateRows(count) : readRowsInPlace(count);
+			}
+
+			uint8_t* readRowsInPlace(int count) override
+			{
+				if (streaming_ || (!image_ && pixels_.empty()) || count < 0 || nextRow_ + count > info_.height)
+				{
+					return nullptr;
+				}
+				size_t rowBytes = info_.rowBytes();
+				uint8_t* rows = (image_ ? image_ : pixels_.data()) + rowBytes * nextRow_;
+				if (!image_)
+				{
+					for (int y = nextRow_; y < nextRow_ + count; y++)
+					{
+						// The row above may have been overwritten by the caller, the kept copy has it
+						uint8_t* out = pixels_.data() + rowBytes * y;
+						const uint8_t* filtered = pixels_.data() + (rowBytes + 1) * y;
+						const uint8_t* prior = y == nextRow_ ? previous_.data() : out - rowBytes;
+						if (!unfilterRow(filtered[0], filtered + 1, out, prior, rowBytes, static_cast<size_t>(info_.channels)))
+						{
+							std::cerr << "Error: Could not decode PNG: bad filter type" << std::endl;
+							return nullptr;
+						}
+					}
+				}
+				nextRow_ += count;
+				if (count > 0)
+				{
+					std::memcpy(previous_.data(), rows + rowBytes * (count - 1), rowBytes);
+				}
+				return rows;
+			}
+
+			bool readsInPlace() const override
+			{
+				return !streaming_;
+			}
+
+			void close() override
+			{
+				ConversionContext* context = ConversionContext::current();
+				stbi_image_free(image_);
+				image_ = nullptr;
+				release(pixels_, context);
+				release(rows_, context);
+				release(file_, context);
+				idat_.close();
+				streaming_ = false;
+			}
+
+		private:
+			static const size_t readBytes = 65536;
+			static const size_t headerBytes = 33; // Signature and IHDR chunk
+
+			// Too large for stbi_zlib_decode_buffer and stbi_load_from_memory, which take and return int sizes
+			static bool tooLarge(const ImageInfo& info, size_t fileSize)
+			{
+				return (static_cast<double>(info.rowBytes()) + 1) * info.height > INT_MAX || fileSize > INT_MAX;
+			}
+
+			bool stream(const ImageInfo& info)
+			{
+				if (!inflater_.start(idat_))
+				{
+					std::cerr << "Error: Could not decode PNG: corrupt image data" << std::endl;
+					return false;
+				}
+				streaming_ = true;
+				info_ = info;
+				nextRow_ = 0;
+				previous_.assign(info.rowBytes(), 0);
+				return true;
+			}
+
+			// Inflates and unfilters the next count rows into rows_
+			const uint8_t* inflateRows(int count)
+			{
+				if (count < 0 || nextRow_ + count > info_.height)
+				{
+					return nullptr;
+				}
+				size_t rowBytes = info_.rowBytes();
+				{
+					MemoryScope decoding(MemoryStageCodec);
+					fitBuffer(rows_, rowBytes * count, ConversionContext::current());
+				}
+				for (int y = 0; y < count; y++)
+				{
+					uint8_t* out = rows_.data() + rowBytes * y;
+					const uint8_t* prior = y == 0 ? previous_.data() : out - rowBytes;
+					uint8_t filter = 0;
+					if (!inflater_.read(&filter, 1) || !inflater_.read(out, rowBytes))
+					{
+						std::cerr << "Error: Could not decode PNG: corrupt image data" << std::endl;
+						return nullptr;
+					}
+					if (!unfilterRow(filter, out, out, prior, rowBytes, static_cast<size_t>(info_.channels)))
+					{
+						std::cerr << "Error: Could not decode PNG: bad filter type" << std::endl;
+						return nullptr;
+					}
+				}
+				nextRow_ += count;
+				if (count > 0)
+				{
+					std::memcpy(previous_.data(), rows_.data() + rowBytes * (count - 1), rowBytes);
+				}
+				return rows_.data();
+			}
+
+			// Back to the context for the next image, else freed now rather than when the source goes
+			static void release(AlignedVector<uint8_t>& buffer, ConversionContext* context)
+			{
+				if (context)
+				{
+					context->give(std::move(buffer));
+				}
+				buffer = AlignedVector<uint8_t>();
+			}
+
+			// A stream without a view is read into file_, sized for the last one: up to limit bytes in all, more of it
+			// after what an earlier call read
+			void readAll(InputStream& in, ConversionContext* context, size_t limit)
+			{
+				MemoryScope reading(MemoryStageRead);
+				size_t size = file_.size();
+				if (size == 0)
+				{
+					reserveBuffer(file_, lastFileBytes_, context);
+				}
+				while (size < limit)
+				{
+					if (file_.size() - size < readBytes)
+					{
+						file_.resize(std::max(file_.capacity(), size + readBytes));
+					}
+					size_t got = in.read(file_.data() + size, std::min(file_.size(), limit) - size);
+					if (got == 0)
+					{
+						break;
+					}
+					size += got;
+				}
+				file_.resize(size);
+				lastFileBytes_ = size;
+			}
+
+			// True for the signature and IHDR of an 8-bit, non-interlaced gray, gray-alpha, RGB or RGBA file; sets info
+			static bool parseHeader(const uint8_t* file, size_t size, ImageInfo& info)
+			{
+				static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+				static const int channelsOfType[7] = { 1, 0, 3, 0, 2, 0, 4 };
+				if (size < headerBytes || std::memcmp(file, signature, 8) != 0 || getBigEndian(file + 8) != 13 || std::memcmp(file + 12, "IHDR", 4) != 0)
+				{
+					return false;
+				}
+				const uint8_t* header = file + 16;
+				uint32_t width = getBigEndian(header);
+				uint32_t height = getBigEndian(header + 4);
+				if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX || header[8] != 8 || header[9] > 6
+					|| channelsOfType[header[9]] == 0 || header[10] != 0 || header[11] != 0 || header[12] != 0)
+				{
+					return false;
+				}
+				info.width = static_cast<int>(width);
+				info.height = static_cast<int>(height);
+				info.channels = channelsOfType[header[9]];
+				return true;
+			}
+
+			// As parseHeader, for a whole file whose chunks are all there; sets idatBytes_
+			bool parse(const uint8_t* file, size_t size, ImageInfo& info)
+			{
+				if (!parseHeader(file, size, info))
+				{
+					return false;
+				}
+				idatBytes_ = 0;
+				for (size_t at = headerBytes; size - at >= 12; )
+				{
+					uint32_t length = getBigEndian(file + at);
+					if (length > size - at - 12)
+					{
+						return false;
+					}
+					if (std::memcmp(file + at + 4, "IDAT", 4) == 0)
+					{
+						idatBytes_ += length;
+					}
+					else if (std::memcmp(file + at + 4, "IEND", 4) == 0)
+					{
+						return idatBytes_ > 0;
+					}
+					at += 12 + static_cast<size_t>(length);
+				}
+				return false;
+			}
+
+			// Gathers the IDAT data (in place when the file is file_, which then goes in front of the zlib stream)
+			// and inflates it into pixels_
+			bool inflate(const uint8_t* file, const ImageInfo& info, ConversionContext* context)
+			{
+				size_t filteredBytes = (info.rowBytes() + 1) * static_cast<size_t>(info.height); // At most INT_MAX, see tooLarge
+				uint8_t* compressed = file == file_.data() ? file_.data() : nullptr;
+				if (!compressed)
+				{
+					MemoryScope reading(MemoryStageRead);
+					fitBuffer(compressed_, idatBytes_, context);
+					compressed = compressed_.data();
+				}
+				size_t gathered = 0;
+				for (size_t at = headerBytes; gathered < idatBytes_; )
+				{
+					uint32_t length = getBigEndian(file + at);
+					if (std::memcmp(file + at + 4, "IDAT", 4) == 0)
+					{
+						std::memmove(compressed + gathered, file + at + 8, length);
+						gathered += length;
+					}
+					at += 12 + static_cast<size_t>(length);
+				}
+				fitBuffer(pixels_, filteredBytes, context);
+				int inflated = stbi_zlib_decode_buffer(reinterpret_cast<char*>(pixels_.data()), static_cast<int>(pixels_.size()),
+					reinterpret_cast<const char*>(compressed), static_cast<int>(idatBytes_));
+				if (inflated != static_cast<int>(pixels_.size()))
+				{
+					std::cerr << "Error: Could not decode PNG: corrupt image data" << std::endl;
+					release(pixels_, context);
+					return false;
+				}
+				return true;
+			}
+
+			bool load(const uint8_t* file, size_t size, ImageInfo& info)
+			{
+				image_ = stbi_load_from_memory(file, static_cast<int>(size), &info.width, &info.height, &info.channels, 0);
+				if (!image_)
+				{
+					std::cerr << "Error: Could not decode PNG: " << stbi_failure_reason() << std::endl;
+					return false;
+				}
+				return true;
+			}
+
+			ImageInfo info_;
+			int nextRow_ = 0;
+			unsigned char* image_ = nullptr; // From stbi_load, else the rows are in pixels_
+			AlignedVector<uint8_t> pixels_; // The filtered image, turning into the packed rows as they are read
+			AlignedVector<uint8_t> file_;
+			AlignedVector<uint8_t> compressed_;
+			AlignedVector<uint8_t> previous_; // The last row read, zeros before the first
+			AlignedVector<uint8_t> rows_; // The rows last inflated, when streaming
+			bool streaming_ = false;
+			IdatReader idat_;
+			Inflater inflater_;
+			size_t idatBytes_ = 0;
+			size_t lastFileBytes_ = 0;
+		};
+
+		class PngCodec : public ImageCodec
+		{
+		public:
+			const char* name() const override { return "PNG"; }
+			std::vector<std::string> extensions() const override { return { ".png" }; }
+			uint32_t capabilities() const override
+			{
+				return ImageCapGray | ImageCapRGB | ImageCapRGBA | ImageCapDepth8 | ImageCapStreamingWrite | ImageCapInPlaceRead;
+			}
+
+			std::unique_ptr<ImageSink> createSink() const override { return std::unique_ptr<ImageSink>(new PngSink()); }
+			std::unique_ptr<ImageSource> createSource() const override { return std::unique_ptr<ImageSource>(new PngSource()); }
+		};
+	}
+
+	std::unique_ptr<ImageCodec> createPngCodec()
+	{
+		return std::unique_ptr<ImageCodec>(new PngCodec());
+	}
+}
@@ -0,0 +1,357 @@
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/ConversionContext.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace SoundImageConverter
+{
+	// Minimal QOI ("Quite OK Image") backend.
+	// Single pass, O(n), no entropy coder: much cheaper than PNG's DEFLATE.
+	// Both directions stream, so memory stays at one block of rows plus a small I/O buffer.
+	namespace
+	{
+		const uint8_t OP_INDEX = 0x00; // 00xxxxxx
+		const uint8_t OP_DIFF = 0x40;  // 01xxxxxx
+		const uint8_t OP_LUMA = 0x80;  // 10xxxxxx
+		const uint8_t OP_RUN = 0xc0;   // 11xxxxxx
+		const uint8_t OP_RGB = 0xfe;
+		const uint8_t OP_RGBA = 0xff;
+		const uint8_t MASK_2 = 0xc0;
+
+		const size_t headerSize = 14;
+		const uint8_t endMarker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+		const size_t ioChunk = 1 << 16;
+
+		struct Pixel
+		{
+			uint8_t r, g, b, a;
+		};
+
+		inline int hashPixel(const Pixel& px)
+		{
+			return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+		}
+
+		inline bool samePixel(const Pixel& x, const Pixel& y)
+		{
+			return x.r == y.r && x.g == y.g && x.b == y.b && x.a == y.a;
+		}
+
+		inline void put32(AlignedVector<uint8_t>& out, uint32_t v)
+		{
+			out.push_back(static_cast<uint8_t>(v >> 24));
+			out.push_back(static_cast<uint8_t>(v >> 16));
+			out.push_back(static_cast<uint8_t>(v >> 8));
+			out.push_back(static_cast<uint8_t>(v));
+		}
+
+		inline uint32_t get32(const uint8_t* p)
+		{
+			return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+				   (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+		}
+
+		class QoiSink : public ImageSink
+		{
+		public:
+			bool begin(OutputStream& out, const ImageInfo& info) override
+			{
+				if (info.width <= 0 || info.height <= 0 || (info.channels != 3 && info.channels != 4))
+				{
+					std::cerr << "Error: QOI supports only RGB and RGBA images (got " << info.channels << " channels)." << std::endl;
+					return false;
+				}
+				out_ = &out;
+				info_ = info;
+				std::memset(index_, 0, sizeof(index_));
+				prev_ = { 0, 0, 0, 255 };
+				run_ = 0;
+
+				buffer_.clear();
+				{
+					MemoryScope output(MemoryStageWrite); // Encoded bytes on their way out
+					buffer_.reserve(ioChunk + 16);
+				}
+				buffer_.insert(buffer_.end(), { 'q', 'o', 'i', 'f' });
+				put32(buffer_, static_cast<uint32_t>(info.width));
+				put32(buffer_, static_cast<uint32_t>(info.height));
+				buffer_.push_back(static_cast<uint8_t>(info.channels));
+				buffer_.push_back(0); // sRGB with linear alpha
+				return true;
+			}
+
+			bool writeRows(const uint8_t* rows, int count) override
+			{
+				const int channels = info_.channels;
+				size_t totalBytes = info_.rowBytes() * count;
+				for (size_t offset = 0; offset < totalBytes; offset += channels)
+				{
+					Pixel px = { rows[offset], rows[offset + 1], rows[offset + 2], channels == 4 ? rows[offset + 3] : prev_.a };
+
+					if (samePixel(px, prev_))
+					{
+						run_++;
+						if (run_ == 62)
+						{
+							flushRun();
+						}
+					}
+					else
+					{
+						flushRun();
+
+						int hash = hashPixel(px);
+						if (samePixel(index_[hash], px))
+						{
+							buffer_.push_back(static_cast<uint8_t>(OP_INDEX | hash));
+						}
+						else
+						{
+							index_[hash] = px;
+
+							if (px.a == prev_.a)
+							{
+								int8_t vr = static_cast<int8_t>(px.r - prev_.r);
+								int8_t vg = static_cast<int8_t>(px.g - prev_.g);
+								int8_t vb = static_cast<int8_t>(px.b - prev_.b);
+								int8_t vgr = static_cast<int8_t>(vr - vg);
+								int8_t vgb = static_cast<int8_t>(vb - vg);
+
+								if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+								{
+									buffer_.push_back(static_cast<uint8_t>(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+								}
+								else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8)
+								{
+									buffer_.push_back(static_cast<uint8_t>(OP_LUMA | (vg + 32)));
+									buffer_.push_back(static_cast<uint8_t>((vgr + 8) << 4 | (vgb + 8)));
+								}
+								else
+								{
+									buffer_.insert(buffer_.end(), { OP_RGB, px.r, px.g, px.b });
+								}
+							}
+							else
+							{
+								buffer_.insert(buffer_.end(), { OP_RGBA, px.r, px.g, px.b, px.a });
+							}
+						}
+					}
+					prev_ = px;
+
+					if (buffer_.size() >= ioChunk && !flushBuffer())
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+			bool finish() override
+			{
+				flushRun();
+				buffer_.insert(buffer_.end(), endMarker, endMarker + sizeof(endMarker));
+				return flushBuffer();
+			}
+
+		private:
+			void flushRun()
+			{
+				if (run_ > 0)
+				{
+					buffer_.push_back(static_cast<uint8_t>(OP_RUN | (run_ - 1)));
+					run_ = 0;
+				}
+			}
+
+			bool flushBuffer()
+			{
+				bool ok = out_->write(buffer_.data(), buffer_.size());
+				buffer_.clear();
+				return ok;
+			}
+
+			OutputStream* out_ = nullptr;
+			ImageInfo info_;
+			Pixel index_[64];
+			Pixel prev_ = { 0, 0, 0, 255 };
+			int run_ = 0;
+			AlignedVector<uint8_t> buffer_;
+		};
+
+		class QoiSource : public ImageSource
+		{
+		public:
+			bool open(InputStream& in, ImageInfo& info) override
+			{
+				in_ = &in;
+				data_ = in.view();
+				dataSize_ = in.viewSize();
+				pos_ = 0;
+				if (!data_)
+				{
+					MemoryScope reading(MemoryStageRead); // The file, a chunk at a time
+					buffer_.resize(ioChunk);
+					data_ = buffer_.data();
+					dataSize_ = 0;
+				}
+
+				if (!ensure(headerSize) || std::memcmp(data_ + pos_, "qoif", 4) != 0)
+				{
+					std::cerr << "Error: Not a QOI file." << std::endl;
+					return false;
+				}
+
+				uint32_t w = get32(data_ + pos_ + 4);
+				uint32_t h = get32(data_ + pos_ + 8);
+				int channels = data_[pos_ + 12];
+				if (w == 0 || h == 0 || w > 0x7fffffffu || h > 0x7fffffffu || (channels != 3 && channels != 4))
+				{
+					std::cerr << "Error: Invalid QOI header." << std::endl;
+					return false;
+				}
+				pos_ += headerSize;
+
+				info.width = static_cast<int>(w);
+				info.height = static_cast<int>(h);
+				info.channels = channels;
+				info_ = info;
+				rowsLeft_ = info.height;
+
+				std::memset(index_, 0, sizeof(index_));
+				px_ = { 0, 0, 0, 255 };
+				run_ = 0;
+				return true;
+			}
+
+			const uint8_t* readRows(int count) override
+			{
+				if (count < 0 || count > rowsLeft_)
+				{
+					return nullptr;
+				}
+				rowsLeft_ -= count;
+
+				const int channels = info_.channels;
+				size_t totalBytes = info_.rowBytes() * count;
+				rows_.resize(totalBytes);
+				for (size_t offset = 0; offset < totalBytes; offset += channels)
+				{
+					if (run_ > 0)
+					{
+						run_--;
+					}
+					else if (ensure(5)) // Longest op; a truncated stream repeats the last pixel like the reference decoder
+					{
+						uint8_t b1 = data_[pos_++];
+						if (b1 == OP_RGB)
+						{
+							px_.r = data_[pos_++];
+							px_.g = data_[pos_++];
+							px_.b = data_[pos_++];
+						}
+						else if (b1 == OP_RGBA)
+						{
+							px_.r = data_[pos_++];
+							px_.g = data_[pos_++];
+							px_.b = data_[pos_++];
+							px_.a = data_[pos_++];
+						}
+						else if ((b1 & MASK_2) == OP_INDEX)
+						{
+							px_ = index_[b1];
+						}
+						else if ((b1 & MASK_2) == OP_DIFF)
+						{
+							px_.r += ((b1 >> 4) & 0x03) - 2;
+							px_.g += ((b1 >> 2) & 0x03) - 2;
+							px_.b += (b1 & 0x03) - 2;
+						}
+						else if ((b1 & MASK_2) == OP_LUMA)
+						{
+							uint8_t b2 = data_[pos_++];
+							int vg = (b1 & 0x3f) - 32;
+							px_.r += vg - 8 + ((b2 >> 4) & 0x0f);
+							px_.g += vg;
+							px_.b += vg - 8 + (b2 & 0x0f);
+						}
+						else // OP_RUN
+						{
+							run_ = b1 & 0x3f;
+						}
+						index_[hashPixel(px_)] = px_;
+					}
+
+					rows_[offset] = px_.r;
+					rows_[offset + 1] = px_.g;
+					rows_[offset + 2] = px_.b;
+					if (channels == 4)
+					{
+						rows_[offset + 3] = px_.a;
+					}
+				}
+				return rows_.data();
+			}
+
+		private:
+			// Makes at least n bytes available at pos_ (always true for a view unless truncated)
+			bool ensure(size_t n)
+			{
+				if (dataSize_ - pos_ >= n)
+				{
+					return true;
+				}
+				if (data_ != buffer_.data())
+				{
+					return false;
+				}
+				size_t left = dataSize_ - pos_;
+				std::memmove(buffer_.data(), buffer_.data() + pos_, left);
+				pos_ = 0;
+				dataSize_ = left;
+				while (dataSize_ < n)
+				{
+					size_t got = in_->read(buffer_.data() + dataSize_, buffer_.size() - dataSize_);
+					if (got == 0)
+					{
+						return false;
+					}
+					dataSize_ += got;
+				}
+				return true;
+			}
+
+			InputStream* in_ = nullptr;
+			const uint8_t* data_ = nullptr;
+			size_t dataSize_ = 0;
+			size_t pos_ = 0;
+			AlignedVector<uint8_t> buffer_;
+			AlignedVector<uint8_t> rows_;
+			ImageInfo info_;
+			int rowsLeft_ = 0;
+			Pixel index_[64];
+			Pixel px_ = { 0, 0, 0, 255 };
+			int run_ = 0;
+		};
+
+		class QoiCodec : public ImageCodec
+		{
+		public:
+			const char* name() const override { return "QOI"; }
+			std::vector<std::string> extensions() const override { return { ".qoi" }; }
+			uint32_t capabilities() const override
+			{
+				return ImageCapRGB | ImageCapRGBA | ImageCapDepth8 | ImageCapStreamingWrite | ImageCapStreamingRead;
+			}
+
+			std::unique_ptr<ImageSink> createSink() const override { return std::unique_ptr<ImageSink>(new QoiSink()); }
+			std::unique_ptr<ImageSource> createSource() const override { return std::unique_ptr<ImageSource>(new QoiSource()); }
+		};
+	}
+
+	std::unique_ptr<ImageCodec> createQoiCodec()
+	{
+		return std::unique_ptr<ImageCodec>(new QoiCodec());
+	}
+}
@@ -0,0 +1,246 @@
+#include "SoundImageConverter/Resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIC_RESAMPLER_X64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIC_TARGET_AVX2
+#else
+#define SIC_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace SoundImageConverter
+{
+	namespace
+	{
+		const double kaiserBeta = 8.0; // About 80 dB stop-band attenuation
+		const int zeroCrossings = 16; // Per side of the sinc, at the output rate when downsampling
+		const double passband = 0.9; // Fraction of the lower Nyquist frequency kept
+
+		// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+		double besselI0(double x)
+		{
+			double sum = 1.0;
+			double term = 1.0;
+			for (int k = 1; k < 50; k++)
+			{
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+				if (term < sum * 1e-12)
+				{
+					break;
+				}
+			}
+			return sum;
+		}
+
+#ifdef SIC_RESAMPLER_X64
+		// n is a multiple of 8
+		SIC_TARGET_AVX2 float dotAvx2(const float* a, const float* b, size_t n)
+		{
+			__m256 acc = _mm256_setzero_ps();
+			for (size_t i = 0; i < n; i += 8)
+			{
+				acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+			}
+			__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+			sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+			sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+			return _mm_cvtss_f32(sum);
+		}
+
+		// SSE2 is part of x86-64, no detection needed
+		float dotSse2(const float* a, const float* b, size_t n)
+		{
+			__m128 acc0 = _mm_setzero_ps();
+			__m128 acc1 = _mm_setzero_ps();
+			for (size_t i = 0; i < n; i += 8)
+			{
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+			}
+			__m128 sum = _mm_add_ps(acc0, acc1);
+			sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+			sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+			return _mm_cvtss_f32(sum);
+		}
+
+		bool detectAvx2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+			bool fma = (info[2] & (1 << 12)) != 0;
+			__cpuidex(info, 7, 0);
+			return osAvx && fma && (info[1] & (1 << 5)) != 0;
+#else
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+		}
+#else
+		float dotScalar(const float* a, const float* b, size_t n)
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < n; i++)
+			{
+				sum += a[i] * b[i];
+			}
+			return sum;
+		}
+#endif
+
+		typedef float (*DotFunction)(const float*, const float*, size_t);
+
+		DotFunction selectDot()
+		{
+#ifdef SIC_RESAMPLER_X64
+			return detectAvx2() ? dotAvx2 : dotSse2;
+#else
+			return dotScalar;
+#endif
+		}
+
+		inline int16_t toSample(float value)
+		{
+			float scaled = std::round(value * 32768.0f);
+			return static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, scaled)));
+		}
+	}
+
+	bool Resampler::init(uint32_t inRate, uint32_t outRate, int channels)
+	{
+		if (inRate == 0 || outRate == 0 || channels < 1)
+		{
+			return false;
+		}
+		uint64_t divisor = std::gcd(static_cast<uint64_t>(inRate), static_cast<uint64_t>(outRate));
+		upFactor_ = outRate / divisor;
+		downFactor_ = inRate / divisor;
+		if (upFactor_ > maxPhases)
+		{
+			return false;
+		}
+		channels_ = channels;
+
+		// Design the prototype low-pass in input samples and split it into phases
+		double ratio = std::min(1.0, static_cast<double>(upFactor_) / downFactor_);
+		double cutoff = 0.5 * passband * ratio; // Cycles per input sample
+		size_t half = static_cast<size_t>(std::ceil(zeroCrossings / ratio));
+		taps_ = (2 * half + 7) / 8 * 8;
+		half = taps_ / 2;
+
+		const double pi = 3.14159265358979323846;
+		coefficients_.assign(upFactor_ * taps_, 0.0f);
+		for (uint64_t phase = 0; phase < upFactor_; phase++)
+		{
+			float* row = &coefficients_[phase * taps_];
+			double sum = 0.0;
+			std::vector<double> values(taps_);
+			for (size_t k = 0; k < taps_; k++)
+			{
+				// Distance from the output instant to input sample k, in input samples
+				double t = static_cast<double>(half) - 1.0 - static_cast<double>(k) + static_cast<double>(phase) / upFactor_;
+				double x = 2.0 * cutoff * t;
+				double sinc = (x == 0.0) ? 1.0 : std::sin(pi * x) / (pi * x);
+				double edge = t / half;
+				double window = std::fabs(edge) >= 1.0 ? 0.0 : besselI0(kaiserBeta * std::sqrt(1.0 - edge * edge)) / besselI0(kaiserBeta);
+				values[k] = sinc * window;
+				sum += values[k];
+			}
+			for (size_t k = 0; k < taps_; k++)
+			{
+				row[k] = static_cast<float>(values[k] / sum); // Unity gain at DC for every phase
+			}
+		}
+
+		// Silence before the first sample, so the first output has a full window
+		history_.assign(channels, std::vector<float>(half - 1, 0.0f));
+		historyStart_ = -static_cast<int64_t>(half - 1);
+		inputFrames_ = 0;
+		outputIndex_ = 0;
+		return true;
+	}
+
+	uint64_t Resampler::outputFrames(uint64_t inFrames, uint32_t inRate, uint32_t outRate)
+	{
+		uint64_t divisor = std::gcd(static_cast<uint64_t>(inRate), static_cast<uint64_t>(outRate));
+		uint64_t up = outRate / divisor;
+		uint64_t down = inRate / divisor;
+		return (inFrames * up + down - 1) / down;
+	}
+
+	void Resampler::process(const int16_t* in, size_t frames, std::vector<int16_t>& out)
+	{
+		for (int c = 0; c < channels_; c++)
+		{
+			std::vector<float>& history = history_[c];
+			size_t base = history.size();
+			history.resize(base + frames);
+			for (size_t i = 0; i < frames; i++)
+			{
+				history[base + i] = in[i * channels_ + c] * (1.0f / 32768.0f);
+			}
+		}
+		inputFrames_ += frames;
+		produce(out, false);
+	}
+
+	void Resampler::flush(std::vector<int16_t>& out)
+	{
+		produce(out, true);
+	}
+
+	void Resampler::produce(std::vector<int16_t>& out, bool flushing)
+	{
+		static const DotFunction dot = selectDot();
+		const int64_t half = static_cast<int64_t>(taps_ / 2);
+		for (;;)
+		{
+			uint64_t position = outputIndex_ * downFactor_; // In 1/L input samples
+			if (position >= inputFrames_ * upFactor_)
+			{
+				break; // Output instants past the end of the input are not produced
+			}
+			int64_t center = static_cast<int64_t>(position / upFactor_);
+			uint64_t phase = position % upFactor_;
+			int64_t first = center - half + 1;
+			int64_t needed = center + half + 1 - historyStart_; // History length needed for this output
+			if (needed > static_cast<int64_t>(history_[0].size()))
+			{
+				if (!flushing)
+				{
+					break; // Wait for more input
+				}
+				for (std::vector<float>& history : history_)
+				{
+					history.resize(static_cast<size_t>(needed), 0.0f);
+				}
+			}
+
+			const float* row = &coefficients_[phase * taps_];
+			for (int c = 0; c < channels_; c++)
+			{
+				out.push_back(toSample(dot(row, &history_[c][static_cast<size_t>(first - historyStart_)], taps_)));
+			}
+			outputIndex_++;
+		}
+
+		// Drop input that no future output needs
+		int64_t nextFirst = static_cast<int64_t>(outputIndex_ * downFactor_ / upFactor_) - half + 1;
+		size_t drop = static_cast<size_t>(std::max<int64_t>(0, std::min<int64_t>(nextFirst - historyStart_, static_cast<int64_t>(history_[0].size()))));
+		if (drop > 0)
+		{
+			for (std::vector<float>& history : history_)
+			{
+				history.erase(history.begin(), history.begin() + drop);
+			}
+			historyStart_ += static_cast<int64_t>(drop);
+		}
+	}
+}
@@ -0,0 +1,174 @@
+#include "SoundImageConverter/SharedMemory.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SoundImageConverter
+{
+	int createSharedMemory(const char* name, size_t size)
+	{
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+		int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+		// Unlinked as soon as it is open, so only the descriptor refers to it
+		static std::atomic<unsigned> counter{ 0 };
+		std::string path = "/" + std::string(name) + "-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+		int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd >= 0)
+		{
+			shm_unlink(path.c_str());
+		}
+#endif
+		if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) != 0)
+		{
+			close(fd);
+			fd = -1;
+		}
+		return fd;
+	}
+
+	bool sealSharedMemorySize(int fd)
+	{
+#ifdef F_ADD_SEALS
+		return fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) == 0;
+#else
+		(void)fd;
+		return false;
+#endif
+	}
+
+	bool sharedMemorySizeSealed(int fd)
+	{
+#ifdef F_GET_SEALS
+		int seals = fcntl(fd, F_GET_SEALS);
+		return seals >= 0 && (seals & F_SEAL_SHRINK) != 0;
+#else
+		(void)fd; // Nothing would stop the client truncating it under the converter
+		return false;
+#endif
+	}
+
+	SharedMemoryOutputStream::~SharedMemoryOutputStream()
+	{
+		unmap();
+		if (fd_ >= 0)
+		{
+			close(fd_);
+		}
+	}
+
+	bool SharedMemoryOutputStream::create(size_t capacity)
+	{
+		capacity = std::max<size_t>(capacity, 4096);
+		fd_ = createSharedMemory("sic-output", capacity);
+		if (fd_ < 0)
+		{
+			return false;
+		}
+		void* view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+		data_ = static_cast<uint8_t*>(view);
+		capacity_ = capacity;
+		return true;
+	}
+
+	bool SharedMemoryOutputStream::attach(int fd)
+	{
+		fd_ = fd;
+		attached_ = true;
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			return false;
+		}
+		size_t capacity = std::max<size_t>(static_cast<size_t>(info.st_size), 4096);
+		if (static_cast<size_t>(info.st_size) < capacity && ftruncate(fd, static_cast<off_t>(capacity)) != 0)
+		{
+			return false;
+		}
+		void* view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+		data_ = static_cast<uint8_t*>(view);
+		capacity_ = capacity;
+		return true;
+	}
+
+	bool SharedMemoryOutputStream::write(const void* data, size_t size)
+	{
+		if (failed_ || (size > capacity_ - size_ && !grow(size_ + size)))
+		{
+			failed_ = true;
+			return false;
+		}
+		std::memcpy(data_ + size_, data, size);
+		size_ += size;
+		return true;
+	}
+
+	bool SharedMemoryOutputStream::grow(size_t needed)
+	{
+		if (!data_)
+		{
+			return false;
+		}
+		size_t capacity = std::max(needed, capacity_ * 2);
+		if (ftruncate(fd_, static_cast<off_t>(capacity)) != 0)
+		{
+			return false;
+		}
+#ifdef MREMAP_MAYMOVE
+		void* view = mremap(data_, capacity_, capacity, MREMAP_MAYMOVE);
+#else
+		munmap(data_, capacity_);
+		data_ = nullptr;
+		void* view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+#endif
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+		data_ = static_cast<uint8_t*>(view);
+		capacity_ = capacity;
+		return true;
+	}
+
+	bool SharedMemoryOutputStream::finish()
+	{
+		unmap();
+		if (fd_ < 0 || failed_)
+		{
+			return false;
+		}
+		return attached_ || (ftruncate(fd_, static_cast<off_t>(size_)) == 0 && sealSharedMemorySize(fd_));
+	}
+
+	int SharedMemoryOutputStream::releaseDescriptor()
+	{
+		int fd = fd_;
+		fd_ = -1;
+		return fd;
+	}
+
+	void SharedMemoryOutputStream::unmap()
+	{
+		if (data_)
+		{
+			munmap(data_, capacity_);
+			data_ = nullptr;
+		}
+	}
+}
+#endif
@@ -0,0 +1,152 @@
+#include "SoundImageConverter/Stream.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace SoundImageConverter
+{
+	FileOutputStream::~FileOutputStream()
+	{
+		close();
+	}
+
+	bool FileOutputStream::open(const std::string& path)
+	{
+		close();
+		file_ = std::fopen(path.c_str(), "wb");
+		owned_ = true;
+		failed_ = false;
+		return file_ != nullptr;
+	}
+
+	bool FileOutputStream::openStandardOutput()
+	{
+		close();
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		file_ = stdout;
+		owned_ = false;
+		failed_ = false;
+		return true;
+	}
+
+	bool FileOutputStream::close()
+	{
+		if (!file_)
+		{
+			return !failed_;
+		}
+		failed_ = ((owned_ ? std::fclose(file_) : std::fflush(file_)) != 0) || failed_;
+		file_ = nullptr;
+		return !failed_;
+	}
+
+	bool FileOutputStream::write(const void* data, size_t size)
+	{
+		if (!file_ || std::fwrite(data, 1, size, file_) != size)
+		{
+			failed_ = true;
+		}
+		return !failed_;
+	}
+
+	FileInputStream::~FileInputStream()
+	{
+		close();
+	}
+
+	bool FileInputStream::open(const std::string& path)
+	{
+		close();
+		file_ = std::fopen(path.c_str(), "rb");
+		owned_ = true;
+		return file_ != nullptr;
+	}
+
+	bool FileInputStream::openStandardInput()
+	{
+		close();
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		file_ = stdin;
+		owned_ = false;
+		return true;
+	}
+
+	void FileInputStream::close()
+	{
+		if (file_ && owned_)
+		{
+			std::fclose(file_);
+		}
+		file_ = nullptr;
+	}
+
+	size_t FileInputStream::read(void* data, size_t size)
+	{
+		return file_ ? std::fread(data, 1, size, file_) : 0;
+	}
+
+	size_t MemoryInputStream::read(void* data, size_t size)
+	{
+		size_t count = std::min(size, size_ - pos_);
+		std::memcpy(data, data_ + pos_, count);
+		pos_ += count;
+		return count;
+	}
+
+	bool MemoryOutputStream::write(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		buffer_.insert(buffer_.end(), bytes, bytes + size);
+		return true;
+	}
+
+	bool MappedInputStream::open(const std::string& path)
+	{
+		pos_ = 0;
+		return file_.open(path);
+	}
+
+	size_t MappedInputStream::read(void* data, size_t size)
+	{
+		size_t count = std::min(size, file_.size() - pos_);
+		std::memcpy(data, file_.data() + pos_, count);
+		pos_ += count;
+		return count;
+	}
+
+	std::unique_ptr<InputStream> openInputFile(const std::string& path)
+	{
+		// Named pipes (mkfifo, <(...)) are only opened once: a trial open would consume the writer
+		std::error_code ec;
+		std::unique_ptr<MappedInputStream> mapped(new MappedInputStream());
+		if (std::filesystem::is_regular_file(path, ec) && mapped->open(path))
+		{
+			return mapped;
+		}
+
+		// Empty files, pipes and other unmappable inputs
+		std::unique_ptr<FileInputStream> file(new FileInputStream());
+		if (file->open(path))
+		{
+			return file;
+		}
+		return nullptr;
+	}
+
+	void removePartialOutput(const std::string& path)
+	{
+		std::error_code ec;
+		if (std::filesystem::is_regular_file(path, ec))
+		{
+			std::filesystem::remove(path, ec);
+		}
+	}
+}
@@ -0,0 +1,150 @@
+#include "SoundImageConverter/TaskScheduler.h"
+#include <algorithm>
+#include <iterator>
+
+namespace SoundImageConverter
+{
+	namespace
+	{
+		// Which worker, of which scheduler, the calling thread is
+		thread_local const TaskScheduler* currentScheduler = nullptr;
+		thread_local size_t currentWorker = 0;
+	}
+
+	TaskScheduler::TaskScheduler(unsigned threads)
+	{
+		if (threads == 0)
+		{
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (unsigned i = 0; i < threads; i++)
+		{
+			workers_.emplace_back(new Worker());
+		}
+		for (size_t i = 0; i < workers_.size(); i++)
+		{
+			workers_[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+		}
+	}
+
+	TaskScheduler::~TaskScheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+			stopping_ = true;
+		}
+		workAvailable_.notify_all();
+		for (std::unique_ptr<Worker>& worker : workers_)
+		{
+			worker->thread.join();
+		}
+	}
+
+	int TaskScheduler::workerIndex() const
+	{
+		return currentScheduler == this ? static_cast<int>(currentWorker) : -1;
+	}
+
+	void TaskScheduler::spawn(TaskGroup& group, std::function<void()> task)
+	{
+		group.pending_++;
+		size_t index = currentScheduler == this ? currentWorker : nextWorker_++ % workers_.size();
+		{
+			std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+			workers_[index]->tasks.push_back(Task{ &group, std::move(task) });
+		}
+		{
+			// Counted under sleepMutex_, so a worker about to sleep either sees it or gets the notification
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+			queued_++;
+		}
+		workAvailable_.notify_one();
+	}
+
+	void TaskScheduler::wait(TaskGroup& group)
+	{
+		Task task;
+		while (group.pending_ != 0)
+		{
+			if (currentScheduler == this && popOwn(currentWorker, task, &group))
+			{
+				task.run();
+				finish(task);
+				continue;
+			}
+			// The rest of the group is running on other threads
+			std::unique_lock<std::mutex> lock(sleepMutex_);
+			groupDone_.wait(lock, [&]() { return group.pending_ == 0; });
+		}
+	}
+
+	void TaskScheduler::workerLoop(size_t index)
+	{
+		currentScheduler = this;
+		currentWorker = index;
+		Task task;
+		for (;;)
+		{
+			if (popOwn(index, task, nullptr) || steal(index, task))
+			{
+				task.run();
+				finish(task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleepMutex_);
+			workAvailable_.wait(lock, [&]() { return queued_ != 0 || stopping_; });
+			if (queued_ == 0 && stopping_)
+			{
+				return;
+			}
+		}
+	}
+
+	bool TaskScheduler::popOwn(size_t index, Task& task, const TaskGroup* only)
+	{
+		// With only set, the newest task of that group: other threads may have queued unrelated work on top
+		Worker& worker = *workers_[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		for (auto it = worker.tasks.rbegin(); it != worker.tasks.rend(); ++it)
+		{
+			if (!only || it->group == only)
+			{
+				task = std::move(*it);
+				worker.tasks.erase(std::next(it).base());
+				queued_--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool TaskScheduler::steal(size_t thief, Task& task)
+	{
+		// Start at the next worker, so thieves spread over the victims
+		for (size_t i = 1; i < workers_.size(); i++)
+		{
+			Worker& victim = *workers_[(thief + i) % workers_.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				queued_--;
+				steals_++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void TaskScheduler::finish(Task& task)
+	{
+		TaskGroup* group = task.group;
+		task.run = nullptr; // Release what the task captured before the group may end
+		if (--group->pending_ == 0)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+			groupDone_.notify_all();
+		}
+	}
+}
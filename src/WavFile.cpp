@@ -0,0 +1,311 @@
+#include "SoundImageConverter/WavFile.h"
+#include <algorithm>
+#include <cstring>
+
+namespace SoundImageConverter
+{
+	namespace
+	{
+		const uint16_t formatPcm = 0x0001;
+		const uint16_t formatExtensible = 0xFFFE;
+		// KSDATAFORMAT_SUBTYPE_PCM after the leading format tag
+		const uint8_t pcmGuidTail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+		const uint64_t riffSizeLimit = 0xFFFFFFFFull;
+
+		inline bool littleEndianHost()
+		{
+			const uint16_t value = 1;
+			uint8_t first;
+			std::memcpy(&first, &value, 1);
+			return first == 1;
+		}
+
+		inline uint16_t get16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+		inline uint32_t get32(const uint8_t* p) { return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16); }
+		inline uint64_t get64(const uint8_t* p) { return get32(p) | (static_cast<uint64_t>(get32(p + 4)) << 32); }
+
+		inline void put16(uint8_t*& p, uint16_t v) { *p++ = v & 0xFF; *p++ = v >> 8; }
+		inline void put32(uint8_t*& p, uint32_t v) { put16(p, v & 0xFFFF); put16(p, v >> 16); }
+		inline void put64(uint8_t*& p, uint64_t v) { put32(p, v & 0xFFFFFFFF); put32(p, static_cast<uint32_t>(v >> 32)); }
+		inline void putId(uint8_t*& p, const char* id) { std::memcpy(p, id, 4); p += 4; }
+
+		void swapBytes(int16_t* samples, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				uint16_t v = static_cast<uint16_t>(samples[i]);
+				samples[i] = static_cast<int16_t>((v >> 8) | (v << 8));
+			}
+		}
+	}
+
+	bool WavReader::readExact(void* data, size_t size)
+	{
+		return in_->read(data, size) == size;
+	}
+
+	bool WavReader::skip(uint64_t size)
+	{
+		uint8_t scratch[4096];
+		while (size > 0)
+		{
+			size_t step = static_cast<size_t>(std::min<uint64_t>(size, sizeof(scratch)));
+			if (!readExact(scratch, step))
+			{
+				return false;
+			}
+			size -= step;
+		}
+		return true;
+	}
+
+	bool WavReader::open(InputStream& in, WavFormat& format)
+	{
+		in_ = &in;
+		format_ = WavFormat();
+		framesLeft_ = 0;
+
+		uint8_t header[12];
+		if (!readExact(header, sizeof(header)) || std::memcmp(header + 8, "WAVE", 4) != 0)
+		{
+			return false;
+		}
+		bool rf64 = std::memcmp(header, "RF64", 4) == 0;
+		if (!rf64 && std::memcmp(header, "RIFF", 4) != 0)
+		{
+			return false;
+		}
+
+		uint64_t position = sizeof(header);
+		uint64_t ds64DataSize = 0;
+		bool haveFormat = false;
+		for (;;)
+		{
+			uint8_t chunk[8];
+			if (!readExact(chunk, sizeof(chunk)))
+			{
+				return false; // No data chunk
+			}
+			position += sizeof(chunk);
+			uint64_t size = get32(chunk + 4);
+
+			if (std::memcmp(chunk, "ds64", 4) == 0 && size >= 24)
+			{
+				uint8_t ds64[24];
+				if (!readExact(ds64, sizeof(ds64)) || !skip(size - sizeof(ds64) + (size & 1)))
+				{
+					return false;
+				}
+				ds64DataSize = get64(ds64 + 8); // riffSize, dataSize, sampleCount
+			}
+			else if (std::memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+			{
+				uint8_t fmt[40] = {};
+				size_t fmtBytes = static_cast<size_t>(std::min<uint64_t>(size, sizeof(fmt)));
+				if (!readExact(fmt, fmtBytes) || !skip(size - fmtBytes + (size & 1)))
+				{
+					return false;
+				}
+				uint16_t tag = get16(fmt);
+				if (tag == formatExtensible)
+				{
+					// The real format is in the sub-format GUID
+					if (fmtBytes < 40 || get16(fmt + 24) != formatPcm || std::memcmp(fmt + 26, pcmGuidTail, sizeof(pcmGuidTail)) != 0)
+					{
+						return false;
+					}
+					tag = formatPcm;
+				}
+				format_.channels = get16(fmt + 2);
+				format_.sampleRate = get32(fmt + 4);
+				format_.bitsPerSample = get16(fmt + 14);
+				if (tag != formatPcm || format_.channels < 1 || (format_.bitsPerSample != 8 && format_.bitsPerSample != 16) ||
+					get16(fmt + 12) != format_.blockAlign())
+				{
+					return false;
+				}
+				haveFormat = true;
+			}
+			else if (std::memcmp(chunk, "data", 4) == 0)
+			{
+				if (!haveFormat)
+				{
+					return false;
+				}
+				if (rf64 && size == 0xFFFFFFFF)
+				{
+					size = ds64DataSize;
+				}
+				bool placeholder = !rf64 && (size == 0 || size == 0xFFFFFFFF); // Streaming writers leave 0 or -1
+				if (in.view() && (placeholder || position + size > in.viewSize()))
+				{
+					size = in.viewSize() - position; // A writer that never patched the size, or a truncated file
+				}
+				format_.frames = (placeholder && !in.view()) ? WavFormat::unknownFrames : size / format_.blockAlign();
+				framesLeft_ = format_.frames;
+				dataOffset_ = position;
+				format = format_;
+				return true;
+			}
+			else if (!skip(size + (size & 1))) // Chunks are word aligned
+			{
+				return false;
+			}
+			position += size + (size & 1);
+		}
+	}
+
+	bool WavReader::openRaw(InputStream& in, WavFormat& format)
+	{
+		if (format.channels < 1 || (format.bitsPerSample != 8 && format.bitsPerSample != 16))
+		{
+			return false;
+		}
+		in_ = &in;
+		format_ = format;
+		format_.frames = in.view() ? in.viewSize() / format_.blockAlign() : WavFormat::unknownFrames;
+		framesLeft_ = format_.frames;
+		dataOffset_ = 0;
+		format = format_;
+		return true;
+	}
+
+	size_t WavReader::readFrames(int16_t* samples, size_t frames)
+	{
+		frames = static_cast<size_t>(std::min<uint64_t>(frames, framesLeft_));
+		size_t count = frames * format_.channels;
+		size_t got;
+		if (format_.bitsPerSample == 16)
+		{
+			got = in_->read(samples, count * sizeof(int16_t)) / format_.blockAlign();
+			if (!littleEndianHost())
+			{
+				swapBytes(samples, got * format_.channels);
+			}
+		}
+		else
+		{
+			// Bytes go to the second half of samples and widen forwards: sample i is written after byte i is read,
+			// and only covers bytes before it
+			uint8_t* bytes = reinterpret_cast<uint8_t*>(samples) + count;
+			got = in_->read(bytes, count) / format_.blockAlign();
+			for (size_t i = 0; i < got * format_.channels; i++)
+			{
+				samples[i] = static_cast<int16_t>((bytes[i] - 128) * 256);
+			}
+		}
+		framesLeft_ = got < frames ? 0 : framesLeft_ - got;
+		return got;
+	}
+
+	const int16_t* WavReader::mappedSamples() const
+	{
+		const uint8_t* view = in_ ? in_->view() : nullptr;
+		if (!view || format_.bitsPerSample != 16 || !littleEndianHost() || dataOffset_ % alignof(int16_t) != 0)
+		{
+			return nullptr;
+		}
+		return reinterpret_cast<const int16_t*>(view + dataOffset_);
+	}
+
+	bool WavWriter::beginRaw(OutputStream& out, const WavFormat& format)
+	{
+		out_ = &out;
+		format_ = format;
+		framesWritten_ = 0;
+		raw_ = true;
+		return format.channels >= 1 && (format.bitsPerSample == 8 || format.bitsPerSample == 16);
+	}
+
+	bool WavWriter::begin(OutputStream& out, const WavFormat& format)
+	{
+		out_ = &out;
+		format_ = format;
+		framesWritten_ = 0;
+		raw_ = false;
+		if (format.channels < 1 || format.channels > 0xFFFF || (format.bitsPerSample != 8 && format.bitsPerSample != 16))
+		{
+			return false;
+		}
+
+		uint64_t dataSize = format.frames * format.blockAlign();
+		uint64_t pad = dataSize & 1;
+		const uint64_t ds64ChunkSize = 8 + 28;
+		bool rf64 = 4 + (8 + 16) + 8 + dataSize + pad > riffSizeLimit;
+
+		uint8_t header[12 + ds64ChunkSize + 8 + 16 + 8];
+		uint8_t* p = header;
+		putId(p, rf64 ? "RF64" : "RIFF");
+		put32(p, rf64 ? 0xFFFFFFFF : static_cast<uint32_t>(4 + (8 + 16) + 8 + dataSize + pad));
+		putId(p, "WAVE");
+		if (rf64)
+		{
+			putId(p, "ds64");
+			put32(p, 28);
+			put64(p, 4 + ds64ChunkSize + (8 + 16) + 8 + dataSize + pad); // RIFF size
+			put64(p, dataSize);
+			put64(p, format.frames);
+			put32(p, 0); // No table entries
+		}
+		putId(p, "fmt ");
+		put32(p, 16);
+		put16(p, formatPcm);
+		put16(p, static_cast<uint16_t>(format.channels));
+		put32(p, format.sampleRate);
+		put32(p, static_cast<uint32_t>(format.sampleRate * format.blockAlign()));
+		put16(p, static_cast<uint16_t>(format.blockAlign()));
+		put16(p, static_cast<uint16_t>(format.bitsPerSample));
+		putId(p, "data");
+		put32(p, rf64 ? 0xFFFFFFFF : static_cast<uint32_t>(dataSize));
+		return out.write(header, p - header);
+	}
+
+	bool WavWriter::writeFrames(const int16_t* samples, size_t frames)
+	{
+		size_t count = frames * format_.channels;
+		framesWritten_ += frames;
+		if (format_.bitsPerSample == 16)
+		{
+			if (littleEndianHost())
+			{
+				return out_->write(samples, count * sizeof(int16_t));
+			}
+		}
+		// Converted through a buffer on the stack, a piece at a time
+		uint8_t buffer[16384];
+		const size_t sampleBytes = format_.bitsPerSample / 8;
+		const size_t piece = sizeof(buffer) / sampleBytes;
+		for (size_t start = 0; start < count; start += piece)
+		{
+			size_t n = std::min(piece, count - start);
+			const int16_t* in = samples + start;
+			for (size_t i = 0; i < n; i++)
+			{
+				if (sampleBytes == 2)
+				{
+					buffer[i * 2] = static_cast<uint8_t>(in[i] & 0xFF);
+					buffer[i * 2 + 1] = static_cast<uint8_t>((in[i] >> 8) & 0xFF);
+				}
+				else
+				{
+					buffer[i] = static_cast<uint8_t>((in[i] >> 8) + 128);
+				}
+			}
+			if (!out_->write(buffer, n * sampleBytes))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool WavWriter::finish()
+	{
+		if (framesWritten_ != format_.frames)
+		{
+			return false;
+		}
+		const uint8_t zero = 0;
+		return raw_ || (format_.frames * format_.blockAlign()) % 2 == 0 || out_->write(&zero, 1);
+	}
+}
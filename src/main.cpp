@@ -1,6 +1,18 @@
 ﻿#include <iostream>
 #include "SoundImageConverter/Converter.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/AudioFormat.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <SDL.h>
 #include <imgui.h>
@@ -8,15 +20,18 @@
 #include <imgui_impl_opengl3.h>
 #include <tinyfiledialogs.h>
 #include <string>
+#include <thread>
+#include <vector>
 #include <SDL_syswm.h>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 #include <gl/GL.h>
 
-std::string generateUniqueFileName(const std::string& basePath)
+// basePath, or basePath with a counter added, that neither exists nor is reserved for a queued job
+std::string generateUniqueFileName(const std::string& basePath, const std::set<std::string>& reserved)
 {
-    if (!std::filesystem::exists(basePath))
+    if (!std::filesystem::exists(basePath) && !reserved.count(basePath))
     {
         return basePath;
     }
@@ -34,11 +49,251 @@ std::string generateUniqueFileName(const std::string& basePath)
         oss << directory << "/" << stem << "_" << counter << extension;
         newPath = oss.str();
         counter++;
-    } while (std::filesystem::exists(newPath));
+    } while (std::filesystem::exists(newPath) || reserved.count(newPath));
 
     return newPath;
 }
 
+// tinyfiledialogs returns multiple selections as one string separated by '|'
+std::vector<std::string> splitDialogPaths(const char* paths)
+{
+    std::vector<std::string> result;
+    std::string all = paths ? paths : "";
+    for (size_t start = 0; start < all.size();)
+    {
+        size_t end = std::min(all.find('|', start), all.size());
+        if (end > start)
+        {
+            result.push_back(all.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+// Sorts path into images to decode and audio to encode. Folders are searched recursively for files with a
+// known image or audio extension; a file chosen explicitly with an unknown extension is tried as audio
+void collectInputs(const std::string& path, std::vector<std::string>& audio, std::vector<std::string>& images)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_directory(path, ec))
+    {
+        (SoundImageConverter::ImageCodecRegistry::instance().findForPath(path) ? images : audio).push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    for (auto it = std::filesystem::recursive_directory_iterator(path, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (it->is_regular_file(ec))
+        {
+            found.push_back(it->path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    for (const std::string& file : found)
+    {
+        if (SoundImageConverter::ImageCodecRegistry::instance().findForPath(file))
+        {
+            images.push_back(file);
+        }
+        else if (SoundImageConverter::AudioFormat::isAudioPath(file))
+        {
+            audio.push_back(file);
+        }
+    }
+}
+
+// CPU time used by the whole process so far, all threads
+double processCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        return 0;
+    }
+    ULARGE_INTEGER kernelTime, userTime;
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+    return (kernelTime.QuadPart + userTime.QuadPart) * 1e-7; // 100 ns units
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+// Short reason for the job table
+const char* describeError(SoundImageConverter::ConversionError error)
+{
+    switch (error)
+    {
+    case SoundImageConverter::ConversionOk: return "OK";
+    case SoundImageConverter::ConversionUnsupported: return "Unsupported";
+    case SoundImageConverter::ConversionOpenInputFailed: return "Cannot open input";
+    case SoundImageConverter::ConversionInvalidInput: return "Invalid input";
+    case SoundImageConverter::ConversionOpenOutputFailed: return "Cannot create output";
+    case SoundImageConverter::ConversionReadFailed: return "Read failed";
+    case SoundImageConverter::ConversionWriteFailed: return "Write failed";
+    case SoundImageConverter::ConversionChecksumMismatch: return "Checksum mismatch";
+    case SoundImageConverter::ConversionCancelled: return "Cancelled";
+    }
+    return "Failed";
+}
+
+// A queued conversion. The worker running it writes the atomics and result, the UI reads them every frame
+struct ConversionJob
+{
+    enum State { Queued, Running, Succeeded, Failed, Cancelled };
+
+    bool encode = true;
+    std::string input;
+    std::string output;
+    uint64_t inputBytes = 0;
+    SoundImageConverter::CancelToken cancel;
+    std::atomic<int> state{ Queued };
+    std::atomic<uint64_t> framesDone{ 0 };
+    std::atomic<uint64_t> framesTotal{ 0 };
+    std::chrono::steady_clock::time_point started; // Written before state becomes Running
+    SoundImageConverter::ConversionResult result; // Written before state becomes final
+
+    bool finished() const { return state >= Succeeded; }
+};
+
+void runConversion(ConversionJob& job)
+{
+    if (job.cancel.cancelled())
+    {
+        job.state = ConversionJob::Cancelled;
+        return;
+    }
+    job.started = std::chrono::steady_clock::now();
+    job.state = ConversionJob::Running;
+    auto progress = [&job](uint64_t done, uint64_t total)
+    {
+        job.framesTotal = total;
+        job.framesDone = done;
+    };
+    if (job.encode)
+    {
+        SoundImageConverter::EncodeOptions options;
+        options.progress = progress;
+        options.cancel = &job.cancel;
+        options.log = nullptr;
+        job.result = SoundImageConverter::Encoder::encode(job.input, job.output, options);
+    }
+    else
+    {
+        SoundImageConverter::DecodeOptions options;
+        options.progress = progress;
+        options.cancel = &job.cancel;
+        options.log = nullptr;
+        job.result = SoundImageConverter::Decoder::decode(job.input, job.output, options);
+    }
+    job.state = job.result.ok() ? ConversionJob::Succeeded
+        : job.result.error == SoundImageConverter::ConversionCancelled ? ConversionJob::Cancelled : ConversionJob::Failed;
+}
+
+// Runs queued jobs oldest first on worker threads. The number of workers can change at any time:
+// extra workers start at once, surplus ones exit after their current job
+class JobQueue
+{
+public:
+    ~JobQueue()
+    {
+        stop();
+    }
+
+    void setWorkers(unsigned count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wanted_ = count;
+        if (threads_.size() < count)
+        {
+            threads_.resize(count);
+            active_.resize(count, false);
+        }
+        for (unsigned i = 0; i < count; i++)
+        {
+            if (!active_[i])
+            {
+                if (threads_[i].joinable())
+                {
+                    threads_[i].join(); // Exited after an earlier decrease
+                }
+                active_[i] = true;
+                threads_[i] = std::thread(&JobQueue::workerLoop, this, i);
+            }
+        }
+        changed_.notify_all();
+    }
+
+    void push(ConversionJob* job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(job);
+        }
+        changed_.notify_one();
+    }
+
+    // Marks the jobs still queued as cancelled and waits for the running ones; cancel those first to return quickly
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            for (ConversionJob* job : queue_)
+            {
+                job->state = ConversionJob::Cancelled;
+            }
+            queue_.clear();
+        }
+        changed_.notify_all();
+        for (std::thread& thread : threads_)
+        {
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+private:
+    void workerLoop(unsigned index)
+    {
+        for (;;)
+        {
+            ConversionJob* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [&]() { return stopping_ || index >= wanted_ || !queue_.empty(); });
+                if (stopping_ || index >= wanted_)
+                {
+                    active_[index] = false;
+                    return;
+                }
+                job = queue_.front();
+                queue_.pop_front();
+            }
+            runConversion(*job);
+
+            // Wake the UI so the table shows the result without waiting for the next timeout
+            SDL_Event wake = {};
+            wake.type = SDL_USEREVENT;
+            SDL_PushEvent(&wake);
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<ConversionJob*> queue_;
+    std::vector<std::thread> threads_;
+    std::vector<bool> active_; // Thread running its loop, guarded by mutex_
+    unsigned wanted_ = 0;
+    bool stopping_ = false;
+};
+
 int main(int, char**)
 {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0)
@@ -56,7 +311,7 @@ int main(int, char**)
         "SoundImageConverter",
         SDL_WINDOWPOS_CENTERED,
         SDL_WINDOWPOS_CENTERED,
-        480, 600,
+        560, 760,
         SDL_WINDOW_OPENGL | SDL_WINDOW_BORDERLESS
     );
     if (!window)
@@ -138,25 +393,147 @@ int main(int, char**)
     ImGui_ImplOpenGL3_Init("#version 330");
 
     // UI state
-    std::string wavPath, pngPath, statusMessage;
+    std::vector<std::string> wavPaths, pngPaths;
+    std::string statusMessage;
     char wavPathBuffer[256] = "";
     char pngPathBuffer[256] = "";
+    // Image backends, in registration order (PNG first)
+    const auto& codecs = SoundImageConverter::ImageCodecRegistry::instance().codecs();
+    std::vector<std::string> imageFilterStrings;
+    for (const auto& codec : codecs)
+    {
+        for (const std::string& extension : codec->extensions())
+        {
+            imageFilterStrings.push_back("*" + extension);
+        }
+    }
+    std::vector<const char*> imageFilters;
+    for (const std::string& filter : imageFilterStrings)
+    {
+        imageFilters.push_back(filter.c_str());
+    }
+    int outputFormat = 0; // Index into codecs
+
+    // Every job since the last "Clear finished", oldest first. Declared before the queue, whose workers point into it
+    std::vector<std::unique_ptr<ConversionJob>> jobs;
+    JobQueue queue;
+    const int maxWorkers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int workerCount = maxWorkers;
+    queue.setWorkers(static_cast<unsigned>(workerCount));
+    std::chrono::steady_clock::time_point queueStarted, queueFinished; // Wall time of the current or last run of the queue
+    bool queueBusy = false;
+
+    // Output goes to resources/, named after the input
+    auto queueJobs = [&](bool encode, const std::vector<std::string>& inputs)
+    {
+        std::set<std::string> reserved;
+        for (const std::unique_ptr<ConversionJob>& job : jobs)
+        {
+            reserved.insert(job->output);
+        }
+        for (const std::string& input : inputs)
+        {
+            std::unique_ptr<ConversionJob> job(new ConversionJob());
+            job->encode = encode;
+            job->input = input;
+            std::string extension = encode ? codecs[outputFormat]->extensions().front() : ".wav";
+            job->output = generateUniqueFileName("resources/" + std::filesystem::path(input).stem().string() + extension, reserved);
+            reserved.insert(job->output);
+            std::error_code ec;
+            job->inputBytes = std::filesystem::file_size(input, ec);
+            if (!queueBusy)
+            {
+                queueStarted = std::chrono::steady_clock::now();
+                queueBusy = true;
+            }
+            queue.push(job.get());
+            jobs.push_back(std::move(job));
+        }
+        statusMessage = "Queued " + std::to_string(inputs.size()) + (encode ? " audio file(s) to encode" : " image(s) to decode");
+    };
+
+    // Shows the selection in a read-only field: the path, or how many files
+    auto describeSelection = [](const std::vector<std::string>& paths, char* buffer, size_t size)
+    {
+        std::string text = paths.size() == 1 ? paths.front() : std::to_string(paths.size()) + " files selected";
+        snprintf(buffer, size, "%s", paths.empty() ? "" : text.c_str());
+    };
+
     bool running = true;
     bool showUI = true;
     bool isDragging = false;
     ImVec2 dragOffset;
 
+    // Frames are only drawn when something can change: a few after each input event (ImGui settles hover and
+    // click state over a couple of frames), about 30 a second while jobs run, and one a second when idle to
+    // refresh the counters below. Otherwise the thread sleeps in SDL_WaitEventTimeout.
+    const int settleFrames = 3;
+    int framesToSettle = settleFrames;
+    double frameMilliseconds = 0; // Building and submitting the last frame, without the wait for vsync
+    int framesPerSecond = 0;
+    int framesCounted = 0;
+    double cpuPercent = 0; // Whole process, jobs included, over the last second
+    auto sampleStart = std::chrono::steady_clock::now();
+    double sampleCpu = processCpuSeconds();
+
     while (running)
     {
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        int timeout = framesToSettle > 0 ? 0 : queueBusy ? 33 : 1000;
+        if (timeout == 0 ? SDL_PollEvent(&event) : SDL_WaitEventTimeout(&event, timeout))
         {
-            ImGui_ImplSDL2_ProcessEvent(&event);
-            if (event.type == SDL_QUIT)
+            std::vector<std::string> dropped;
+            do
             {
-                running = false;
+                ImGui_ImplSDL2_ProcessEvent(&event);
+                if (event.type == SDL_QUIT)
+                {
+                    running = false;
+                }
+                else if (event.type == SDL_DROPFILE)
+                {
+                    dropped.push_back(event.drop.file);
+                    SDL_free(event.drop.file);
+                }
+            } while (SDL_PollEvent(&event));
+            framesToSettle = settleFrames;
+
+            // Dropped files and folders go straight into the queue: images are decoded, audio is encoded to the selected format
+            std::vector<std::string> audio, images;
+            for (const std::string& path : dropped)
+            {
+                collectInputs(path, audio, images);
             }
+            if (!audio.empty())
+            {
+                queueJobs(true, audio);
+            }
+            if (!images.empty())
+            {
+                queueJobs(false, images);
+            }
+            if (!dropped.empty() && audio.empty() && images.empty())
+            {
+                statusMessage = "Nothing to convert in the dropped files.";
+            }
+        }
+        else if (framesToSettle > 0)
+        {
+            framesToSettle--;
+        }
+        auto frameStart = std::chrono::steady_clock::now();
+
+        double sampleSeconds = std::chrono::duration<double>(frameStart - sampleStart).count();
+        if (sampleSeconds >= 1.0)
+        {
+            double cpu = processCpuSeconds();
+            cpuPercent = (cpu - sampleCpu) / sampleSeconds * 100;
+            framesPerSecond = static_cast<int>(framesCounted / sampleSeconds + 0.5);
+            framesCounted = 0;
+            sampleStart = frameStart;
+            sampleCpu = cpu;
         }
+        framesCounted++;
 
         glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
         glClear(GL_COLOR_BUFFER_BIT);
@@ -262,49 +639,63 @@ int main(int, char**)
             {
                 ImGui::Spacing();
                 ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.8f, 0.8f, 0.8f, 1.0f));
-                ImGui::Text("Select WAV Audio File");
+                ImGui::Text("Select Audio Files or a Folder");
                 ImGui::PopStyleColor();
                 
-                ImGui::SetNextItemWidth(-100);
+                ImGui::SetNextItemWidth(-180);
                 ImGui::InputText("##WavFile", wavPathBuffer, sizeof(wavPathBuffer), ImGuiInputTextFlags_ReadOnly);
-                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Selected audio file path");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Selected audio files");
                 ImGui::SameLine();
                 if (ImGui::Button("Browse##Wav", ImVec2(80, 0)))
                 {
-                    const char* filters[] = { "*.wav" };
-                    const char* path = tinyfd_openFileDialog("Select Audio File", "", 1, filters, "WAV Files (*.wav)", 0);
-                    if (path)
+                    const char* filters[] = { "*.wav", "*.flac", "*.ogg", "*.mp3", "*.aif", "*.aiff" };
+                    const char* paths = tinyfd_openFileDialog("Select Audio Files", "", 6, filters, "Audio Files", 1);
+                    if (paths)
                     {
-                        strncpy_s(wavPathBuffer, sizeof(wavPathBuffer), path, _TRUNCATE);
-                        wavPath = path;
+                        wavPaths = splitDialogPaths(paths);
+                        describeSelection(wavPaths, wavPathBuffer, sizeof(wavPathBuffer));
                     }
                 }
-                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Select a WAV file to convert");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Select one or more audio files to convert");
+                ImGui::SameLine();
+                if (ImGui::Button("Folder##Wav", ImVec2(80, 0)))
+                {
+                    const char* folder = tinyfd_selectFolderDialog("Select Audio Folder", "");
+                    if (folder)
+                    {
+                        std::vector<std::string> images;
+                        wavPaths.clear();
+                        collectInputs(folder, wavPaths, images);
+                        describeSelection(wavPaths, wavPathBuffer, sizeof(wavPathBuffer));
+                    }
+                }
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Convert every audio file in a folder and its subfolders");
+
+                ImGui::Spacing();
+                for (int i = 0; i < static_cast<int>(codecs.size()); i++)
+                {
+                    if (i > 0) ImGui::SameLine();
+                    ImGui::RadioButton(codecs[i]->name(), &outputFormat, i);
+                    if (ImGui::IsItemHovered()) ImGui::SetTooltip("Save as %s", codecs[i]->extensions().front().c_str());
+                }
                 
                 ImGui::Spacing();
                 ImGui::SetCursorPosX((ImGui::GetWindowWidth() - 140) * 0.5f);
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.25f, 0.50f, 0.25f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.35f, 0.60f, 0.35f, 1.0f));
-                if (ImGui::Button("Convert to PNG", ImVec2(140, 32)))  // Remove checkmark
+                std::string convertLabel = std::string("Convert to ") + codecs[outputFormat]->name();
+                if (ImGui::Button(convertLabel.c_str(), ImVec2(140, 32)))  // Remove checkmark
                 {
-                    if (!wavPath.empty())
+                    if (!wavPaths.empty())
                     {
-                        std::string outPng = generateUniqueFileName("resources/output.png");
-                        if (SoundImageConverter::Encoder::encode(wavPath, outPng))
-                        {
-                            statusMessage = "Encoded successfully to " + outPng;
-                        }
-                        else
-                        {
-                            statusMessage = "Encoding failed!";
-                        }
+                        queueJobs(true, wavPaths);
                     }
                     else
                     {
                         statusMessage = "Please select an audio file first!";
                     }
                 }
-                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Convert selected WAV to PNG");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Convert the selected audio to images");
                 ImGui::PopStyleColor(2);
                 ImGui::Spacing();
             }
@@ -320,24 +711,36 @@ int main(int, char**)
             {
                 ImGui::Spacing();
                 ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.8f, 0.8f, 0.8f, 1.0f));
-                ImGui::Text("Select PNG Image File");
+                ImGui::Text("Select Images or a Folder");
                 ImGui::PopStyleColor();
                 
-                ImGui::SetNextItemWidth(-100);
+                ImGui::SetNextItemWidth(-180);
                 ImGui::InputText("##PngFile", pngPathBuffer, sizeof(pngPathBuffer), ImGuiInputTextFlags_ReadOnly);
-                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Selected image file path");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Selected images");
                 ImGui::SameLine();
                 if (ImGui::Button("Browse##Png", ImVec2(80, 0)))
                 {
-                    const char* filters[] = { "*.png" };
-                    const char* path = tinyfd_openFileDialog("Select Image File", "", 1, filters, "PNG Files (*.png)", 0);
-                    if (path)
+                    const char* paths = tinyfd_openFileDialog("Select Image Files", "", static_cast<int>(imageFilters.size()), imageFilters.data(), "Image Files", 1);
+                    if (paths)
+                    {
+                        pngPaths = splitDialogPaths(paths);
+                        describeSelection(pngPaths, pngPathBuffer, sizeof(pngPathBuffer));
+                    }
+                }
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Select one or more images to convert");
+                ImGui::SameLine();
+                if (ImGui::Button("Folder##Png", ImVec2(80, 0)))
+                {
+                    const char* folder = tinyfd_selectFolderDialog("Select Image Folder", "");
+                    if (folder)
                     {
-                        strncpy_s(pngPathBuffer, sizeof(pngPathBuffer), path, _TRUNCATE);
-                        pngPath = path;
+                        std::vector<std::string> audio;
+                        pngPaths.clear();
+                        collectInputs(folder, audio, pngPaths);
+                        describeSelection(pngPaths, pngPathBuffer, sizeof(pngPathBuffer));
                     }
                 }
-                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Select a PNG file to convert");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Convert every image in a folder and its subfolders");
                 
                 ImGui::Spacing();
                 ImGui::SetCursorPosX((ImGui::GetWindowWidth() - 140) * 0.5f);
@@ -345,29 +748,159 @@ int main(int, char**)
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.35f, 0.45f, 0.70f, 1.0f));
                 if (ImGui::Button("Convert to WAV", ImVec2(140, 32)))
                 {
-                    if (!pngPath.empty())
+                    if (!pngPaths.empty())
                     {
-                        std::string outWav = generateUniqueFileName("resources/output.wav");
-                        if (SoundImageConverter::Decoder::decode(pngPath, outWav))
-                        {
-                            statusMessage = "Decoded successfully to " + outWav;
-                        }
-                        else
-                        {
-                            statusMessage = "Decoding failed!";
-                        }
+                        queueJobs(false, pngPaths);
                     }
                     else
                     {
                         statusMessage = "Please select an image file first!";
                     }
                 }
-                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Convert selected PNG to WAV");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Convert the selected images to WAV");
                 ImGui::PopStyleColor(2);
                 ImGui::Spacing();
             }
             ImGui::PopStyleColor();
 
+            // Job queue: worker count, a row per job and the totals underneath
+            auto now = std::chrono::steady_clock::now();
+            size_t waiting = 0, succeeded = 0, failed = 0, cancelled = 0;
+            uint64_t totalIn = 0, totalOut = 0;
+            for (const std::unique_ptr<ConversionJob>& job : jobs)
+            {
+                int state = job->state;
+                waiting += state == ConversionJob::Queued || state == ConversionJob::Running;
+                succeeded += state == ConversionJob::Succeeded;
+                failed += state == ConversionJob::Failed;
+                cancelled += state == ConversionJob::Cancelled;
+                if (state == ConversionJob::Succeeded)
+                {
+                    totalIn += job->result.bytesIn;
+                    totalOut += job->result.bytesOut;
+                }
+            }
+            if (queueBusy && waiting == 0)
+            {
+                queueBusy = false;
+                queueFinished = now;
+                statusMessage = "Finished: " + std::to_string(succeeded) + " converted, " + std::to_string(failed) + " failed";
+            }
+
+            if (!jobs.empty())
+            {
+                ImGui::Spacing();
+                ImGui::Separator();
+                ImGui::Spacing();
+                ImGui::SetNextItemWidth(140);
+                if (ImGui::SliderInt("Workers", &workerCount, 1, maxWorkers))
+                {
+                    queue.setWorkers(static_cast<unsigned>(workerCount));
+                }
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Conversions running at the same time");
+                ImGui::SameLine();
+                if (ImGui::Button("Cancel All"))
+                {
+                    for (std::unique_ptr<ConversionJob>& job : jobs)
+                    {
+                        job->cancel.cancel();
+                    }
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Clear Finished"))
+                {
+                    // Queued jobs stay, even cancelled ones: the queue still points at them
+                    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const std::unique_ptr<ConversionJob>& job) { return job->finished(); }), jobs.end());
+                }
+
+                ImGuiTableFlags tableFlags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV;
+                if (ImGui::BeginTable("Jobs", 5, tableFlags, ImVec2(0, 170)))
+                {
+                    ImGui::TableSetupScrollFreeze(0, 1);
+                    ImGui::TableSetupColumn("File", ImGuiTableColumnFlags_WidthStretch);
+                    ImGui::TableSetupColumn("Status", ImGuiTableColumnFlags_WidthFixed, 130);
+                    ImGui::TableSetupColumn("Time", ImGuiTableColumnFlags_WidthFixed, 50);
+                    ImGui::TableSetupColumn("MB/s", ImGuiTableColumnFlags_WidthFixed, 50);
+                    ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 20);
+                    ImGui::TableHeadersRow();
+
+                    // Only the visible rows are built, so a folder of thousands of clips costs no more than a screenful
+                    ImGuiListClipper clipper;
+                    clipper.Begin(static_cast<int>(jobs.size()));
+                    while (clipper.Step())
+                    {
+                        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+                        {
+                            ConversionJob& job = *jobs[row];
+                            int state = job.state;
+                            double seconds = state == ConversionJob::Running ? std::chrono::duration<double>(now - job.started).count() : job.result.seconds;
+                            uint64_t total = job.framesTotal;
+                            double fraction = state == ConversionJob::Succeeded ? 1.0 : total != 0 ? static_cast<double>(job.framesDone) / total : 0.0;
+                            double bytes = state == ConversionJob::Succeeded ? static_cast<double>(job.result.bytesIn) : job.inputBytes * fraction;
+
+                            ImGui::PushID(row);
+                            ImGui::TableNextRow();
+                            ImGui::TableNextColumn();
+                            ImGui::TextUnformatted(std::filesystem::path(job.input).filename().string().c_str());
+                            if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s\n-> %s", job.input.c_str(), job.output.c_str());
+
+                            ImGui::TableNextColumn();
+                            switch (state)
+                            {
+                            case ConversionJob::Queued:
+                                ImGui::TextDisabled(job.cancel.cancelled() ? "Cancelling" : "Queued");
+                                break;
+                            case ConversionJob::Running:
+                            {
+                                char overlay[32];
+                                snprintf(overlay, sizeof(overlay), job.cancel.cancelled() ? "Cancelling" : fraction >= 1.0 ? "Finishing" : "%.0f%%", fraction * 100);
+                                ImGui::ProgressBar(static_cast<float>(fraction), ImVec2(-1, 0), overlay);
+                                break;
+                            }
+                            case ConversionJob::Succeeded:
+                                ImGui::TextColored(ImVec4(0.3f, 0.9f, 0.3f, 1.0f), job.encode ? "Encoded" : "Decoded");
+                                break;
+                            case ConversionJob::Failed:
+                                ImGui::TextColored(ImVec4(0.9f, 0.3f, 0.3f, 1.0f), "%s", describeError(job.result.error));
+                                break;
+                            default:
+                                ImGui::TextDisabled("Cancelled");
+                                break;
+                            }
+
+                            ImGui::TableNextColumn();
+                            if (state != ConversionJob::Queued && state != ConversionJob::Cancelled)
+                            {
+                                ImGui::Text("%.1f s", seconds);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.1f", seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+                            }
+                            else
+                            {
+                                ImGui::TableNextColumn();
+                            }
+
+                            ImGui::TableNextColumn();
+                            if (!job.finished())
+                            {
+                                if (ImGui::SmallButton("x"))
+                                {
+                                    job.cancel.cancel();
+                                }
+                                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Cancel and delete the partial output");
+                            }
+                            ImGui::PopID();
+                        }
+                    }
+                    ImGui::EndTable();
+                }
+
+                // Throughput of the whole queue in wall time, so it grows with the worker count
+                double wall = std::chrono::duration<double>((queueBusy ? now : queueFinished) - queueStarted).count();
+                ImGui::Text("%zu converted, %zu failed, %zu cancelled, %zu left  |  %.1f MB in, %.1f MB out  |  %.1f MB/s",
+                    succeeded, failed, cancelled, waiting, totalIn / 1e6, totalOut / 1e6, wall > 0 ? totalIn / wall / 1e6 : 0.0);
+            }
+
             // Status area
             if (!statusMessage.empty())
             {
@@ -400,14 +933,27 @@ int main(int, char**)
                 ImGui::PopStyleVar();
             }
 
+            // Idle cost counters
+            char counters[96];
+            snprintf(counters, sizeof(counters), "frame %.2f ms  %d fps  CPU %.1f%%", frameMilliseconds, framesPerSecond, cpuPercent);
+            drawList->AddText(ImVec2(windowPos.x + 20, windowPos.y + windowSize.y - 28), IM_COL32(110, 110, 120, 255), counters);
+
             ImGui::End();
         }
 
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        frameMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
         SDL_GL_SwapWindow(window);
     }
 
+    // Closing the window cancels whatever is still running or queued
+    for (std::unique_ptr<ConversionJob>& job : jobs)
+    {
+        job->cancel.cancel();
+    }
+    queue.stop();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,97 @@
+// Conversion daemon: keeps workers and buffers warm and converts requests sent over a Unix domain socket
+// (protocol in ConversionServer.h), and with --http over HTTP on 127.0.0.1 (HttpServer.h). Runs until SIGINT or SIGTERM.
+//   sic-daemon [-j THREADS] [-b BUFFERS] [--buffer-mb MB] [--http PORT] [socket path]
+#include "SoundImageConverter/ConversionServer.h"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace SoundImageConverter;
+
+namespace
+{
+	ConversionServer* runningServer = nullptr;
+
+	void handleSignal(int)
+	{
+		runningServer->stop();
+	}
+
+	void printUsage()
+	{
+		std::cerr << "Usage: sic-daemon [-j THREADS] [-b BUFFERS] [--buffer-mb MB] [--http PORT] [socket path]" << std::endl;
+		std::cerr << "The socket path may only be left out with --http" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	ServerOptions options;
+	std::string socketPath;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc)
+		{
+			options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+		}
+		else if (arg == "-b" && i + 1 < argc)
+		{
+			options.buffers = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+		}
+		else if (arg == "--buffer-mb" && i + 1 < argc)
+		{
+			options.bufferBytes = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+		}
+		else if (arg == "--http" && i + 1 < argc)
+		{
+			int port = std::atoi(argv[++i]);
+			if (port < 1 || port > 65535)
+			{
+				printUsage();
+				return EXIT_FAILURE;
+			}
+			options.httpPort = static_cast<uint16_t>(port);
+		}
+		else if (socketPath.empty() && arg[0] != '-')
+		{
+			socketPath = arg;
+		}
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (socketPath.empty() && options.httpPort == 0)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	ConversionServer server(options);
+	if (!server.start(socketPath))
+	{
+		return EXIT_FAILURE;
+	}
+	runningServer = &server;
+	std::signal(SIGINT, handleSignal);
+	std::signal(SIGTERM, handleSignal);
+	std::signal(SIGPIPE, SIG_IGN); // A client hanging up mid-answer fails that send, not the daemon
+	if (!socketPath.empty())
+	{
+		std::cout << "Listening on " << socketPath << std::endl;
+	}
+	if (options.httpPort != 0)
+	{
+		std::cout << "Listening on http://127.0.0.1:" << options.httpPort << "/" << std::endl;
+	}
+
+	server.run();
+
+	ServerStats stats = server.stats();
+	std::cout << "Stopped after " << stats.requests << " requests (" << stats.failed << " failed) on "
+		<< stats.connections << " connections" << std::endl;
+	return EXIT_SUCCESS;
+}
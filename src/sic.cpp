@@ -0,0 +1,375 @@
+// Command line front end for the conversion core.
+//   sic encode [-r RATE] [--raw FORMAT:RATE:CHANNELS] [-t TYPE] [--mem-report] <in.wav|-> <out.png|.qoi|.pam|->
+//   sic decode [--raw] [-t TYPE] [--mem-report] <in.png|.qoi|.pam|-> <out.wav|->
+//   "-" reads standard input or writes standard output; -t names the image type of a piped image;
+//   --mem-report prints the bytes each stage held and the process RSS
+//   sic verify [-j N] <image or directory>...
+//   sic batch encode|decode [-j N] [-q DEPTH] [--no-uring] [-r RATE] <input dir> <output dir> <output extension>
+#include "SoundImageConverter/Converter.h"
+#include "SoundImageConverter/BatchConverter.h"
+#include "SoundImageConverter/ImageCodec.h"
+#include "SoundImageConverter/Checksum.h"
+#include "SoundImageConverter/Stream.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SoundImageConverter;
+
+namespace
+{
+	void printUsage()
+	{
+		std::cerr << "Usage:" << std::endl
+			<< "  sic encode [-r RATE] [--raw u8|s16le:RATE:CHANNELS] [-t TYPE] [--mem-report] <in.wav|-> <out image|->" << std::endl
+			<< "  sic decode [--raw] [-t TYPE] [--mem-report] <in image|-> <out.wav|->" << std::endl
+			<< "  sic verify [-j N] <image or directory>..." << std::endl
+			<< "  sic batch encode|decode [-j N] [-q DEPTH] [--no-uring] [-r RATE] <input dir> <output dir> <output extension>" << std::endl;
+	}
+
+	// Parses FORMAT:RATE:CHANNELS, FORMAT being u8 or s16le (ffmpeg's names)
+	bool parseRawFormat(const std::string& spec, EncodeOptions& options)
+	{
+		size_t first = spec.find(':');
+		size_t second = first == std::string::npos ? first : spec.find(':', first + 1);
+		if (second == std::string::npos)
+		{
+			return false;
+		}
+		std::string format = spec.substr(0, first);
+		options.rawBitDepth = format == "u8" ? 8 : 16;
+		options.rawSampleRate = static_cast<uint32_t>(std::strtoul(spec.c_str() + first + 1, nullptr, 10));
+		options.rawChannels = std::atoi(spec.c_str() + second + 1);
+		return (format == "u8" || format == "s16le") && options.rawSampleRate != 0 && options.rawChannels > 0;
+	}
+
+	void printResult(std::ostream& log, const ConversionResult& result)
+	{
+		log << std::fixed << std::setprecision(3) << result.frames << " frames in " << result.seconds << " s (busy: read "
+			<< result.readSeconds << ", pack " << result.packSeconds << ", write " << result.writeSeconds << "), "
+			<< result.bytesIn << " bytes in, " << result.bytesOut << " bytes out, " << result.peakBufferBytes << " bytes of buffers" << std::endl;
+		log.unsetf(std::ios_base::floatfield);
+	}
+
+	// Per stage, KiB held at the end and at the most, then the RSS
+	void printMemory(std::ostream& log, const MemoryUsage& memory)
+	{
+		auto row = [&log](const char* name, const StageMemory& stage)
+		{
+			log << "  " << std::left << std::setw(7) << name << std::right << std::setw(12) << stage.current / 1024
+				<< std::setw(12) << stage.peak / 1024 << std::endl;
+		};
+		log << "Memory (KiB)    current        peak" << std::endl;
+		for (int i = 0; i < MemoryStageCount; i++)
+		{
+			row(memoryStageName(static_cast<MemoryStage>(i)), memory.stages[i]);
+		}
+		row("total", memory.total);
+		log << "RSS " << memory.residentBytes / 1024 << " KiB at the end, " << memory.peakResidentBytes / 1024 << " KiB at the highest sample" << std::endl;
+	}
+
+	// Encodes or decodes one file, "-" standing for standard input or output.
+	// A piped image has no name to take the backend from, so type ("png", "qoi", ...) names it
+	int convert(bool encode, const std::string& input, const std::string& output, const std::string& type,
+		EncodeOptions encodeOptions, DecodeOptions decodeOptions, bool memoryReport)
+	{
+		bool pipeIn = input == "-";
+		bool pipeOut = output == "-";
+		if (!pipeIn && !pipeOut)
+		{
+			ConversionResult result = encode ? Encoder::encode(input, output, encodeOptions) : Decoder::decode(input, output, decodeOptions);
+			if (result.ok())
+			{
+				printResult(std::cout, result);
+			}
+			if (memoryReport)
+			{
+				printMemory(std::cout, result.memory);
+			}
+			return result.ok() ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		std::string imagePath = encode ? output : input;
+		std::string audioPath = encode ? input : output;
+		if (imagePath == "-")
+		{
+			if (type.empty())
+			{
+				std::cerr << "Error: -t TYPE is needed to pipe an image" << std::endl;
+				return EXIT_FAILURE;
+			}
+			imagePath = (encode ? "stdout." : "stdin.") + type;
+		}
+		if (audioPath == "-")
+		{
+			audioPath = encode ? "stdin" : "stdout";
+		}
+		if (pipeOut && decodeOptions.output == AudioOutputByName)
+		{
+			decodeOptions.output = AudioOutputWav; // libsndfile formats need a seekable file
+		}
+
+		FileInputStream pipe;
+		std::unique_ptr<InputStream> file = pipeIn ? nullptr : openInputFile(input);
+		if ((pipeIn && !pipe.openStandardInput()) || (!pipeIn && !file))
+		{
+			std::cerr << "Error: Could not open " << input << std::endl;
+			return EXIT_FAILURE;
+		}
+		// Only standard output is opened here; a named output is written, and removed on failure, by the converter,
+		// which for FLAC and the like must open it through libsndfile anyway
+		FileOutputStream out;
+		if (pipeOut && !out.openStandardOutput())
+		{
+			std::cerr << "Error: Could not open " << output << " for writing" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		// Progress goes to stderr while stdout carries the data
+		std::ostream& log = pipeOut ? std::cerr : std::cout;
+		encodeOptions.log = &log;
+		decodeOptions.log = &log;
+		InputStream& in = pipeIn ? static_cast<InputStream&>(pipe) : *file;
+		ConversionResult result;
+		if (encode)
+		{
+			result = pipeOut ? Encoder::encode(in, audioPath, out, imagePath, encodeOptions) : Encoder::encode(in, audioPath, imagePath, encodeOptions);
+		}
+		else
+		{
+			result = pipeOut ? Decoder::decode(in, imagePath, out, audioPath, decodeOptions) : Decoder::decode(in, imagePath, audioPath, decodeOptions);
+		}
+		bool ok = result.ok();
+		if (ok)
+		{
+			printResult(log, result);
+		}
+		if (memoryReport)
+		{
+			printMemory(log, result.memory);
+		}
+		if (pipeOut && !out.close())
+		{
+			std::cerr << "Error: Could not write " << output << std::endl;
+			ok = false;
+		}
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Expands directories (recursively) to the images a registered backend can read
+	void collectImages(const std::string& path, std::vector<std::string>& images)
+	{
+		std::error_code ec;
+		if (!std::filesystem::is_directory(path, ec))
+		{
+			images.push_back(path);
+			return;
+		}
+		for (auto it = std::filesystem::recursive_directory_iterator(path, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+		{
+			if (it->is_regular_file(ec) && ImageCodecRegistry::instance().findForPath(it->path().string()))
+			{
+				images.push_back(it->path().string());
+			}
+		}
+		std::sort(images.begin(), images.end());
+	}
+
+	// Verifies every image on a pool of threads; each file is one mapped, sequential read
+	int verify(const std::vector<std::string>& images, unsigned threadCount)
+	{
+		std::atomic<size_t> next(0);
+		std::atomic<size_t> failed(0);
+		std::mutex printMutex;
+
+		auto worker = [&]()
+		{
+			for (size_t i = next++; i < images.size(); i = next++)
+			{
+				bool ok = Decoder::verify(images[i]);
+				if (!ok)
+				{
+					failed++;
+				}
+				std::lock_guard<std::mutex> lock(printMutex);
+				std::cout << (ok ? "OK   " : "FAIL ") << images[i] << std::endl;
+			}
+		};
+
+		threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(images.size())));
+		std::vector<std::thread> threads;
+		for (unsigned t = 1; t < threadCount; t++)
+		{
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		std::cout << images.size() - failed << " of " << images.size() << " images verified"
+			<< (Checksum::hardwareAccelerated() ? " (CRC32C: SSE4.2)" : " (CRC32C: software)") << std::endl;
+		return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Converts every file directly in inputDir (images only, when decoding) to outputDir/<name>.<extension>
+	int batch(const std::string& mode, const std::string& inputDir, const std::string& outputDir, std::string extension, const BatchOptions& options)
+	{
+		if (!extension.empty() && extension[0] != '.')
+		{
+			extension.insert(0, ".");
+		}
+		std::error_code ec;
+		std::filesystem::create_directories(outputDir, ec);
+
+		std::vector<BatchJob> jobs;
+		for (auto it = std::filesystem::directory_iterator(inputDir, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+		{
+			if (!it->is_regular_file(ec) || (mode == "decode" && !ImageCodecRegistry::instance().findForPath(it->path().string())))
+			{
+				continue;
+			}
+			BatchJob job;
+			job.input = it->path().string();
+			job.output = (std::filesystem::path(outputDir) / it->path().stem()).string() + extension;
+			jobs.push_back(job);
+		}
+		std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.input < b.input; });
+		if (jobs.empty())
+		{
+			std::cerr << "Error: No input files in " << inputDir << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		BatchResult result = mode == "encode" ? BatchConverter::encode(jobs, options) : BatchConverter::decode(jobs, options);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << result.converted << " of " << jobs.size() << " files converted in " << seconds << " s ("
+			<< static_cast<size_t>(jobs.size() / std::max(seconds, 1e-9)) << " files/s, "
+			<< (result.usedIoUring ? "io_uring" : "pread/pwrite") << ")" << std::endl;
+		return result.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	std::string command = argv[1];
+	if (command == "encode" || command == "decode")
+	{
+		EncodeOptions encodeOptions;
+		DecodeOptions decodeOptions;
+		std::string type;
+		std::vector<std::string> paths;
+		bool valid = true;
+		bool memoryReport = false;
+		for (int i = 2; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "-r" && i + 1 < argc && command == "encode")
+			{
+				encodeOptions.sampleRate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+			}
+			else if (arg == "--raw" && i + 1 < argc && command == "encode")
+			{
+				valid = parseRawFormat(argv[++i], encodeOptions) && valid;
+			}
+			else if (arg == "--raw" && command == "decode")
+			{
+				decodeOptions.output = AudioOutputRaw;
+			}
+			else if (arg == "-t" && i + 1 < argc)
+			{
+				type = argv[++i];
+			}
+			else if (arg == "--mem-report")
+			{
+				memoryReport = true;
+			}
+			else
+			{
+				paths.push_back(arg);
+			}
+		}
+		if (valid && paths.size() == 2)
+		{
+			return convert(command == "encode", paths[0], paths[1], type, encodeOptions, decodeOptions, memoryReport);
+		}
+	}
+	if (command == "verify")
+	{
+		unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::string> images;
+		for (int i = 2; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "-j" && i + 1 < argc)
+			{
+				threadCount = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			}
+			else
+			{
+				collectImages(arg, images);
+			}
+		}
+		if (images.empty())
+		{
+			std::cerr << "Error: No images to verify." << std::endl;
+			return EXIT_FAILURE;
+		}
+		return verify(images, threadCount);
+	}
+	if (command == "batch" && argc >= 3)
+	{
+		std::string mode = argv[2];
+		BatchOptions options;
+		std::vector<std::string> paths;
+		for (int i = 3; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "-j" && i + 1 < argc)
+			{
+				options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if (arg == "-q" && i + 1 < argc)
+			{
+				options.queueDepth = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if (arg == "-r" && i + 1 < argc)
+			{
+				options.encode.sampleRate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+			}
+			else if (arg == "--no-uring")
+			{
+				options.allowIoUring = false;
+			}
+			else
+			{
+				paths.push_back(arg);
+			}
+		}
+		if ((mode == "encode" || mode == "decode") && paths.size() == 3)
+		{
+			return batch(mode, paths[0], paths[1], paths[2], options);
+		}
+	}
+
+	printUsage();
+	return EXIT_FAILURE;
+}
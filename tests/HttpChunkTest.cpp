@@ -0,0 +1,111 @@
+// Chunked request bodies on the HTTP endpoint: well-formed chunks are converted, chunk sizes that are not plain hex,
+// longer than 16 digits, or that would wrap the running total past the request limit are refused, and so are
+// Content-Length headers that are not plain digits, repeated, or sent along with chunking.
+// Runs every check, then exits non-zero if any failed.
+// Usage: SoundImageConverterHttpChunkTest
+#include "SoundImageConverter/HttpServer.h"
+#include "SoundImageConverter/Stream.h"
+#include "SyntheticAudio.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace SoundImageConverter;
+
+namespace
+{
+	const uint64_t maxRequestBytes = 1 << 20;
+
+	std::string hex(size_t value)
+	{
+		char text[32];
+		std::snprintf(text, sizeof(text), "%zx", value);
+		return text;
+	}
+
+	// Sends one POST /encode with the given body and framing headers over a socket pair served by an HttpConnection,
+	// and returns the status line of the answer
+	std::string statusLine(const std::string& body, const std::string& framing = "Transfer-Encoding: chunked\r\n")
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		{
+			return "socketpair failed";
+		}
+		HttpConnection connection(fds[0], maxRequestBytes);
+		std::thread server([&]() { connection.serve([](const ConversionResult&) {}); });
+
+		std::string request = "POST /encode?type=qoi HTTP/1.1\r\nHost: localhost\r\n" + framing + "\r\n" + body;
+		size_t sent = 0;
+		while (sent < request.size())
+		{
+			ssize_t n = send(fds[1], request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+			if (n <= 0)
+			{
+				break;
+			}
+			sent += static_cast<size_t>(n);
+		}
+		shutdown(fds[1], SHUT_WR);
+
+		std::string answer;
+		char buffer[4096];
+		while (answer.find("\r\n") == std::string::npos)
+		{
+			ssize_t n = recv(fds[1], buffer, sizeof(buffer), 0);
+			if (n <= 0)
+			{
+				break;
+			}
+			answer.append(buffer, static_cast<size_t>(n));
+		}
+		connection.shutdown();
+		server.join();
+		close(fds[1]);
+		return answer.substr(0, answer.find("\r\n"));
+	}
+
+	bool checkStatus(const std::string& status, const std::string& expected, const std::string& what)
+	{
+		return check(status.compare(0, expected.size(), expected) == 0, what + ": expected " + expected + "..., got \"" + status + "\"");
+	}
+}
+
+int main()
+{
+	// The data size is patched to 0xFFFFFFFF so the encoder reads to the end of the body
+	std::vector<uint8_t> bytes = smallWav(8000, 1, 1000, 0xFFFFFFFFu);
+	std::string wav(bytes.begin(), bytes.end());
+	std::string half = wav.substr(0, wav.size() / 2);
+	std::string rest = wav.substr(wav.size() / 2);
+	bool ok = true;
+
+	ok = checkStatus(statusLine(hex(half.size()) + "\r\n" + half + "\r\n" + hex(rest.size()) + ";name=value\r\n" + rest + "\r\n0\r\n\r\n"),
+					 "HTTP/1.1 200", "two chunks") && ok;
+	ok = checkStatus(statusLine(std::string(16, '0') + hex(wav.size()) + "\r\n" + wav + "\r\n0\r\n\r\n"), "HTTP/1.1 4", "more than 16 digits") && ok;
+	ok = checkStatus(statusLine("+" + hex(wav.size()) + "\r\n" + wav + "\r\n0\r\n\r\n"), "HTTP/1.1 4", "sign before the size") && ok;
+	ok = checkStatus(statusLine("0x" + hex(wav.size()) + "\r\n" + wav + "\r\n0\r\n\r\n"), "HTTP/1.1 4", "0x before the size") && ok;
+	ok = checkStatus(statusLine(hex(maxRequestBytes + 1) + "\r\n" + wav + "\r\n0\r\n\r\n"), "HTTP/1.1 413", "chunk over the limit") && ok;
+	// 1 + 0xffffffffffffffff wraps around to 0; the rest of the WAV would then be read as one endless chunk
+	ok = checkStatus(statusLine("1\r\n" + wav.substr(0, 1) + "\r\nffffffffffffffff\r\n" + wav.substr(1)), "HTTP/1.1 413", "total wrapping around") && ok;
+
+	std::string length = "Content-Length: " + std::to_string(wav.size()) + "\r\n";
+	ok = checkStatus(statusLine(wav, length), "HTTP/1.1 200", "Content-Length") && ok;
+	ok = checkStatus(statusLine(wav, "Content-Length: +" + std::to_string(wav.size()) + "\r\n"), "HTTP/1.1 400", "sign before the length") && ok;
+	ok = checkStatus(statusLine(wav, "Content-Length: " + std::to_string(wav.size()) + "x\r\n"), "HTTP/1.1 400", "junk after the length") && ok;
+	ok = checkStatus(statusLine(wav, "Content-Length: \r\n"), "HTTP/1.1 400", "empty length") && ok;
+	ok = checkStatus(statusLine(wav, length + length), "HTTP/1.1 400", "repeated Content-Length") && ok;
+	ok = checkStatus(statusLine(hex(wav.size()) + "\r\n" + wav + "\r\n0\r\n\r\n", length + "Transfer-Encoding: chunked\r\n"), "HTTP/1.1 400",
+					 "Content-Length and chunked") && ok;
+	ok = checkStatus(statusLine(wav, "Transfer-Encoding: gzip\r\n"), "HTTP/1.1 400", "unsupported Transfer-Encoding") && ok;
+
+	std::cout << (ok ? "HTTP chunks: OK" : "HTTP chunks: FAILED") << std::endl;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,178 @@
+// A recording longer than 2^31 samples, out of core: generated while the encoder reads it, the image goes through a
+// 4 MiB pipe to the decoder on a second thread, and the decoded PCM is counted and checksummed as it arrives, so
+// nothing touches the disk and memory stays constant. Exits non-zero if the frame count or CRC differs.
+// Usage: SoundImageConverterLongRecordingTest [frames] [type]
+// frames defaults to 2^31 + 1000, past every 32-bit sample and byte count, and type (the image extension) to qoi.
+// 560000000 frames make a PNG past the 2 GB that stb_image can inflate at once
+#include "SoundImageConverter/Checksum.h"
+#include "SoundImageConverter/Converter.h"
+#include "SoundImageConverter/Stream.h"
+#include "SyntheticAudio.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SoundImageConverter;
+
+namespace
+{
+	// Bounded in-memory pipe between the encoder and the decoder threads
+	class BytePipe
+	{
+	public:
+		class Writer : public OutputStream
+		{
+		public:
+			explicit Writer(BytePipe& pipe) : pipe_(pipe) {}
+			bool write(const void* data, size_t size) override { return pipe_.write(data, size); }
+
+		private:
+			BytePipe& pipe_;
+		};
+
+		class Reader : public InputStream
+		{
+		public:
+			explicit Reader(BytePipe& pipe) : pipe_(pipe) {}
+			size_t read(void* data, size_t size) override { return pipe_.read(data, size); }
+
+		private:
+			BytePipe& pipe_;
+		};
+
+		bool write(const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (size > 0)
+			{
+				changed_.wait(lock, [&]() { return buffer_.size() - head_ < capacity || readerDone_; });
+				if (readerDone_)
+				{
+					return false;
+				}
+				if (head_ > 0)
+				{
+					buffer_.erase(buffer_.begin(), buffer_.begin() + head_);
+					head_ = 0;
+				}
+				size_t count = std::min(size, capacity - buffer_.size());
+				buffer_.insert(buffer_.end(), bytes, bytes + count);
+				bytes += count;
+				size -= count;
+				changed_.notify_all();
+			}
+			return true;
+		}
+
+		size_t read(void* data, size_t size)
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			changed_.wait(lock, [&]() { return buffer_.size() > head_ || writerDone_; });
+			size_t count = std::min(size, buffer_.size() - head_);
+			std::copy(buffer_.begin() + head_, buffer_.begin() + head_ + count, static_cast<uint8_t*>(data));
+			head_ += count;
+			changed_.notify_all();
+			return count;
+		}
+
+		void closeWriter() { close(writerDone_); }
+		void closeReader() { close(readerDone_); }
+
+	private:
+		static const size_t capacity = 4 << 20;
+
+		void close(bool& done)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			done = true;
+			changed_.notify_all();
+		}
+
+		std::mutex mutex_;
+		std::condition_variable changed_;
+		std::vector<uint8_t> buffer_;
+		size_t head_ = 0; // Read position; consumed bytes are dropped by the next write
+		bool writerDone_ = false;
+		bool readerDone_ = false;
+	};
+
+	// Counts the decoded PCM and takes its CRC32C, and the CRC of what the generator says it should be, without keeping either
+	class ChecksumOutputStream : public OutputStream
+	{
+	public:
+		explicit ChecksumOutputStream(const SyntheticWavStream& source) : source_(source) {}
+
+		bool write(const void* data, size_t size) override
+		{
+			expected_.resize(size);
+			source_.samples(bytes_, expected_.data(), size, true);
+			crc_ = Checksum::crc32c(crc_, data, size);
+			expectedCrc_ = Checksum::crc32c(expectedCrc_, expected_.data(), size);
+			bytes_ += size;
+			return true;
+		}
+
+		uint64_t bytes() const { return bytes_; }
+		uint32_t crc() const { return crc_; }
+		uint32_t expectedCrc() const { return expectedCrc_; }
+
+	private:
+		const SyntheticWavStream& source_;
+		std::vector<uint8_t> expected_;
+		uint64_t bytes_ = 0;
+		uint32_t crc_ = 0;
+		uint32_t expectedCrc_ = 0;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t frames = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1ull << 31) + 1000;
+	std::string imagePath = std::string("long.") + (argc > 2 ? argv[2] : "qoi");
+	if (frames == 0)
+	{
+		std::cerr << "Error: the frame count must be positive" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	SyntheticWavStream source(frames);
+	ChecksumOutputStream decoded(source);
+	BytePipe pipe;
+	BytePipe::Writer imageOut(pipe);
+	BytePipe::Reader imageIn(pipe);
+	EncodeOptions encodeOptions;
+	DecodeOptions decodeOptions;
+	decodeOptions.output = AudioOutputRaw;
+	encodeOptions.log = nullptr;
+	decodeOptions.log = nullptr;
+
+	auto start = std::chrono::steady_clock::now();
+	ConversionResult encoded;
+	std::thread encoder([&]()
+	{
+		encoded = Encoder::encode(source, "synthetic.wav", imageOut, imagePath, encodeOptions);
+		pipe.closeWriter();
+	});
+	ConversionResult result = Decoder::decode(imageIn, imagePath, decoded, "long.raw", decodeOptions);
+	pipe.closeReader();
+	encoder.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	bool ok = check(encoded.ok(), "encode: error " + std::to_string(encoded.error));
+	ok = check(result.ok(), "decode: error " + std::to_string(result.error)) && ok;
+	ok = check(encoded.frames == frames && result.frames == frames,
+			   "frames: expected " + std::to_string(frames) + ", encoded " + std::to_string(encoded.frames) + ", decoded " + std::to_string(result.frames)) && ok;
+	ok = check(decoded.bytes() == frames * 2, "decoded bytes: expected " + std::to_string(frames * 2) + ", got " + std::to_string(decoded.bytes())) && ok;
+	ok = check(decoded.crc() == decoded.expectedCrc(), "CRC32C: expected " + Checksum::toHex(decoded.expectedCrc()) + ", got " + Checksum::toHex(decoded.crc())) && ok;
+
+	std::cout << "Long recording, " << frames << " frames as " << imagePath << " in " << elapsed.count() << " s: " << (ok ? "OK" : "FAILED") << std::endl;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
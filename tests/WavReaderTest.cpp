@@ -0,0 +1,86 @@
+// WAV files whose writer never patched the data size (0 or 0xFFFFFFFF): a mapped file takes its length from the
+// file size, a stream is read to its end. Runs every check, then exits non-zero if any failed.
+// Usage: SoundImageConverterWavReaderTest [workdir]
+#include "SoundImageConverter/Converter.h"
+#include "SoundImageConverter/Stream.h"
+#include "SoundImageConverter/WavFile.h"
+#include "SyntheticAudio.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SoundImageConverter;
+
+namespace
+{
+	const uint64_t frameCount = 40000;
+
+	// 16-bit stereo WAV in memory, a stray byte after the last frame and the data size replaced by placeholder
+	std::vector<uint8_t> wavWithSize(uint32_t placeholder)
+	{
+		std::vector<uint8_t> wav = smallWav(22050, 2, frameCount, placeholder);
+		wav.push_back(0);
+		return wav;
+	}
+
+	// Hides the view, as a pipe would
+	class PipeInputStream : public InputStream
+	{
+	public:
+		explicit PipeInputStream(InputStream& in) : in_(in) {}
+		size_t read(void* data, size_t size) override { return in_.read(data, size); }
+
+	private:
+		InputStream& in_;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	std::filesystem::path dir = argc > 1 ? std::filesystem::path(argv[1]) : std::filesystem::temp_directory_path();
+	bool ok = true;
+	for (uint32_t placeholder : { 0u, 0xFFFFFFFFu })
+	{
+		std::vector<uint8_t> wav = wavWithSize(placeholder);
+		std::string name = "data size " + std::to_string(placeholder);
+
+		// In memory, with a view
+		MemoryInputStream memory(wav.data(), wav.size());
+		WavReader reader;
+		WavFormat format;
+		ok = check(reader.open(memory, format) && format.frames == frameCount, name + ", view: frames from the size") && ok;
+
+		// Without one the length is unknown and the encoder reads to the end
+		MemoryInputStream hidden(wav.data(), wav.size());
+		PipeInputStream pipe(hidden);
+		WavReader pipeReader;
+		ok = check(pipeReader.open(pipe, format) && format.frames == WavFormat::unknownFrames, name + ", pipe: unknown length") && ok;
+
+		// A mapped file, all the way through the encoder and decoder
+		std::string wavPath = (dir / ("sic_wavreader_" + std::to_string(placeholder) + ".wav")).string();
+		std::string imagePath = (dir / ("sic_wavreader_" + std::to_string(placeholder) + ".qoi")).string();
+		std::string decodedPath = (dir / ("sic_wavreader_" + std::to_string(placeholder) + "_decoded.wav")).string();
+		FILE* file = std::fopen(wavPath.c_str(), "wb");
+		bool written = file && std::fwrite(wav.data(), 1, wav.size(), file) == wav.size();
+		written = file && std::fclose(file) == 0 && written;
+		EncodeOptions encodeOptions;
+		encodeOptions.log = nullptr;
+		DecodeOptions decodeOptions;
+		decodeOptions.log = nullptr;
+		ConversionResult encoded = written ? Encoder::encode(wavPath, imagePath, encodeOptions) : ConversionResult();
+		ok = check(written && encoded.ok() && encoded.frames == frameCount, name + ", mapped file: encoded frames") && ok;
+		ConversionResult decoded = encoded.ok() ? Decoder::decode(imagePath, decodedPath, decodeOptions) : ConversionResult();
+		ok = check(encoded.ok() && decoded.ok() && decoded.frames == frameCount, name + ", mapped file: decoded frames") && ok;
+
+		std::error_code ec;
+		std::filesystem::remove(wavPath, ec);
+		std::filesystem::remove(imagePath, ec);
+		std::filesystem::remove(decodedPath, ec);
+	}
+	std::cout << (ok ? "WAV reader: OK" : "WAV reader: FAILED") << std::endl;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}